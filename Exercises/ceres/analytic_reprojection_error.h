@@ -0,0 +1,231 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_ANALYTIC_REPROJECTION_ERROR_H_
+#define EXERCISES_CERES_ANALYTIC_REPROJECTION_ERROR_H_
+
+#include <math.h>
+#include <limits>
+
+#include "Eigen/Core"
+#include "ceres/ceres.h"
+#include "ceres/rotation.h"
+#include "cost_function_arena.h"
+#include "reprojection_error.h"
+
+namespace openMVG {
+
+// The same residual as ReprojectionError, with the same parameter
+// blocks, but with hand derived Jacobians. Automatic differentiation
+// of ReprojectionError propagates 15 dimensional dual numbers through
+// the whole computation; here the rotation matrix is computed once
+// and the Jacobians are assembled from a handful of small matrix
+// products.
+//
+// With p = point - center, q = R(rotation) * p, u = (q_x, q_y) / q_z
+// and
+//
+//   projection = principal_point + focal * (1 + k1 r^2 + k2 r^4 + k3 r^6) u
+//
+// where r^2 = |u|^2, the chain rule gives
+//
+//   d residual / d point    =  J_q * R
+//   d residual / d center   = -J_q * R
+//   d residual / d rotation =  J_q * d(R p) / d rotation
+//
+// with J_q = d projection / d q. For the derivative of the rotation
+// see
+//
+//   G. Gallego and A. Yezzi, A compact formula for the derivative of a
+//   3-D rotation in exponential coordinates, JMIV 51(3), 2015.
+//
+// whose formula is evaluated here in the equivalent form based on the
+// right Jacobian of SO(3), which stays accurate for small angles.
+//
+// analytic_reprojection_error_test compares all of this with automatic
+// differentiation of ReprojectionError.
+class AnalyticReprojectionError
+    : public ceres::SizedCostFunction<2, 6, 6, 3> {
+ public:
+  AnalyticReprojectionError(const double x, const double y)
+      : x_(x), y_(y) {}
+
+  virtual ~AnalyticReprojectionError() {}
+
+  virtual bool Evaluate(double const* const* parameters,
+                        double* residuals,
+                        double** jacobians) const {
+    typedef Eigen::Matrix<double, 3, 3, Eigen::RowMajor> Matrix3;
+    typedef Eigen::Matrix<double, 2, 3, Eigen::RowMajor> Matrix23;
+    typedef Eigen::Matrix<double, 2, 6, Eigen::RowMajor> Matrix26;
+
+    const double* intrinsics = parameters[0];
+    const double* rotation = parameters[1];
+    const double* center = parameters[1] + 3;
+    const double* point = parameters[2];
+
+    Matrix3 R;
+    ceres::AngleAxisToRotationMatrix(rotation,
+                                     ceres::RowMajorAdapter3x3(R.data()));
+    const Eigen::Vector3d p(point[0] - center[0],
+                            point[1] - center[1],
+                            point[2] - center[2]);
+    const Eigen::Vector3d q = R * p;
+
+    const double inverse_depth = 1.0 / q[2];
+    const double x_u = q[0] * inverse_depth;
+    const double y_u = q[1] * inverse_depth;
+
+    const double focal = intrinsics[ReprojectionError::OFFSET_FOCAL_LENGTH];
+    const double k1 = intrinsics[ReprojectionError::OFFSET_DISTO_K1];
+    const double k2 = intrinsics[ReprojectionError::OFFSET_DISTO_K2];
+    const double k3 = intrinsics[ReprojectionError::OFFSET_DISTO_K3];
+
+    const double r2 = x_u * x_u + y_u * y_u;
+    const double r4 = r2 * r2;
+    const double r6 = r4 * r2;
+    const double r_coeff = 1.0 + k1 * r2 + k2 * r4 + k3 * r6;
+    const double x_d = x_u * r_coeff;
+    const double y_d = y_u * r_coeff;
+
+    residuals[0] =
+        intrinsics[ReprojectionError::OFFSET_PRINCIPAL_POINT_X] +
+        focal * x_d - x_;
+    residuals[1] =
+        intrinsics[ReprojectionError::OFFSET_PRINCIPAL_POINT_Y] +
+        focal * y_d - y_;
+
+    if (jacobians == NULL) {
+      return true;
+    }
+
+    if (jacobians[0] != NULL) {
+      Eigen::Map<Matrix26> J(jacobians[0]);
+      J(0, ReprojectionError::OFFSET_FOCAL_LENGTH) = x_d;
+      J(1, ReprojectionError::OFFSET_FOCAL_LENGTH) = y_d;
+      J(0, ReprojectionError::OFFSET_PRINCIPAL_POINT_X) = 1.0;
+      J(1, ReprojectionError::OFFSET_PRINCIPAL_POINT_X) = 0.0;
+      J(0, ReprojectionError::OFFSET_PRINCIPAL_POINT_Y) = 0.0;
+      J(1, ReprojectionError::OFFSET_PRINCIPAL_POINT_Y) = 1.0;
+      J(0, ReprojectionError::OFFSET_DISTO_K1) = focal * x_u * r2;
+      J(1, ReprojectionError::OFFSET_DISTO_K1) = focal * y_u * r2;
+      J(0, ReprojectionError::OFFSET_DISTO_K2) = focal * x_u * r4;
+      J(1, ReprojectionError::OFFSET_DISTO_K2) = focal * y_u * r4;
+      J(0, ReprojectionError::OFFSET_DISTO_K3) = focal * x_u * r6;
+      J(1, ReprojectionError::OFFSET_DISTO_K3) = focal * y_u * r6;
+    }
+
+    if (jacobians[1] == NULL && jacobians[2] == NULL) {
+      return true;
+    }
+
+    // d projection / d u, scaled by the focal length.
+    const double d_coeff = 2.0 * (k1 + 2.0 * k2 * r2 + 3.0 * k3 * r4);
+    Eigen::Matrix2d J_u;
+    J_u(0, 0) = focal * (r_coeff + d_coeff * x_u * x_u);
+    J_u(0, 1) = focal * d_coeff * x_u * y_u;
+    J_u(1, 0) = J_u(0, 1);
+    J_u(1, 1) = focal * (r_coeff + d_coeff * y_u * y_u);
+
+    // d u / d q.
+    Matrix23 J_uq;
+    J_uq << inverse_depth, 0.0, -x_u * inverse_depth,
+            0.0, inverse_depth, -y_u * inverse_depth;
+
+    const Matrix23 J_q = J_u * J_uq;
+    const Matrix23 J_p = J_q * R;
+
+    if (jacobians[2] != NULL) {
+      Eigen::Map<Matrix23> J(jacobians[2]);
+      J = J_p;
+    }
+
+    if (jacobians[1] != NULL) {
+      Eigen::Map<Matrix26> J(jacobians[1]);
+      Matrix3 p_cross;
+      p_cross << 0.0, -p[2], p[1],
+                 p[2], 0.0, -p[0],
+                 -p[1], p[0], 0.0;
+
+      const Eigen::Map<const Eigen::Vector3d> w(rotation);
+      const double theta2 = w.squaredNorm();
+      if (theta2 > std::numeric_limits<double>::epsilon()) {
+        // d(R p) / dw = -R [p]_x J_r(w), with the right Jacobian
+        //
+        //   J_r(w) = I - a [w]_x + b [w]_x^2,
+        //
+        // a = (1 - cos(theta)) / theta^2 and b = (theta - sin(theta)) /
+        // theta^3. Both cancel catastrophically for small angles, where
+        // their Taylor series are used instead.
+        double a;
+        double b;
+        if (theta2 > 1e-4) {
+          const double theta = sqrt(theta2);
+          a = (1.0 - cos(theta)) / theta2;
+          b = (theta - sin(theta)) / (theta2 * theta);
+        } else {
+          a = 0.5 - theta2 * (1.0 / 24.0 - theta2 / 720.0);
+          b = 1.0 / 6.0 - theta2 * (1.0 / 120.0 - theta2 / 5040.0);
+        }
+        Matrix3 w_cross;
+        w_cross << 0.0, -w[2], w[1],
+                   w[2], 0.0, -w[0],
+                   -w[1], w[0], 0.0;
+        const Matrix3 right_jacobian =
+            Matrix3::Identity() - a * w_cross + b * w_cross * w_cross;
+        J.leftCols<3>() = -J_p * p_cross * right_jacobian;
+      } else {
+        // Near zero AngleAxisToRotationMatrix uses R = I + [w]_x, whose
+        // derivative is d(w x p) / dw = -[p]_x.
+        J.leftCols<3>() = -J_q * p_cross;
+      }
+      J.rightCols<3>() = -J_p;
+    }
+
+    return true;
+  }
+
+  static ceres::CostFunction* Create(const double x, const double y) {
+    return new AnalyticReprojectionError(x, y);
+  }
+
+  static ceres::CostFunction* Create(const double x,
+                                     const double y,
+                                     CostFunctionArena* arena) {
+    if (arena == NULL) {
+      return Create(x, y);
+    }
+    return arena->Construct<AnalyticReprojectionError>(x, y);
+  }
+
+ private:
+  double x_;
+  double y_;
+};
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_ANALYTIC_REPROJECTION_ERROR_H_
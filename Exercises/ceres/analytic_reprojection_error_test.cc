@@ -0,0 +1,226 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Compares the residuals and Jacobians of AnalyticReprojectionError
+// with those of ReprojectionError differentiated automatically, at
+// random poses and at rotations at and around its small angle branches.
+// Exits with a non-zero status if any of them differ.
+//
+// Usage: analytic_reprojection_error_test [--logtostderr]
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+
+#include "analytic_reprojection_error.h"
+#include "ceres/ceres.h"
+#include "ceres/rotation.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "random.h"
+#include "reprojection_error.h"
+
+namespace openMVG {
+namespace {
+
+const double kTolerance = 1e-9;
+
+// A camera with random intrinsics at the given rotation and a random
+// center, a random point in front of it and a random observation, all
+// determined by index.
+struct TestCase {
+  double intrinsics[6];
+  double pose[6];
+  double point[3];
+  double x;
+  double y;
+};
+
+double Uniform(const CounterBasedRandom& random,
+               const uint64_t index,
+               const uint32_t block,
+               const double min,
+               const double max) {
+  double u1, u2;
+  random.Uniform(index, 0, block, &u1, &u2);
+  return min + (max - min) * u1;
+}
+
+void MakeTestCase(const CounterBasedRandom& random,
+                  const uint64_t index,
+                  const double* rotation,
+                  TestCase* test_case) {
+  uint32_t block = 0;
+  test_case->intrinsics[0] = Uniform(random, index, block++, 500.0, 2000.0);
+  test_case->intrinsics[1] = Uniform(random, index, block++, 300.0, 700.0);
+  test_case->intrinsics[2] = Uniform(random, index, block++, 200.0, 500.0);
+  test_case->intrinsics[3] = Uniform(random, index, block++, -0.3, 0.3);
+  test_case->intrinsics[4] = Uniform(random, index, block++, -0.1, 0.1);
+  test_case->intrinsics[5] = Uniform(random, index, block++, -0.05, 0.05);
+  std::copy(rotation, rotation + 3, test_case->pose);
+  for (int i = 3; i < 6; ++i) {
+    test_case->pose[i] = Uniform(random, index, block++, -1.0, 1.0);
+  }
+
+  // The point at q in the frame of the camera, i.e.,
+  // point = center + R^T q.
+  double q[3];
+  q[0] = Uniform(random, index, block++, -2.0, 2.0);
+  q[1] = Uniform(random, index, block++, -2.0, 2.0);
+  q[2] = Uniform(random, index, block++, 2.0, 10.0);
+  double inverse_rotation[3];
+  for (int i = 0; i < 3; ++i) {
+    inverse_rotation[i] = -rotation[i];
+  }
+  ceres::AngleAxisRotatePoint(inverse_rotation, q, test_case->point);
+  for (int i = 0; i < 3; ++i) {
+    test_case->point[i] += test_case->pose[3 + i];
+  }
+
+  test_case->x = Uniform(random, index, block++, 0.0, 1000.0);
+  test_case->y = Uniform(random, index, block++, 0.0, 1000.0);
+}
+
+// The largest difference between the analytic and automatic residuals
+// and Jacobians, relative to the magnitude of the automatic ones.
+double MaxRelativeDifference(const TestCase& test_case) {
+  ceres::AutoDiffCostFunction<ReprojectionError, 2, 6, 6, 3> autodiff(
+      new ReprojectionError(test_case.x, test_case.y));
+  AnalyticReprojectionError analytic(test_case.x, test_case.y);
+
+  const double* parameters[3] = {
+    test_case.intrinsics, test_case.pose, test_case.point
+  };
+  const int sizes[3] = {6, 6, 3};
+  double expected_residuals[2];
+  double actual_residuals[2];
+  double expected_jacobians[3][12];
+  double actual_jacobians[3][12];
+  double* expected[3] = {
+    expected_jacobians[0], expected_jacobians[1], expected_jacobians[2]
+  };
+  double* actual[3] = {
+    actual_jacobians[0], actual_jacobians[1], actual_jacobians[2]
+  };
+  CHECK(autodiff.Evaluate(parameters, expected_residuals, expected));
+  CHECK(analytic.Evaluate(parameters, actual_residuals, actual));
+
+  double max_difference = 0.0;
+  for (int i = 0; i < 2; ++i) {
+    max_difference = std::max(
+        max_difference,
+        fabs(expected_residuals[i] - actual_residuals[i]) /
+            (1.0 + fabs(expected_residuals[i])));
+  }
+  for (int k = 0; k < 3; ++k) {
+    for (int i = 0; i < 2 * sizes[k]; ++i) {
+      max_difference = std::max(
+          max_difference,
+          fabs(expected_jacobians[k][i] - actual_jacobians[k][i]) /
+              (1.0 + fabs(expected_jacobians[k][i])));
+    }
+  }
+  return max_difference;
+}
+
+// Checks num_cases test cases whose rotations have the given norm and
+// random directions, or random norms up to pi if norm is negative.
+// Returns the number of failures.
+int CheckRotations(const CounterBasedRandom& random,
+                   const uint64_t first_index,
+                   const int num_cases,
+                   const double norm,
+                   const char* name) {
+  int num_failures = 0;
+  double worst = 0.0;
+  for (int i = 0; i < num_cases; ++i) {
+    const uint64_t index = first_index + i;
+    double rotation[3];
+    double n1, n2, n3, unused;
+    random.Normal(index, 1, 0, &n1, &n2);
+    random.Normal(index, 1, 1, &n3, &unused);
+    const double length = sqrt(n1 * n1 + n2 * n2 + n3 * n3);
+    const double angle =
+        norm >= 0.0 ? norm : Uniform(random, index, 100, 0.0, M_PI);
+    rotation[0] = angle * n1 / length;
+    rotation[1] = angle * n2 / length;
+    rotation[2] = angle * n3 / length;
+
+    TestCase test_case;
+    MakeTestCase(random, index, rotation, &test_case);
+    const double difference = MaxRelativeDifference(test_case);
+    worst = std::max(worst, difference);
+    if (!(difference <= kTolerance)) {
+      LOG(ERROR) << name << ": test case " << index
+                 << " differs by " << difference;
+      ++num_failures;
+    }
+  }
+  LOG(INFO) << name << ": " << num_cases - num_failures << " of "
+            << num_cases << " passed, maximum relative difference "
+            << worst << ".";
+  return num_failures;
+}
+
+}  // namespace
+}  // namespace openMVG
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  const openMVG::CounterBasedRandom random(38401);
+  const double epsilon = std::numeric_limits<double>::epsilon();
+  int num_failures = 0;
+  num_failures += openMVG::CheckRotations(random, 0, 10000, -1.0,
+                                          "Random rotations");
+  num_failures += openMVG::CheckRotations(random, 10000, 100, 0.0,
+                                          "Zero rotation");
+  num_failures += openMVG::CheckRotations(random, 10100, 1000, 1e-12,
+                                          "Rotation of 1e-12");
+  // Around the switch to the small angle branch at theta^2 = epsilon.
+  num_failures += openMVG::CheckRotations(random, 11100, 1000,
+                                          0.5 * sqrt(epsilon),
+                                          "Just below the small angle limit");
+  num_failures += openMVG::CheckRotations(random, 12100, 1000,
+                                          2.0 * sqrt(epsilon),
+                                          "Just above the small angle limit");
+  // Around the switch to the Taylor series of the right Jacobian at
+  // theta^2 = 1e-4.
+  num_failures += openMVG::CheckRotations(random, 13100, 1000, 1e-3,
+                                          "Rotation of 1e-3");
+  num_failures += openMVG::CheckRotations(random, 14100, 1000, 0.99e-2,
+                                          "Just below the series limit");
+  num_failures += openMVG::CheckRotations(random, 15100, 1000, 1.01e-2,
+                                          "Just above the series limit");
+  if (num_failures > 0) {
+    LOG(ERROR) << num_failures << " test cases failed.";
+    return 1;
+  }
+  LOG(INFO) << "All test cases passed.";
+  return 0;
+}
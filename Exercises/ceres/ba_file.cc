@@ -31,64 +31,576 @@
 #include "ba_file.h"
 
 #include <math.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <algorithm>
 #include <fstream>
 #include <string>
 #include <vector>
 #include "Eigen/Core"
+#include "binary_baf_format.h"
 #include "ceres/rotation.h"
 #include "glog/logging.h"
+#include "mapped_file.h"
+#include "random.h"
 
 namespace openMVG {
 namespace {
 
-// Return a random number sampled from a uniform distribution in the range
-// [0,1].
-inline double RandDouble() {
-  double r = static_cast<double>(rand());
-  return r / RAND_MAX;
+// Streams of random numbers used by BAFile::Perturb.
+enum PerturbationStream {
+  POINT_STREAM = 0,
+  ROTATION_STREAM = 1,
+  POSITION_STREAM = 2
+};
+
+// Add normally distributed noise with standard deviation sigma to
+// the three coordinates of point. The noise only depends on the
+// random number generator's seed, stream and index.
+void PerturbPoint3(const CounterBasedRandom& random,
+                   const PerturbationStream stream,
+                   const uint64_t index,
+                   const double sigma,
+                   double* point) {
+  if (sigma <= 0) return;
+  double noise[4];
+  random.Normal(index, stream, 0, &noise[0], &noise[1]);
+  random.Normal(index, stream, 1, &noise[2], &noise[3]);
+  for (int i = 0; i < 3; ++i) {
+    point[i] += noise[i] * sigma;
+  }
+}
+
+// A tokenizer for the whitespace separated numbers in a BAF file,
+// operating directly on the contents of a memory mapped file.
+//
+// Unlike std::istream, it does no allocation and does not consult
+// the locale. Integers and decimal numbers with at most 19
+// significant digits and a decimal exponent of magnitude at most 22
+// (which covers everything openMVG writes) are converted using a
+// single correctly rounded floating point operation. Everything else
+// falls back to strtod. Either way the result is the same correctly
+// rounded double that std::istream >> double produces.
+class BAFTextReader {
+ public:
+  BAFTextReader(const char* begin, const char* end)
+      : pos_(begin), end_(end) {}
+
+  bool Read(int* value) {
+    SkipWhitespace();
+    const char* pos = pos_;
+    const bool negative = ConsumeSign(&pos);
+    const char* digits_begin = pos;
+    int64_t result = 0;
+    while (pos < end_ && IsDigit(*pos)) {
+      result = 10 * result + (*pos - '0');
+      if (result > 2147483648LL) {
+        return false;
+      }
+      ++pos;
+    }
+
+    if (pos == digits_begin) {
+      return false;
+    }
+
+    result = negative ? -result : result;
+    if (result > 2147483647LL) {
+      return false;
+    }
+    *value = static_cast<int>(result);
+    pos_ = pos;
+    return true;
+  }
+
+  bool Read(double* value) {
+    SkipWhitespace();
+    const char* pos = pos_;
+    const bool negative = ConsumeSign(&pos);
+
+    uint64_t mantissa = 0;
+    int num_significant_digits = 0;
+    int num_digits = 0;
+    int exponent = 0;
+
+    // Integer part.
+    for (; pos < end_ && IsDigit(*pos); ++pos, ++num_digits) {
+      if (mantissa == 0 && *pos == '0') {
+        continue;
+      }
+      if (++num_significant_digits <= kMaxSignificantDigits) {
+        mantissa = 10 * mantissa + (*pos - '0');
+      } else {
+        ++exponent;
+      }
+    }
+
+    // Fractional part.
+    if (pos < end_ && *pos == '.') {
+      for (++pos; pos < end_ && IsDigit(*pos); ++pos, ++num_digits) {
+        if (mantissa == 0 && *pos == '0') {
+          --exponent;
+          continue;
+        }
+        if (++num_significant_digits <= kMaxSignificantDigits) {
+          mantissa = 10 * mantissa + (*pos - '0');
+          --exponent;
+        }
+      }
+    }
+
+    if (num_digits == 0) {
+      return false;
+    }
+
+    // Exponent. As with std::istream, an 'e' which is not followed by
+    // a valid exponent is an error.
+    if (pos < end_ && (*pos == 'e' || *pos == 'E')) {
+      ++pos;
+      const bool negative_exponent = ConsumeSign(&pos);
+      if (pos == end_ || !IsDigit(*pos)) {
+        return false;
+      }
+      int explicit_exponent = 0;
+      for (; pos < end_ && IsDigit(*pos); ++pos) {
+        if (explicit_exponent < 100000) {
+          explicit_exponent = 10 * explicit_exponent + (*pos - '0');
+        }
+      }
+      exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+    }
+
+    // Both the mantissa and the power of ten are exactly representable
+    // as doubles, so a single multiplication or division yields the
+    // correctly rounded result.
+    static const double kPowersOfTen[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+      1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+      1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    if (num_significant_digits <= kMaxSignificantDigits &&
+        mantissa <= (1ULL << 53) &&
+        exponent >= -22 &&
+        exponent <= 22) {
+      double result = static_cast<double>(mantissa);
+      if (exponent < 0) {
+        result /= kPowersOfTen[-exponent];
+      } else {
+        result *= kPowersOfTen[exponent];
+      }
+      *value = negative ? -result : result;
+      pos_ = pos;
+      return true;
+    }
+
+    return ReadSlow(pos, value);
+  }
+
+  void SkipWhitespace() {
+    while (pos_ < end_ && IsWhitespace(*pos_)) {
+      ++pos_;
+    }
+  }
+
+  const char* pos() const { return pos_; }
+
+ private:
+  static const int kMaxSignificantDigits = 19;
+
+  static bool IsDigit(const char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  static bool IsWhitespace(const char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' ||
+        c == '\v' || c == '\f';
+  }
+
+  bool ConsumeSign(const char** pos) const {
+    if (*pos < end_ && (**pos == '-' || **pos == '+')) {
+      return *(*pos)++ == '-';
+    }
+    return false;
+  }
+
+  // Convert the already validated token [pos_, token_end) using
+  // strtod. The token is copied into a null terminated buffer since
+  // the memory mapped file is not null terminated.
+  bool ReadSlow(const char* token_end, double* value) {
+    const size_t length = token_end - pos_;
+    char buffer[128];
+    if (length < sizeof(buffer)) {
+      memcpy(buffer, pos_, length);
+      buffer[length] = '\0';
+      *value = strtod(buffer, NULL);
+    } else {
+      *value = strtod(std::string(pos_, length).c_str(), NULL);
+    }
+    pos_ = token_end;
+    return true;
+  }
+
+  const char* pos_;
+  const char* end_;
+};
+
+// The points and observations read from a range of the point section
+// of a text BAF file.
+struct PointBlock {
+  PointBlock() : begin(NULL), end(NULL) {}
+
+  std::vector<double> points;
+  std::vector<int> num_observations;
+  std::vector<int> intrinsics_ids;
+  std::vector<int> pose_ids;
+  std::vector<double> x;
+  std::vector<double> y;
+
+  // The first and one past the last character of the records read,
+  // not counting surrounding whitespace.
+  const char* begin;
+  const char* end;
+};
+
+// Read at most max_num_points point records, stopping at the first
+// record that starts at or after block_end. Records may extend past
+// block_end, but not past file_end. Returns false if a record could
+// not be parsed.
+bool ReadPointBlock(const char* block_begin,
+                    const char* block_end,
+                    const char* file_end,
+                    int max_num_points,
+                    PointBlock* block) {
+  BAFTextReader reader(block_begin, file_end);
+  reader.SkipWhitespace();
+  block->begin = reader.pos();
+  for (int i = 0; i < max_num_points && reader.pos() < block_end; ++i) {
+    double point[3];
+    int num_observations_for_point = 0;
+    if (!reader.Read(&point[0]) ||
+        !reader.Read(&point[1]) ||
+        !reader.Read(&point[2]) ||
+        !reader.Read(&num_observations_for_point) ||
+        num_observations_for_point <= 0) {
+      return false;
+    }
+    block->points.insert(block->points.end(), point, point + 3);
+    block->num_observations.push_back(num_observations_for_point);
+
+    for (int j = 0; j < num_observations_for_point; ++j) {
+      Observation observation;
+      if (!reader.Read(&observation.intrinsics_id) ||
+          !reader.Read(&observation.pose_id) ||
+          !reader.Read(&observation.x) ||
+          !reader.Read(&observation.y)) {
+        return false;
+      }
+
+      VLOG(2) << "observation:"
+              << " " <<  observation.intrinsics_id
+              << " " <<  observation.pose_id
+              << " " << observation.x << " " << observation.y;
+
+      block->intrinsics_ids.push_back(observation.intrinsics_id);
+      block->pose_ids.push_back(observation.pose_id);
+      block->x.push_back(observation.x);
+      block->y.push_back(observation.y);
+    }
+    reader.SkipWhitespace();
+  }
+  block->end = reader.pos();
+  return true;
 }
 
-// Marsaglia Polar method for generation standard normal (pseudo)
-// random numbers http://en.wikipedia.org/wiki/Marsaglia_polar_method
-inline double RandNormal() {
-  double x1, x2, w;
-  do {
-    x1 = 2.0 * RandDouble() - 1.0;
-    x2 = 2.0 * RandDouble() - 1.0;
-    w = x1 * x1 + x2 * x2;
-  } while ( w >= 1.0 || w == 0.0 );
+// Split the point section [begin, end) of a text BAF file into about
+// num_blocks ranges and read them in parallel.
+//
+// openMVG writes one point record per line, so the ranges are cut at
+// line breaks. This assumption is verified afterwards: every range
+// except the first must start exactly where the previous one stopped
+// reading, and all together they must contain num_points records.
+// Returns false if that is not the case, or if any of the ranges could
+// not be read.
+bool ReadPointBlocksInParallel(const char* begin,
+                               const char* end,
+                               const int num_points,
+                               const int num_blocks,
+                               const int num_threads,
+                               std::vector<PointBlock>* blocks) {
+  std::vector<const char*> boundaries(num_blocks + 1, end);
+  boundaries[0] = begin;
+  for (int i = 1; i < num_blocks; ++i) {
+    const char* boundary =
+        std::max(boundaries[i - 1], begin + (end - begin) / num_blocks * i);
+    boundary = std::find(boundary, end, '\n');
+    boundaries[i] = (boundary == end) ? end : boundary + 1;
+  }
+
+  blocks->clear();
+  blocks->resize(num_blocks);
+  std::vector<int> success(num_blocks, 0);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+#endif
+  for (int i = 0; i < num_blocks; ++i) {
+    success[i] = ReadPointBlock(boundaries[i],
+                                boundaries[i + 1],
+                                end,
+                                num_points,
+                                &(*blocks)[i]);
+  }
 
-  w = sqrt((-2.0 * log(w)) / w);
-  return x1 * w;
+  int num_points_read = 0;
+  for (int i = 0; i < num_blocks; ++i) {
+    const PointBlock& block = (*blocks)[i];
+    if (!success[i] || (i > 0 && block.begin != (*blocks)[i - 1].end)) {
+      return false;
+    }
+    num_points_read += block.num_observations.size();
+  }
+  return num_points_read == num_points;
 }
 
-void PerturbPoint3(const double sigma, double* point) {
-  if (sigma <= 0) return;
+// Spread the lower 21 bits of x out so that there are two zero bits
+// between each of them.
+inline uint64_t SpreadBits(uint64_t x) {
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+  return x;
+}
+
+// Position of a point along a Morton (Z-order) curve through the box
+// [min, max], using 21 bits per coordinate.
+inline uint64_t MortonCode(const double* point,
+                           const double* min,
+                           const double* max) {
+  uint64_t code = 0;
   for (int i = 0; i < 3; ++i) {
-    point[i] += RandNormal() * sigma;
+    const double extent = max[i] - min[i];
+    const double t = (extent > 0.0) ? (point[i] - min[i]) / extent : 0.0;
+    const uint64_t q = static_cast<uint64_t>(
+        std::min(std::max(t, 0.0), 1.0) * 2097151.0);
+    code |= SpreadBits(q) << i;
+  }
+  return code;
+}
+
+// Sort keys for BAFile::Reorder. Ties are broken by the current id,
+// which makes the sort deterministic.
+struct PointSortKey {
+  int dominant_pose_id;
+  uint64_t morton_code;
+  int point_id;
+
+  bool operator<(const PointSortKey& other) const {
+    if (dominant_pose_id != other.dominant_pose_id) {
+      return dominant_pose_id < other.dominant_pose_id;
+    }
+    if (morton_code != other.morton_code) {
+      return morton_code < other.morton_code;
+    }
+    return point_id < other.point_id;
   }
+};
+
+// Arrays smaller than this are not worth selecting from in parallel.
+const int kMinParallelSelectSize = 1 << 16;
+
+// Number of vertices formatted at a time when writing PLY files.
+const int kPLYVerticesPerBlock = 65536;
+
+void WritePLYHeader(const char* format,
+                    const int num_vertices,
+                    std::ofstream* of) {
+  *of << "ply"
+      << '\n' << "format " << format << " 1.0"
+      << '\n' << "element vertex " << num_vertices
+      << '\n' << "property float x"
+      << '\n' << "property float y"
+      << '\n' << "property float z"
+      << '\n' << "property uchar red"
+      << '\n' << "property uchar green"
+      << '\n' << "property uchar blue"
+      << '\n' << "end_header" << '\n';
+}
+
+// Vertices 0 ... num_poses() - 1 of the PLY files are the camera
+// centers, the rest are the points.
+void GetPLYVertex(const BAFile& ba_file,
+                  const int vertex_id,
+                  const double** xyz,
+                  const unsigned char** color) {
+  // Export extrinsic data (i.e. camera centers) as green points and
+  // the structure (i.e. 3D Points) as white points.
+  static const unsigned char kGreen[3] = { 0, 255, 0 };
+  static const unsigned char kWhite[3] = { 255, 255, 255 };
+  if (vertex_id < ba_file.num_poses()) {
+    *xyz = ba_file.GetPose(vertex_id) + 3;
+    *color = kGreen;
+  } else {
+    *xyz = ba_file.GetPoint(vertex_id - ba_file.num_poses());
+    *color = kWhite;
+  }
+}
+
+void AppendPLYVertex(const BAFile& ba_file,
+                     const int vertex_id,
+                     std::string* buffer) {
+  const double* xyz = NULL;
+  const unsigned char* color = NULL;
+  GetPLYVertex(ba_file, vertex_id, &xyz, &color);
+
+  // %g formats doubles exactly like std::ostream does by default.
+  char line[128];
+  const int length = snprintf(line, sizeof(line), "%g %g %g %d %d %d\n",
+                              xyz[0], xyz[1], xyz[2],
+                              color[0], color[1], color[2]);
+  buffer->append(line, length);
+}
+
+// Map a double to an unsigned integer such that the integers compare
+// the same way as the doubles do.
+inline uint64_t OrderedKey(const double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const uint64_t kSignBit = 1ULL << 63;
+  return (bits & kSignBit) ? ~bits : (bits | kSignBit);
+}
+
+// Return the element that std::nth_element would put at position k,
+// using num_threads threads.
+//
+// This is one round of a most significant digit radix selection. The
+// elements are counted by the top 16 bits of their OrderedKey in
+// parallel, the elements in the bucket that contains the k-th
+// element are gathered in parallel, and std::nth_element is then used
+// on those alone.
+double Select(std::vector<double>* data, const int k, const int num_threads) {
+  const int n = data->size();
+  if (num_threads == 1 || n < kMinParallelSelectSize) {
+    std::nth_element(data->begin(), data->begin() + k, data->end());
+    return (*data)[k];
+  }
+
+  const int kNumBuckets = 1 << 16;
+  const int kShift = 48;
+  const int num_chunks = num_threads;
+  std::vector<std::vector<int> > chunk_counts(num_chunks);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(num_threads)
+#endif
+  for (int chunk = 0; chunk < num_chunks; ++chunk) {
+    std::vector<int>& counts = chunk_counts[chunk];
+    counts.resize(kNumBuckets, 0);
+    const int begin = static_cast<int64_t>(n) * chunk / num_chunks;
+    const int end = static_cast<int64_t>(n) * (chunk + 1) / num_chunks;
+    for (int i = begin; i < end; ++i) {
+      ++counts[OrderedKey((*data)[i]) >> kShift];
+    }
+  }
+
+  // Find the bucket containing the k-th element, and the position of
+  // the k-th element within it.
+  int bucket = 0;
+  int num_before_bucket = 0;
+  for (; bucket < kNumBuckets; ++bucket) {
+    int count = 0;
+    for (int chunk = 0; chunk < num_chunks; ++chunk) {
+      count += chunk_counts[chunk][bucket];
+    }
+    if (num_before_bucket + count > k) {
+      break;
+    }
+    num_before_bucket += count;
+  }
+
+  std::vector<int> chunk_offsets(num_chunks + 1, 0);
+  for (int chunk = 0; chunk < num_chunks; ++chunk) {
+    chunk_offsets[chunk + 1] =
+        chunk_offsets[chunk] + chunk_counts[chunk][bucket];
+  }
+
+  std::vector<double> candidates(chunk_offsets.back());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(num_threads)
+#endif
+  for (int chunk = 0; chunk < num_chunks; ++chunk) {
+    const int begin = static_cast<int64_t>(n) * chunk / num_chunks;
+    const int end = static_cast<int64_t>(n) * (chunk + 1) / num_chunks;
+    int offset = chunk_offsets[chunk];
+    for (int i = begin; i < end; ++i) {
+      if ((OrderedKey((*data)[i]) >> kShift) == bucket) {
+        candidates[offset++] = (*data)[i];
+      }
+    }
+  }
+
+  const int k_in_bucket = k - num_before_bucket;
+  std::nth_element(candidates.begin(),
+                   candidates.begin() + k_in_bucket,
+                   candidates.end());
+  return candidates[k_in_bucket];
 }
 
-double Median(std::vector<double>* data) {
-  int n = data->size();
-  std::vector<double>::iterator mid_point = data->begin() + n / 2;
-  std::nth_element(data->begin(), mid_point, data->end());
-  return *mid_point;
+double Median(std::vector<double>* data, const int num_threads) {
+  return Select(data, data->size() / 2, num_threads);
 }
 
 }  // namespace
 
 BAFile::BAFile(const std::string& filename) {
-  std::ifstream file(filename.c_str());
-  if (!file.good()) {
+  Load(filename, Options());
+}
+
+BAFile::BAFile(const std::string& filename, const Options& options) {
+  Load(filename, options);
+}
+
+void BAFile::Load(const std::string& filename, const Options& options) {
+  CHECK_GE(options.num_threads, 1);
+  options_ = options;
+  num_observations_ = 0;
+  poses_ = NULL;
+  points_ = NULL;
+  point_offsets_ = NULL;
+  intrinsics_ids_ = NULL;
+  pose_ids_ = NULL;
+  observation_x_ = CoordinateArray();
+  observation_y_ = CoordinateArray();
+
+  if (!mapped_file_.Open(filename)) {
     LOG(FATAL) << "Unable to open file: " << filename;
   }
 
-  file >> num_intrinsics_;
-  file >> num_poses_;
-  file >> num_points_;
+  const char* data = mapped_file_.data();
+  const size_t size = mapped_file_.size();
+  if (size >= sizeof(kBinaryBAFMagic) &&
+      memcmp(data, kBinaryBAFMagic, sizeof(kBinaryBAFMagic)) == 0) {
+    ReadBinary();
+  } else {
+    ReadText(data, data + size, options.num_threads);
+    mapped_file_.Close();
+  }
+  ValidateObservations();
+
+  if (options.merge_intrinsics_tolerance >= 0.0) {
+    MergeIntrinsics(options.merge_intrinsics_tolerance);
+  }
+}
+
+void BAFile::ReadText(const char* begin,
+                      const char* end,
+                      const int num_threads) {
+  BAFTextReader reader(begin, end);
+  CHECK(reader.Read(&num_intrinsics_));
+  CHECK(reader.Read(&num_poses_));
+  CHECK(reader.Read(&num_points_));
 
   LOG(INFO) << "Reading BAF file with:"
             << " num_intrinsics: " << num_intrinsics_
@@ -99,14 +611,19 @@ BAFile::BAFile(const std::string& filename) {
   CHECK_GE(num_poses_, 1);
   CHECK_GE(num_points_, 1);
 
-  intrinsics_.resize(6 * num_intrinsics_);
-  poses_.resize(6 * num_poses_);
-  points_.resize(3 * num_points_);
-  observations_.resize(num_points_);
+  std::vector<double>& parameters = storage_.parameters;
+  parameters.resize(6 * num_poses_ + 3 * num_points_);
+  poses_ = &parameters[0];
+  points_ = poses_ + 6 * num_poses_;
 
   // Read the intrinsics.
-  for (int i = 0; i < intrinsics_.size(); ++i) {
-    CHECK(file >> intrinsics_[i]);
+  intrinsics_.resize(kMaxNumIntrinsicParameters * num_intrinsics_, 0.0);
+  camera_models_.resize(num_intrinsics_, RADIAL_K3);
+  for (int i = 0; i < num_intrinsics_; ++i) {
+    double* intrinsics = GetIntrinsics(i);
+    for (int j = 0; j < 6; ++j) {
+      CHECK(reader.Read(&intrinsics[j]));
+    }
   }
 
   for (int i = 0; i < num_poses_; ++i) {
@@ -114,87 +631,848 @@ BAFile::BAFile(const std::string& filename) {
     double* center = &poses_[6 * i + 3];
     double rotation_matrix[9];
     for (int j = 0; j < 9; ++j) {
-      CHECK(file >> rotation_matrix[j]);
+      CHECK(reader.Read(&rotation_matrix[j]));
     }
 
     ceres::RotationMatrixToAngleAxis(
         ceres::ColumnMajorAdapter3x3<const double>(rotation_matrix),
         angle_axis);
 
-    CHECK((file >> center[0] >> center[1] >> center[2]));
+    CHECK(reader.Read(&center[0]) &&
+          reader.Read(&center[1]) &&
+          reader.Read(&center[2]));
+  }
+
+  // Read the points and their observations, in parallel if possible.
+  std::vector<PointBlock> blocks;
+  const int num_blocks = (num_threads > 1) ? 4 * num_threads : 1;
+  if (num_blocks == 1 ||
+      !ReadPointBlocksInParallel(reader.pos(), end, num_points_,
+                                 num_blocks, num_threads, &blocks)) {
+    if (num_blocks > 1) {
+      LOG(WARNING) << "Unable to split the points of the BAF file into "
+                   << "blocks, reading them using a single thread.";
+    }
+    blocks.clear();
+    blocks.resize(1);
+    CHECK(ReadPointBlock(reader.pos(), end, end, num_points_, &blocks[0]))
+        << "Error reading point " << blocks[0].num_observations.size();
+    CHECK_EQ(static_cast<int>(blocks[0].num_observations.size()), num_points_);
+  }
+
+  // Compute the offsets of the blocks in the observation arrays and
+  // then copy them there, reusing the arrays of the first block unless
+  // the coordinates are converted to single precision.
+  const int num_blocks_read = blocks.size();
+  std::vector<int> block_point_offsets(num_blocks_read + 1, 0);
+  std::vector<int> block_observation_offsets(num_blocks_read + 1, 0);
+  for (int i = 0; i < num_blocks_read; ++i) {
+    block_point_offsets[i + 1] =
+        block_point_offsets[i] + blocks[i].num_observations.size();
+    block_observation_offsets[i + 1] =
+        block_observation_offsets[i] + blocks[i].x.size();
+  }
+  num_observations_ = block_observation_offsets.back();
+
+  std::vector<int>& intrinsics_ids = storage_.intrinsics_ids;
+  std::vector<int>& pose_ids = storage_.pose_ids;
+  std::vector<double>& x = storage_.x;
+  std::vector<double>& y = storage_.y;
+  std::vector<float>& x_float = storage_.x_float;
+  std::vector<float>& y_float = storage_.y_float;
+  const bool single_precision = options_.single_precision_observations;
+  intrinsics_ids.swap(blocks[0].intrinsics_ids);
+  pose_ids.swap(blocks[0].pose_ids);
+  intrinsics_ids.resize(num_observations_);
+  pose_ids.resize(num_observations_);
+  if (single_precision) {
+    x_float.resize(num_observations_);
+    y_float.resize(num_observations_);
+  } else {
+    x.swap(blocks[0].x);
+    y.swap(blocks[0].y);
+    x.resize(num_observations_);
+    y.resize(num_observations_);
+  }
+
+  std::vector<int>& point_offsets = storage_.point_offsets;
+  point_offsets.resize(num_points_ + 1);
+  point_offsets[0] = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic)
+#endif
+  for (int i = 0; i < num_blocks_read; ++i) {
+    const PointBlock& block = blocks[i];
+    const int point_offset = block_point_offsets[i];
+    const int observation_offset = block_observation_offsets[i];
+    std::copy(block.points.begin(), block.points.end(),
+              points_ + 3 * point_offset);
+
+    int offset = observation_offset;
+    for (int j = 0; j < block.num_observations.size(); ++j) {
+      offset += block.num_observations[j];
+      point_offsets[point_offset + j + 1] = offset;
+    }
+
+    if (single_precision) {
+      std::copy(block.x.begin(), block.x.end(),
+                x_float.begin() + observation_offset);
+      std::copy(block.y.begin(), block.y.end(),
+                y_float.begin() + observation_offset);
+    }
+    if (i == 0) {
+      continue;
+    }
+    std::copy(block.intrinsics_ids.begin(), block.intrinsics_ids.end(),
+              intrinsics_ids.begin() + observation_offset);
+    std::copy(block.pose_ids.begin(), block.pose_ids.end(),
+              pose_ids.begin() + observation_offset);
+    if (!single_precision) {
+      std::copy(block.x.begin(), block.x.end(),
+                x.begin() + observation_offset);
+      std::copy(block.y.begin(), block.y.end(),
+                y.begin() + observation_offset);
+    }
+  }
+
+  UseStorage();
+}
+
+void BAFile::ReadBinary() {
+  const size_t size = mapped_file_.size();
+  char* data = mapped_file_.mutable_data();
+  CHECK_GE(size, sizeof(BinaryBAFHeader)) << "Truncated binary BAF file.";
+
+  BinaryBAFHeader header;
+  memcpy(&header, data, sizeof(header));
+  CHECK_EQ(header.version, kBinaryBAFVersion)
+      << "Unsupported binary BAF file version.";
+  CHECK_EQ(header.flags & ~kSinglePrecisionObservations, 0)
+      << "Unsupported binary BAF file flags.";
+
+  num_intrinsics_ = header.num_intrinsics;
+  num_poses_ = header.num_poses;
+  num_points_ = header.num_points;
+  num_observations_ = header.num_observations;
+
+  LOG(INFO) << "Reading binary BAF file with:"
+            << " num_intrinsics: " << num_intrinsics_
+            << " num_poses: " << num_poses_
+            << " num_points: " << num_points_
+            << " num_observations: " << num_observations_;
+
+  CHECK_GE(num_intrinsics_, 1);
+  CHECK_GE(num_poses_, 1);
+  CHECK_GE(num_points_, 1);
+  CHECK_GE(num_observations_, num_points_);
+
+  const BinaryBAFLayout layout(header);
+  CHECK_EQ(size, layout.size) << "Truncated binary BAF file.";
+
+  // Everything but the intrinsics is used in place. The mapping is
+  // private, so the pages holding the parameter blocks are only copied
+  // once the solver starts modifying them, and the rest are never
+  // copied at all.
+  intrinsics_.resize(kMaxNumIntrinsicParameters * num_intrinsics_, 0.0);
+  camera_models_.resize(num_intrinsics_, RADIAL_K3);
+  const double* intrinsics =
+      reinterpret_cast<const double*>(data + layout.intrinsics);
+  for (int i = 0; i < num_intrinsics_; ++i) {
+    std::copy(intrinsics + 6 * i, intrinsics + 6 * (i + 1), GetIntrinsics(i));
   }
+  poses_ = reinterpret_cast<double*>(data + layout.poses);
+  points_ = reinterpret_cast<double*>(data + layout.points);
+  point_offsets_ = reinterpret_cast<const int*>(data + layout.point_offsets);
+  intrinsics_ids_ =
+      reinterpret_cast<const int*>(data + layout.intrinsics_ids);
+  pose_ids_ = reinterpret_cast<const int*>(data + layout.pose_ids);
+  if (header.flags & kSinglePrecisionObservations) {
+    observation_x_ =
+        CoordinateArray(reinterpret_cast<const float*>(data + layout.x));
+    observation_y_ =
+        CoordinateArray(reinterpret_cast<const float*>(data + layout.y));
+  } else {
+    observation_x_ =
+        CoordinateArray(reinterpret_cast<const double*>(data + layout.x));
+    observation_y_ =
+        CoordinateArray(reinterpret_cast<const double*>(data + layout.y));
+  }
+
+  if (options_.single_precision_observations &&
+      !observation_x_.is_single_precision()) {
+    // The coordinates are the only thing that is converted, everything
+    // else is still used in place.
+    const double* x = observation_x_.doubles();
+    const double* y = observation_y_.doubles();
+    storage_.x_float.resize(num_observations_);
+    storage_.y_float.resize(num_observations_);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(options_.num_threads)
+#endif
+    for (int i = 0; i < num_observations_; ++i) {
+      storage_.x_float[i] = x[i];
+      storage_.y_float[i] = y[i];
+    }
+    observation_x_ = CoordinateArray(&storage_.x_float[0]);
+    observation_y_ = CoordinateArray(&storage_.y_float[0]);
+  }
+}
+
+void BAFile::ValidateObservations() const {
+  CHECK_EQ(point_offsets_[0], 0);
+  CHECK_EQ(point_offsets_[num_points_], num_observations_);
 
+  // Count the violations in parallel, and only look for the first one
+  // to report if there are any.
+  int num_invalid = 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(options_.num_threads) \
+    reduction(+ : num_invalid)
+#endif
   for (int i = 0; i < num_points_; ++i) {
-    CHECK((file >> points_[3 * i] >> points_[3 * i + 1] >> points_[3 * i + 2]));
-    int num_observations_for_point = 0;
-    CHECK(file >> num_observations_for_point);
-    CHECK_GT(num_observations_for_point, 0);
-    for (int j = 0; j < num_observations_for_point; ++j) {
-      Observation observation;
-      CHECK(file
-            >> observation.intrinsics_id
-            >> observation.pose_id
-            >> observation.x
-            >> observation.y);
+    num_invalid += point_offsets_[i] > point_offsets_[i + 1];
+  }
+  for (int i = 0; num_invalid > 0 && i < num_points_; ++i) {
+    CHECK_LE(point_offsets_[i], point_offsets_[i + 1])
+        << "Invalid observation offsets of point " << i << ".";
+  }
 
-      VLOG(2) << "observation:"
-              << " " <<  observation.intrinsics_id
-              << " " <<  observation.pose_id
-              << " " << observation.x << " " << observation.y;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(options_.num_threads) \
+    reduction(+ : num_invalid)
+#endif
+  for (int i = 0; i < num_observations_; ++i) {
+    num_invalid += intrinsics_ids_[i] < 0 ||
+        intrinsics_ids_[i] >= num_intrinsics_ ||
+        pose_ids_[i] < 0 ||
+        pose_ids_[i] >= num_poses_;
+  }
+  for (int i = 0; num_invalid > 0 && i < num_observations_; ++i) {
+    CHECK(intrinsics_ids_[i] >= 0 && intrinsics_ids_[i] < num_intrinsics_)
+        << "Observation " << i << " has intrinsics id " << intrinsics_ids_[i]
+        << ", but there are only " << num_intrinsics_ << " intrinsics.";
+    CHECK(pose_ids_[i] >= 0 && pose_ids_[i] < num_poses_)
+        << "Observation " << i << " has pose id " << pose_ids_[i]
+        << ", but there are only " << num_poses_ << " poses.";
+  }
+}
+
+void BAFile::UseStorage() {
+  poses_ = &storage_.parameters[0];
+  points_ = poses_ + 6 * num_poses_;
+  point_offsets_ = &storage_.point_offsets[0];
+  intrinsics_ids_ = &storage_.intrinsics_ids[0];
+  pose_ids_ = &storage_.pose_ids[0];
+  if (storage_.x_float.empty()) {
+    observation_x_ = CoordinateArray(&storage_.x[0]);
+    observation_y_ = CoordinateArray(&storage_.y[0]);
+  } else {
+    observation_x_ = CoordinateArray(&storage_.x_float[0]);
+    observation_y_ = CoordinateArray(&storage_.y_float[0]);
+  }
+}
+
+void BAFile::SetCameraModel(int intrinsics_id, CameraModelType type) {
+  CHECK_GE(intrinsics_id, 0);
+  CHECK_LT(intrinsics_id, num_intrinsics_);
+  double* intrinsics = GetIntrinsics(intrinsics_id);
+  double max_dropped_term = 0.0;
+  for (int i = NumIntrinsicParameters(type);
+       i < kMaxNumIntrinsicParameters;
+       ++i) {
+    max_dropped_term = std::max(max_dropped_term, fabs(intrinsics[i]));
+  }
+  if (max_dropped_term > 0.0) {
+    LOG(WARNING) << "The " << CameraModelTypeToString(type)
+                 << " camera model of intrinsics " << intrinsics_id
+                 << " drops distortion terms of magnitude up to "
+                 << max_dropped_term << ", which changes the data and the "
+                 << "initial cost.";
+  }
+  std::fill(intrinsics + NumIntrinsicParameters(type),
+            intrinsics + kMaxNumIntrinsicParameters,
+            0.0);
+  camera_models_[intrinsics_id] = type;
+}
 
-      observations_[i].push_back(observation);
+int BAFile::MergeIntrinsics(const double tolerance) {
+  // The number of distinct intrinsics is usually small, so every
+  // intrinsic is compared with each of the ones kept so far.
+  std::vector<int> new_intrinsics_ids(num_intrinsics_);
+  std::vector<int> kept_intrinsics_ids;
+  for (int i = 0; i < num_intrinsics_; ++i) {
+    const double* intrinsics = GetIntrinsics(i);
+    new_intrinsics_ids[i] = -1;
+    for (int j = 0; j < kept_intrinsics_ids.size(); ++j) {
+      const int kept_id = kept_intrinsics_ids[j];
+      if (camera_models_[kept_id] != camera_models_[i]) {
+        continue;
+      }
+      const double* kept_intrinsics = GetIntrinsics(kept_id);
+      const double pixel_tolerance =
+          tolerance * fabs(kept_intrinsics[OFFSET_FOCAL_LENGTH]);
+      bool is_match = true;
+      for (int k = 0; k < kMaxNumIntrinsicParameters && is_match; ++k) {
+        const double difference =
+            fabs(intrinsics[k] - kept_intrinsics[k]);
+        is_match = difference <=
+            (k < OFFSET_DISTO_K1 ? pixel_tolerance : tolerance);
+      }
+      if (is_match) {
+        new_intrinsics_ids[i] = j;
+        break;
+      }
     }
+    if (new_intrinsics_ids[i] < 0) {
+      new_intrinsics_ids[i] = kept_intrinsics_ids.size();
+      kept_intrinsics_ids.push_back(i);
+    }
+  }
+
+  const int num_merged = num_intrinsics_ - kept_intrinsics_ids.size();
+  if (num_merged == 0) {
+    return 0;
+  }
+
+  // Kept intrinsics only move to lower ids, so this is done in place.
+  for (int j = 0; j < kept_intrinsics_ids.size(); ++j) {
+    const double* intrinsics = GetIntrinsics(kept_intrinsics_ids[j]);
+    std::copy(intrinsics,
+              intrinsics + kMaxNumIntrinsicParameters,
+              GetIntrinsics(j));
+    camera_models_[j] = camera_models_[kept_intrinsics_ids[j]];
   }
+  num_intrinsics_ = kept_intrinsics_ids.size();
+  intrinsics_.resize(kMaxNumIntrinsicParameters * num_intrinsics_);
+  camera_models_.resize(num_intrinsics_);
+
+  // The intrinsics ids of a binary file are used in place, so they are
+  // copied out of the mapping first.
+  if (storage_.intrinsics_ids.empty()) {
+    storage_.intrinsics_ids.assign(intrinsics_ids_,
+                                   intrinsics_ids_ + num_observations_);
+    intrinsics_ids_ = &storage_.intrinsics_ids[0];
+  }
+  std::vector<int>& intrinsics_ids = storage_.intrinsics_ids;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(options_.num_threads)
+#endif
+  for (int i = 0; i < num_observations_; ++i) {
+    intrinsics_ids[i] = new_intrinsics_ids[intrinsics_ids[i]];
+  }
+
+  LOG(INFO) << "Merged " << num_merged + num_intrinsics_ << " intrinsics "
+            << "into " << num_intrinsics_ << ".";
+  return num_merged;
 }
 
-void BAFile::WriteToPLYFile(const std::string& filename) const {
+void BAFile::WarnIfTangentialDistortionIsDropped() const {
+  for (int i = 0; i < num_intrinsics_; ++i) {
+    const double* intrinsics = GetIntrinsics(i);
+    if (intrinsics[OFFSET_DISTO_T1] != 0.0 ||
+        intrinsics[OFFSET_DISTO_T2] != 0.0) {
+      LOG(WARNING) << "BAF files cannot store tangential distortion, "
+                   << "dropping it.";
+      return;
+    }
+  }
+}
+
+void BAFile::IndexObservationsByPose() {
+  if (!pose_offsets_.empty()) {
+    return;
+  }
+
+  pose_offsets_.resize(num_poses_ + 1, 0);
+  for (int i = 0; i < num_observations_; ++i) {
+    ++pose_offsets_[pose_ids_[i] + 1];
+  }
+  for (int i = 0; i < num_poses_; ++i) {
+    pose_offsets_[i + 1] += pose_offsets_[i];
+  }
+
+  // Iterating over the observations in order keeps the observations
+  // of each pose sorted.
+  std::vector<int> next(pose_offsets_.begin(), pose_offsets_.end() - 1);
+  pose_observation_ids_.resize(num_observations_);
+  pose_point_ids_.resize(num_observations_);
+  for (int i = 0; i < num_points_; ++i) {
+    for (int j = point_offsets_[i]; j < point_offsets_[i + 1]; ++j) {
+      const int k = next[pose_ids_[j]]++;
+      pose_observation_ids_[k] = j;
+      pose_point_ids_[k] = i;
+    }
+  }
+}
+
+void BAFile::ComputeCovisibilityGraph(
+    std::vector<CovisibilityEdge>* edges) const {
+  // The points observed by each pose, in increasing order, as in
+  // IndexObservationsByPose, which is not used so that this stays
+  // const.
+  std::vector<int> pose_offsets(num_poses_ + 1, 0);
+  for (int i = 0; i < num_observations_; ++i) {
+    ++pose_offsets[pose_ids_[i] + 1];
+  }
+  for (int i = 0; i < num_poses_; ++i) {
+    pose_offsets[i + 1] += pose_offsets[i];
+  }
+  std::vector<int> next(pose_offsets.begin(), pose_offsets.end() - 1);
+  std::vector<int> pose_point_ids(num_observations_);
+  for (int i = 0; i < num_points_; ++i) {
+    for (int j = point_offsets_[i]; j < point_offsets_[i + 1]; ++j) {
+      pose_point_ids[next[pose_ids_[j]]++] = i;
+    }
+  }
+
+  // Count the points each pose shares with the poses with larger ids
+  // in a dense array indexed by pose, so that the memory used is linear
+  // in the number of observations and edges rather than in the sum of
+  // the squared track lengths. A pose observing the same point twice
+  // counts it once: last_visit holds the index in pose_point_ids of
+  // the last point a pose was counted for.
+  std::vector<std::vector<CovisibilityEdge> > pose_edges(num_poses_);
+#ifdef _OPENMP
+#pragma omp parallel num_threads(options_.num_threads)
+#endif
+  {
+    std::vector<int> num_shared_points(num_poses_, 0);
+    std::vector<int> last_visit(num_poses_, -1);
+    std::vector<int> neighbors;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 64)
+#endif
+    for (int pose_id = 0; pose_id < num_poses_; ++pose_id) {
+      neighbors.clear();
+      for (int k = pose_offsets[pose_id]; k < pose_offsets[pose_id + 1]; ++k) {
+        const int point_id = pose_point_ids[k];
+        if (k > pose_offsets[pose_id] && pose_point_ids[k - 1] == point_id) {
+          continue;
+        }
+        for (int j = point_offsets_[point_id];
+             j < point_offsets_[point_id + 1];
+             ++j) {
+          const int other_pose_id = pose_ids_[j];
+          if (other_pose_id <= pose_id || last_visit[other_pose_id] == k) {
+            continue;
+          }
+          last_visit[other_pose_id] = k;
+          if (num_shared_points[other_pose_id]++ == 0) {
+            neighbors.push_back(other_pose_id);
+          }
+        }
+      }
+
+      std::sort(neighbors.begin(), neighbors.end());
+      std::vector<CovisibilityEdge>& edges_of_pose = pose_edges[pose_id];
+      edges_of_pose.resize(neighbors.size());
+      for (int i = 0; i < neighbors.size(); ++i) {
+        edges_of_pose[i].pose_id1 = pose_id;
+        edges_of_pose[i].pose_id2 = neighbors[i];
+        edges_of_pose[i].num_shared_points = num_shared_points[neighbors[i]];
+        num_shared_points[neighbors[i]] = 0;
+      }
+    }
+  }
+
+  edges->clear();
+  for (int i = 0; i < num_poses_; ++i) {
+    edges->insert(edges->end(), pose_edges[i].begin(), pose_edges[i].end());
+    std::vector<CovisibilityEdge>().swap(pose_edges[i]);
+  }
+}
+
+void BAFile::Reorder(const ReorderingType type) {
+  // Renumber the poses in breadth first order, starting each connected
+  // component of the covisibility graph at a pose of minimum degree,
+  // and visiting the neighbors of a pose in decreasing order of the
+  // number of points they share with it.
+  std::vector<CovisibilityEdge> edges;
+  ComputeCovisibilityGraph(&edges);
+  std::vector<std::vector<std::pair<int, int> > > neighbors(num_poses_);
+  for (int i = 0; i < edges.size(); ++i) {
+    const CovisibilityEdge& edge = edges[i];
+    neighbors[edge.pose_id1].push_back(
+        std::make_pair(-edge.num_shared_points, edge.pose_id2));
+    neighbors[edge.pose_id2].push_back(
+        std::make_pair(-edge.num_shared_points, edge.pose_id1));
+  }
+  for (int i = 0; i < num_poses_; ++i) {
+    std::sort(neighbors[i].begin(), neighbors[i].end());
+  }
+
+  std::vector<int> pose_order;
+  std::vector<bool> visited(num_poses_, false);
+  while (pose_order.size() < num_poses_) {
+    int start = -1;
+    for (int i = 0; i < num_poses_; ++i) {
+      if (!visited[i] &&
+          (start == -1 || neighbors[i].size() < neighbors[start].size())) {
+        start = i;
+      }
+    }
+
+    visited[start] = true;
+    int head = pose_order.size();
+    pose_order.push_back(start);
+    for (; head < pose_order.size(); ++head) {
+      const std::vector<std::pair<int, int> >& adjacent =
+          neighbors[pose_order[head]];
+      for (int i = 0; i < adjacent.size(); ++i) {
+        if (!visited[adjacent[i].second]) {
+          visited[adjacent[i].second] = true;
+          pose_order.push_back(adjacent[i].second);
+        }
+      }
+    }
+  }
+
+  std::vector<int> new_pose_ids(num_poses_);
+  for (int i = 0; i < num_poses_; ++i) {
+    new_pose_ids[pose_order[i]] = i;
+  }
+
+  // Sort the points.
+  double min[3] = { 0.0, 0.0, 0.0 };
+  double max[3] = { 0.0, 0.0, 0.0 };
+  for (int j = 0; j < 3; ++j) {
+    min[j] = max[j] = GetPoint(0)[j];
+  }
+  for (int i = 1; i < num_points_; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      min[j] = std::min(min[j], GetPoint(i)[j]);
+      max[j] = std::max(max[j], GetPoint(i)[j]);
+    }
+  }
+
+  std::vector<PointSortKey> keys(num_points_);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(options_.num_threads)
+#endif
+  for (int i = 0; i < num_points_; ++i) {
+    PointSortKey& key = keys[i];
+    key.dominant_pose_id = 0;
+    if (type == DOMINANT_CAMERA) {
+      key.dominant_pose_id = num_poses_;
+      for (int j = point_offsets_[i]; j < point_offsets_[i + 1]; ++j) {
+        key.dominant_pose_id =
+            std::min(key.dominant_pose_id, new_pose_ids[pose_ids_[j]]);
+      }
+    }
+    key.morton_code = MortonCode(GetPoint(i), min, max);
+    key.point_id = i;
+  }
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<int> point_order(num_points_);
+  for (int i = 0; i < num_points_; ++i) {
+    point_order[i] = keys[i].point_id;
+  }
+
+  Permute(pose_order, point_order);
+}
+
+void BAFile::RestoreOriginalOrder() {
+  if (original_pose_ids_.empty()) {
+    return;
+  }
+
+  // original_*_ids_ map current ids to original ids, so moving the
+  // element with current id j to position original_*_ids_[j] is the
+  // inverse permutation.
+  std::vector<int> pose_order(num_poses_);
+  for (int i = 0; i < num_poses_; ++i) {
+    pose_order[original_pose_ids_[i]] = i;
+  }
+  std::vector<int> point_order(num_points_);
+  for (int i = 0; i < num_points_; ++i) {
+    point_order[original_point_ids_[i]] = i;
+  }
+  Permute(pose_order, point_order);
+  original_pose_ids_.clear();
+  original_point_ids_.clear();
+}
+
+void BAFile::Permute(const std::vector<int>& pose_order,
+                     const std::vector<int>& point_order) {
+  CHECK_EQ(static_cast<int>(pose_order.size()), num_poses_);
+  CHECK_EQ(static_cast<int>(point_order.size()), num_points_);
+
+  std::vector<int> new_pose_ids(num_poses_);
+  for (int i = 0; i < num_poses_; ++i) {
+    new_pose_ids[pose_order[i]] = i;
+  }
+
+  Storage storage;
+  storage.parameters.resize(6 * num_poses_ + 3 * num_points_);
+  double* poses = &storage.parameters[0];
+  double* points = poses + 6 * num_poses_;
+  for (int i = 0; i < num_poses_; ++i) {
+    std::copy(GetPose(pose_order[i]), GetPose(pose_order[i]) + 6,
+              poses + 6 * i);
+  }
+
+  storage.point_offsets.resize(num_points_ + 1);
+  storage.point_offsets[0] = 0;
+  for (int i = 0; i < num_points_; ++i) {
+    const int old_id = point_order[i];
+    storage.point_offsets[i + 1] = storage.point_offsets[i] +
+        point_offsets_[old_id + 1] - point_offsets_[old_id];
+  }
+
+  storage.intrinsics_ids.resize(num_observations_);
+  storage.pose_ids.resize(num_observations_);
+  const bool single_precision = observation_x_.is_single_precision();
+  if (single_precision) {
+    storage.x_float.resize(num_observations_);
+    storage.y_float.resize(num_observations_);
+  } else {
+    storage.x.resize(num_observations_);
+    storage.y.resize(num_observations_);
+  }
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(options_.num_threads)
+#endif
+  for (int i = 0; i < num_points_; ++i) {
+    const int old_id = point_order[i];
+    std::copy(GetPoint(old_id), GetPoint(old_id) + 3, points + 3 * i);
+    int k = storage.point_offsets[i];
+    for (int j = point_offsets_[old_id]; j < point_offsets_[old_id + 1];
+         ++j, ++k) {
+      storage.intrinsics_ids[k] = intrinsics_ids_[j];
+      storage.pose_ids[k] = new_pose_ids[pose_ids_[j]];
+      if (single_precision) {
+        storage.x_float[k] = observation_x_.floats()[j];
+        storage.y_float[k] = observation_y_.floats()[j];
+      } else {
+        storage.x[k] = observation_x_.doubles()[j];
+        storage.y[k] = observation_y_.doubles()[j];
+      }
+    }
+  }
+
+  // Compose with any earlier reordering.
+  std::vector<int> original_pose_ids(num_poses_);
+  for (int i = 0; i < num_poses_; ++i) {
+    original_pose_ids[i] = OriginalPoseId(pose_order[i]);
+  }
+  std::vector<int> original_point_ids(num_points_);
+  for (int i = 0; i < num_points_; ++i) {
+    original_point_ids[i] = OriginalPointId(point_order[i]);
+  }
+  original_pose_ids_.swap(original_pose_ids);
+  original_point_ids_.swap(original_point_ids);
+
+  // Everything now lives in storage_, so a binary file's mapping is no
+  // longer needed.
+  storage_.Swap(&storage);
+  mapped_file_.Close();
+  UseStorage();
+
+  pose_offsets_.clear();
+  pose_observation_ids_.clear();
+  pose_point_ids_.clear();
+}
+
+void BAFile::WriteToBAFFile(const std::string& filename) const {
   std::ofstream of(filename.c_str());
+  CHECK(of.good()) << "Unable to open file: " << filename;
 
-  of << "ply"
-     << '\n' << "format ascii 1.0"
-     << '\n' << "element vertex " << num_poses() + num_points()
-     << '\n' << "property float x"
-     << '\n' << "property float y"
-     << '\n' << "property float z"
-     << '\n' << "property uchar red"
-     << '\n' << "property uchar green"
-     << '\n' << "property uchar blue"
-     << '\n' << "end_header" << std::endl;
-
-  // Export extrinsic data (i.e. camera centers) as green points.
-  double center[3];
-  for (int i = 0; i < num_poses(); ++i)  {
-    const double* center = GetPose(i) + 3;
-    of << center[0] << " " << center[1] << " " << center[2]
-       << " 0 255 0" << "\n";
-  }
-
-  // Export the structure (i.e. 3D Points) as white points.
-  for (int i = 0; i < num_points(); ++i) {
+  // Enough digits for the values to survive the round trip through
+  // text exactly.
+  of.precision(17);
+
+  of << num_intrinsics_ << "\n" << num_poses_ << "\n" << num_points_ << "\n";
+  WarnIfTangentialDistortionIsDropped();
+  for (int i = 0; i < num_intrinsics_; ++i) {
+    const double* intrinsics = GetIntrinsics(i);
+    for (int j = 0; j < 6; ++j) {
+      of << intrinsics[j] << " ";
+    }
+    of << "\n";
+  }
+
+  for (int i = 0; i < num_poses_; ++i) {
+    const double* pose = GetPose(i);
+    double rotation_matrix[9];
+    ceres::AngleAxisToRotationMatrix(
+        pose, ceres::ColumnMajorAdapter3x3(rotation_matrix));
+    for (int j = 0; j < 9; ++j) {
+      of << rotation_matrix[j] << " ";
+    }
+    of << pose[3] << " " << pose[4] << " " << pose[5] << " \n";
+  }
+
+  for (int i = 0; i < num_points_; ++i) {
     const double* point = GetPoint(i);
-    of << point[0] << " " << point[1] << " " << point[2]
-       << " 255 255 255\n";
+    const ObservationSpan observations = ObservationsForPoint(i);
+    of << point[0] << " " << point[1] << " " << point[2] << " "
+       << observations.size();
+    for (int j = 0; j < observations.size(); ++j) {
+      of << " " << observations.intrinsics_id(j)
+         << " " << observations.pose_id(j)
+         << " " << observations.x(j)
+         << " " << observations.y(j);
+    }
+    of << " \n";
   }
-  of.close();
+  CHECK(of.good()) << "Error writing to file: " << filename;
+}
+
+void BAFile::WriteToBinaryBAFFile(const std::string& filename) const {
+  std::ofstream of(filename.c_str(), std::ios::out | std::ios::binary);
+  CHECK(of.good()) << "Unable to open file: " << filename;
+
+  BinaryBAFHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kBinaryBAFMagic, sizeof(kBinaryBAFMagic));
+  header.version = kBinaryBAFVersion;
+  header.num_intrinsics = num_intrinsics_;
+  header.num_poses = num_poses_;
+  header.num_points = num_points_;
+  header.num_observations = num_observations_;
+  const bool single_precision = observation_x_.is_single_precision();
+  if (single_precision) {
+    header.flags |= kSinglePrecisionObservations;
+  }
+  const BinaryBAFLayout layout(header);
+
+  BinaryBAFWriter writer(&of);
+  writer.Write(layout.header, &header, sizeof(header));
+  WarnIfTangentialDistortionIsDropped();
+  for (int i = 0; i < num_intrinsics_; ++i) {
+    writer.Write(layout.intrinsics + 6 * sizeof(double) * i,
+                 GetIntrinsics(i),
+                 6 * sizeof(double));
+  }
+  writer.Write(layout.poses, poses_, 6 * num_poses_ * sizeof(double));
+  writer.Write(layout.points, points_, 3 * num_points_ * sizeof(double));
+  writer.Write(layout.point_offsets, point_offsets_,
+               (num_points_ + 1) * sizeof(int32_t));
+  writer.Write(layout.intrinsics_ids, intrinsics_ids_,
+               num_observations_ * sizeof(int32_t));
+  writer.Write(layout.pose_ids, pose_ids_,
+               num_observations_ * sizeof(int32_t));
+  if (single_precision) {
+    writer.Write(layout.x, observation_x_.floats(),
+                 num_observations_ * sizeof(float));
+    writer.Write(layout.y, observation_y_.floats(),
+                 num_observations_ * sizeof(float));
+  } else {
+    writer.Write(layout.x, observation_x_.doubles(),
+                 num_observations_ * sizeof(double));
+    writer.Write(layout.y, observation_y_.doubles(),
+                 num_observations_ * sizeof(double));
+  }
+  writer.Write(layout.size, NULL, 0);
+  CHECK(of.good()) << "Error writing to file: " << filename;
+}
+
+void BAFile::WriteToPLYFile(const std::string& filename) const {
+  const int num_threads = options_.num_threads;
+  std::ofstream of(filename.c_str(), std::ios::out | std::ios::binary);
+  CHECK(of.good()) << "Unable to open file: " << filename;
+  WritePLYHeader("ascii", num_poses() + num_points(), &of);
+
+  // Vertices are formatted in blocks, several blocks at a time in
+  // parallel, and the blocks are then written out in order.
+  const int num_vertices = num_poses() + num_points();
+  const int num_blocks =
+      (num_vertices + kPLYVerticesPerBlock - 1) / kPLYVerticesPerBlock;
+  std::vector<std::string> buffers(num_threads);
+  for (int first_block = 0;
+       first_block < num_blocks;
+       first_block += num_threads) {
+    const int num_blocks_in_batch =
+        std::min(num_threads, num_blocks - first_block);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(num_threads)
+#endif
+    for (int i = 0; i < num_blocks_in_batch; ++i) {
+      const int begin = (first_block + i) * kPLYVerticesPerBlock;
+      const int end = std::min(begin + kPLYVerticesPerBlock, num_vertices);
+      std::string* buffer = &buffers[i];
+      buffer->clear();
+      for (int j = begin; j < end; ++j) {
+        AppendPLYVertex(*this, j, buffer);
+      }
+    }
+
+    for (int i = 0; i < num_blocks_in_batch; ++i) {
+      of.write(buffers[i].data(), buffers[i].size());
+    }
+  }
+  CHECK(of.good()) << "Error writing to file: " << filename;
+}
+
+void BAFile::WriteToBinaryPLYFile(const std::string& filename) const {
+  std::ofstream of(filename.c_str(), std::ios::out | std::ios::binary);
+  CHECK(of.good()) << "Unable to open file: " << filename;
+
+  // The vertices are always written little endian, which is what most
+  // PLY readers expect, so on big endian machines the bytes of every
+  // float are swapped.
+  const uint16_t kByteOrderMark = 1;
+  const bool is_little_endian =
+      *reinterpret_cast<const uint8_t*>(&kByteOrderMark) == 1;
+  WritePLYHeader("binary_little_endian", num_poses() + num_points(), &of);
+
+  // Each vertex is three floats followed by three bytes of color.
+  const int kVertexSize = 3 * sizeof(float) + 3;
+  const int num_vertices = num_poses() + num_points();
+  std::vector<char> buffer(kPLYVerticesPerBlock * kVertexSize);
+  for (int begin = 0; begin < num_vertices; begin += kPLYVerticesPerBlock) {
+    const int end = std::min(begin + kPLYVerticesPerBlock, num_vertices);
+    char* pos = &buffer[0];
+    for (int i = begin; i < end; ++i) {
+      const double* xyz = NULL;
+      const unsigned char* color = NULL;
+      GetPLYVertex(*this, i, &xyz, &color);
+      const float vertex[3] = {
+        static_cast<float>(xyz[0]),
+        static_cast<float>(xyz[1]),
+        static_cast<float>(xyz[2])
+      };
+      memcpy(pos, vertex, sizeof(vertex));
+      if (!is_little_endian) {
+        for (int j = 0; j < 3; ++j) {
+          std::reverse(pos + j * sizeof(float), pos + (j + 1) * sizeof(float));
+        }
+      }
+      memcpy(pos + sizeof(vertex), color, 3);
+      pos += kVertexSize;
+    }
+    of.write(&buffer[0], pos - &buffer[0]);
+  }
+  CHECK(of.good()) << "Error writing to file: " << filename;
 }
 
 void BAFile::Normalize() {
+  const int num_threads = options_.num_threads;
+
   // Compute the marginal median of the geometry.
   std::vector<double> tmp(num_points_);
   Eigen::Vector3d median;
   for (int i = 0; i < 3; ++i) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(num_threads)
+#endif
     for (int j = 0; j < num_points(); ++j) {
       tmp[j] = GetPoint(j)[i];
     }
-    median(i) = Median(&tmp);
+    median(i) = Median(&tmp, num_threads);
   }
 
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(num_threads)
+#endif
   for (int i = 0; i < num_points(); ++i) {
-    Eigen::Map<Eigen::Vector3d> point(GetPoint(i));
+    Eigen::Map<const Eigen::Vector3d> point(GetPoint(i));
     tmp[i] = (point - median).lpNorm<1>();
   }
 
-  const double median_absolute_deviation = Median(&tmp);
+  const double median_absolute_deviation = Median(&tmp, num_threads);
 
   // Scale so that the median absolute deviation of the resulting
   // reconstruction is 100.
@@ -205,6 +1483,9 @@ void BAFile::Normalize() {
   VLOG(2) << "scale: " << scale;
 
   // X = scale * (X - median)
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(num_threads)
+#endif
   for (int i = 0; i < num_points(); ++i) {
     Eigen::Map<Eigen::Vector3d> point(GetPoint(i));
     point = scale * (point - median);
@@ -219,18 +1500,23 @@ void BAFile::Normalize() {
 
 void BAFile::Perturb(const double rotation_sigma,
                      const double position_sigma,
-                     const double point_sigma) {
+                     const double point_sigma,
+                     const unsigned int random_seed) {
   CHECK_GE(point_sigma, 0.0);
   CHECK_GE(rotation_sigma, 0.0);
   CHECK_GE(position_sigma, 0.0);
 
+  const CounterBasedRandom random(random_seed);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(options_.num_threads)
+#endif
   for (int i = 0; i < num_points(); ++i) {
-    PerturbPoint3(point_sigma, GetPoint(i));
+    PerturbPoint3(random, POINT_STREAM, i, point_sigma, GetPoint(i));
   }
 
   for (int i = 0; i < num_poses(); ++i) {
-    PerturbPoint3(rotation_sigma, GetPose(i));
-    PerturbPoint3(position_sigma, GetPose(i) + 3);
+    PerturbPoint3(random, ROTATION_STREAM, i, rotation_sigma, GetPose(i));
+    PerturbPoint3(random, POSITION_STREAM, i, position_sigma, GetPose(i) + 3);
   }
 }
 
@@ -31,6 +31,8 @@
 
 #include <string>
 #include <vector>
+#include "camera_models.h"
+#include "mapped_file.h"
 
 namespace openMVG {
 struct Observation {
@@ -40,13 +42,158 @@ struct Observation {
   double y;
 };
 
+// A pair of poses which observe num_shared_points points in common.
+struct CovisibilityEdge {
+  int pose_id1;
+  int pose_id2;
+  int num_shared_points;
+};
+
+// An array of observation coordinates, stored either in double or,
+// to save memory, in single precision. Elements are always returned
+// as doubles.
+class CoordinateArray {
+ public:
+  CoordinateArray() : doubles_(NULL), floats_(NULL) {}
+  explicit CoordinateArray(const double* doubles)
+      : doubles_(doubles), floats_(NULL) {}
+  explicit CoordinateArray(const float* floats)
+      : doubles_(NULL), floats_(floats) {}
+
+  double operator[](int i) const {
+    return doubles_ != NULL ? doubles_[i] : floats_[i];
+  }
+
+  CoordinateArray operator+(int offset) const {
+    return doubles_ != NULL ? CoordinateArray(doubles_ + offset)
+                            : CoordinateArray(floats_ + offset);
+  }
+
+  bool is_single_precision() const { return floats_ != NULL; }
+  const double* doubles() const { return doubles_; }
+  const float* floats() const { return floats_; }
+
+ private:
+  const double* doubles_;
+  const float* floats_;
+};
+
+// The observations of a single point. This is a view into the
+// observation arrays of a BAFile and is only valid as long as the
+// BAFile is.
+class ObservationSpan {
+ public:
+  ObservationSpan(const int* intrinsics_ids,
+                  const int* pose_ids,
+                  const CoordinateArray& x,
+                  const CoordinateArray& y,
+                  int size)
+      : intrinsics_ids_(intrinsics_ids),
+        pose_ids_(pose_ids),
+        x_(x),
+        y_(y),
+        size_(size) {}
+
+  int size() const { return size_; }
+
+  Observation operator[](int i) const {
+    Observation observation;
+    observation.intrinsics_id = intrinsics_ids_[i];
+    observation.pose_id = pose_ids_[i];
+    observation.x = x_[i];
+    observation.y = y_[i];
+    return observation;
+  }
+
+  int intrinsics_id(int i) const { return intrinsics_ids_[i]; }
+  int pose_id(int i) const { return pose_ids_[i]; }
+  double x(int i) const { return x_[i]; }
+  double y(int i) const { return y_[i]; }
+
+ private:
+  const int* intrinsics_ids_;
+  const int* pose_ids_;
+  CoordinateArray x_;
+  CoordinateArray y_;
+  int size_;
+};
+
 // A parse for OpenMVG's BAF file format.
+//
+// Besides the text format written by openMVG, BAFile also reads a
+// binary version of it (see WriteToBinaryBAFFile), which stores the
+// poses already converted to angle-axis form. All the arrays of a
+// binary file are used in place from a memory mapping of the file, so
+// loading one takes constant time.
+//
+// Observations are stored in compressed sparse row form: they are
+// numbered 0 ... num_observations() - 1 in order of the points they
+// belong to, and each of their attributes is stored in an array of
+// its own.
+//
+// The parameters (intrinsics, poses and points) are always stored in
+// double precision, since they are the parameter blocks of the
+// problem being solved. The observed coordinates are not, and can be
+// stored in single precision to reduce the memory used by large
+// problems, see Options::single_precision_observations.
+//
+// BAF files describe RADIAL_K3 cameras. The camera model of each
+// intrinsic can be changed, see SetCameraModel, and its parameters are
+// stored in a slot of kMaxNumIntrinsicParameters doubles, of which the
+// model uses the first NumIntrinsicParameters(model).
 class BAFile {
  public:
+  struct Options {
+    Options()
+        : num_threads(1),
+          single_precision_observations(false),
+          merge_intrinsics_tolerance(-1.0) {
+    }
+
+    // Number of threads used to read the points of a text BAF file,
+    // and by Normalize, Perturb and WriteToPLYFile. None of the results
+    // depend on the number of threads.
+    int num_threads;
+
+    // Store the x and y coordinates of the observations as floats,
+    // which reduces the memory used by each observation from 24 to 16
+    // bytes. Binary BAF files written from such a BAFile store them as
+    // floats too, and are used in place like any other binary file.
+    // Binary files with double precision observations are converted
+    // on load.
+    bool single_precision_observations;
+
+    // If non-negative, call MergeIntrinsics with this tolerance once
+    // the file is loaded.
+    double merge_intrinsics_tolerance;
+  };
+
+  // Read a text or binary BAF file. The format is detected from the
+  // contents of the file.
   explicit BAFile(const std::string& filename);
+  BAFile(const std::string& filename, const Options& options);
 
+  // Write the camera centers and the points as an ASCII PLY file. The
+  // text is formatted in blocks, using Options::num_threads threads.
   void WriteToPLYFile(const std::string& filename) const;
 
+  // Same as WriteToPLYFile, but using the much more compact and faster
+  // to write binary PLY format, little endian on every machine.
+  void WriteToBinaryPLYFile(const std::string& filename) const;
+
+  // BAF files can only store RADIAL_K3 cameras. The writers below
+  // drop the tangential distortion of BROWN_T2 cameras, with a
+  // warning if it is not zero.
+  //
+  // Write the reconstruction as a text BAF file. Values are written
+  // with enough precision to be read back exactly, except for the
+  // rotations, which go through a conversion to rotation matrices.
+  void WriteToBAFFile(const std::string& filename) const;
+
+  // Write the reconstruction as a binary BAF file. The observations
+  // are written in the precision they are stored in.
+  void WriteToBinaryBAFFile(const std::string& filename) const;
+
   // Move the "center" of the reconstruction to the origin, where the
   // center is determined by computing the marginal median of the
   // points. The reconstruction is then scaled so that the median
@@ -58,41 +205,209 @@ class BAFile {
 
   // Perturb the camera pose and the geometry with random normal
   // numbers with corresponding standard deviations.
+  //
+  // The random numbers are generated by a counter based generator,
+  // keyed by random_seed and the index of the element being perturbed,
+  // so the result does not depend on the number of threads used, nor
+  // on the global state of rand().
   void Perturb(const double rotation_sigma,
                const double translation_sigma,
-               const double point_sigma);
+               const double point_sigma,
+               const unsigned int random_seed);
 
-  const std::vector<Observation>& ObservationsForPoint(int point_id) {
-    return observations_[point_id];
+  ObservationSpan ObservationsForPoint(int point_id) const {
+    const int begin = point_offsets_[point_id];
+    return ObservationSpan(intrinsics_ids_ + begin,
+                           pose_ids_ + begin,
+                           observation_x_ + begin,
+                           observation_y_ + begin,
+                           point_offsets_[point_id + 1] - begin);
+  }
+
+  // Random access to all the observations.
+  Observation GetObservation(int observation_id) const {
+    return ObservationSpan(intrinsics_ids_, pose_ids_,
+                           observation_x_, observation_y_,
+                           num_observations_)[observation_id];
+  }
+
+  // Compute the edges of the covisibility graph of the poses, sorted
+  // by (pose_id1, pose_id2), with pose_id1 < pose_id2. Besides the
+  // edges, uses memory linear in the number of observations, and time
+  // linear in the sum of the squared track lengths.
+  void ComputeCovisibilityGraph(std::vector<CovisibilityEdge>* edges) const;
+
+  enum ReorderingType {
+    // Sort the points along a Morton (Z-order) curve through their
+    // bounding box.
+    SPACE_FILLING_CURVE,
+
+    // Sort the points by the first pose, in the new pose order, that
+    // observes them, and along a Morton curve within each pose.
+    DOMINANT_CAMERA
+  };
+
+  // Renumber the poses and the points to improve the memory locality
+  // of a problem whose residual blocks are added in point order.
+  //
+  // The poses are renumbered in (Cuthill-McKee) breadth first order
+  // of the covisibility graph, so that poses which see the same points
+  // get nearby ids, and the points are then sorted as described by
+  // type. The pose ids of the observations are updated accordingly.
+  //
+  // The original ids are remembered, see OriginalPoseId,
+  // OriginalPointId and RestoreOriginalOrder.
+  void Reorder(ReorderingType type);
+
+  // Undo all previous calls to Reorder, e.g., before writing the
+  // reconstruction out.
+  void RestoreOriginalOrder();
+
+  // The id the pose or point had in the BAF file.
+  int OriginalPoseId(int pose_id) const {
+    return original_pose_ids_.empty() ? pose_id : original_pose_ids_[pose_id];
+  }
+  int OriginalPointId(int point_id) const {
+    return original_point_ids_.empty()
+        ? point_id
+        : original_point_ids_[point_id];
+  }
+
+  // Build the index used by the *ForPose methods below. This is a
+  // counting sort of the observations by pose, so it is linear in the
+  // number of observations. Calling it again is a no-op.
+  void IndexObservationsByPose();
+
+  // The number of observations made by a pose, and the ids of those
+  // observations and of the points they belong to, in increasing
+  // order. Requires IndexObservationsByPose().
+  int NumObservationsForPose(int pose_id) const {
+    return pose_offsets_[pose_id + 1] - pose_offsets_[pose_id];
+  }
+  const int* ObservationIdsForPose(int pose_id) const {
+    return &pose_observation_ids_[pose_offsets_[pose_id]];
+  }
+  const int* PointIdsForPose(int pose_id) const {
+    return &pose_point_ids_[pose_offsets_[pose_id]];
   }
 
   double* GetPoint(int point_id) { return &points_[point_id * 3]; }
   double* GetPose(int pose_id)   { return &poses_[pose_id * 6]; }
   double* GetIntrinsics(int intrinsics_id) {
-    return &intrinsics_[intrinsics_id * 6];
+    return &intrinsics_[intrinsics_id * kMaxNumIntrinsicParameters];
   }
 
   const double* GetPoint(int point_id) const { return &points_[point_id * 3]; }
   const double* GetPose(int pose_id)   const { return &poses_[pose_id * 6]; }
   const double* GetIntrinsics(int intrinsics_id) const {
-    return &intrinsics_[intrinsics_id * 6];
+    return &intrinsics_[intrinsics_id * kMaxNumIntrinsicParameters];
   }
 
+  CameraModelType camera_model(int intrinsics_id) const {
+    return camera_models_[intrinsics_id];
+  }
+
+  // Change the camera model of an intrinsic. The distortion terms
+  // which are not part of the new model are set to zero, with a
+  // warning if any of them was not, and the ones that are new to it
+  // start out as zero.
+  void SetCameraModel(int intrinsics_id, CameraModelType type);
+
+  // Merge intrinsics which have the same camera model and parameters
+  // within tolerance, so that the cameras share a single parameter
+  // block. The focal length and principal point are compared relative
+  // to the focal length, and the distortion terms absolutely. Every
+  // intrinsic is merged into the first one it matches, whose
+  // parameters are kept. The remaining intrinsics are renumbered in
+  // order and the observations remapped, so the sharing is also
+  // written out by the writers. Returns the number of intrinsics
+  // removed.
+  int MergeIntrinsics(double tolerance);
+
   int num_poses()  const { return num_poses_;  }
   int num_points() const { return num_points_; }
   int num_intrinsics() const { return num_intrinsics_; }
   int num_observations() const { return num_observations_; }
 
  private:
+  void Load(const std::string& filename, const Options& options);
+  void ReadText(const char* begin, const char* end, int num_threads);
+  void ReadBinary();
+
+  // CHECK that the point offsets are increasing and that the
+  // intrinsics and pose ids of the observations are in range, since
+  // they are used to index arrays.
+  void ValidateObservations() const;
+
+  // Point all the arrays below into storage_.
+  void UseStorage();
+
+  void WarnIfTangentialDistortionIsDropped() const;
+
+  // Move pose pose_order[i] to position i and point point_order[i] to
+  // position i, copying everything into storage_.
+  void Permute(const std::vector<int>& pose_order,
+               const std::vector<int>& point_order);
+
+  Options options_;
   int num_intrinsics_;
   int num_poses_;
   int num_points_;
   int num_observations_;
 
+  // The intrinsics are always copied, since their layout differs from
+  // the one in BAF files.
   std::vector<double> intrinsics_;
-  std::vector<double> poses_;
-  std::vector<double> points_;
-  std::vector<std::vector<Observation> > observations_;
+  std::vector<CameraModelType> camera_models_;
+
+  // For text BAF files the arrays below point into storage_, for
+  // binary BAF files directly into mapped_file_.
+  double* poses_;
+  double* points_;
+
+  // The observations of point i are [point_offsets_[i],
+  // point_offsets_[i + 1]).
+  const int* point_offsets_;
+  const int* intrinsics_ids_;
+  const int* pose_ids_;
+  CoordinateArray observation_x_;
+  CoordinateArray observation_y_;
+
+  struct Storage {
+    std::vector<double> parameters;
+    std::vector<int> point_offsets;
+    std::vector<int> intrinsics_ids;
+    std::vector<int> pose_ids;
+    std::vector<double> x;
+    std::vector<double> y;
+
+    // Used instead of x and y if single_precision_observations is set.
+    std::vector<float> x_float;
+    std::vector<float> y_float;
+
+    void Swap(Storage* other) {
+      parameters.swap(other->parameters);
+      point_offsets.swap(other->point_offsets);
+      intrinsics_ids.swap(other->intrinsics_ids);
+      pose_ids.swap(other->pose_ids);
+      x.swap(other->x);
+      y.swap(other->y);
+      x_float.swap(other->x_float);
+      y_float.swap(other->y_float);
+    }
+  };
+  Storage storage_;
+  MappedFile mapped_file_;
+
+  // Index of the observations by pose, see IndexObservationsByPose().
+  std::vector<int> pose_offsets_;
+  std::vector<int> pose_observation_ids_;
+  std::vector<int> pose_point_ids_;
+
+  // Original ids of the poses and points, empty unless Reorder has
+  // been called.
+  std::vector<int> original_pose_ids_;
+  std::vector<int> original_point_ids_;
 };
 
 }  // namespace openMVG
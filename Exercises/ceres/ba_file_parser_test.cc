@@ -0,0 +1,248 @@
+// Ceres Solver - A fast non-linear least squares minimizer
+// Copyright 2015 Google Inc. All rights reserved.
+// http://ceres-solver.org/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Writes a text BAF file whose numbers are formatted in all the ways
+// the parser of BAFile tells apart: integers, fixed and scientific
+// notation, more significant digits or larger exponents than it
+// converts itself, explicit signs, leading zeros and subnormals. Exits
+// with a non-zero status unless every one of them is read as the same
+// double as strtod reads it.
+//
+// Usage: ba_file_parser_test [--logtostderr]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "ba_file.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+namespace openMVG {
+namespace {
+
+const char kFilename[] = "ba_file_parser_test.baf";
+const int kNumIntrinsics = 3;
+const int kNumPoses = 5;
+const int kNumPoints = 2000;
+
+// The numbers of the file, in the order they are written, as text and
+// as read by strtod.
+struct Numbers {
+  std::vector<std::string> text;
+  std::vector<double> values;
+};
+
+// Format a random number in a format which depends on index, starting
+// with a few which are at the edges of what the parser converts
+// itself.
+std::string FormatNumber(const int index) {
+  static const char* kSpecialNumbers[] = {
+    "0", "-0", "+1", ".5", "5.", "1E5", "1e22", "1e23", "1e-22", "1e-23",
+    "9007199254740993", "9999999999999999999", "12345678901234567890",
+    "0.000000000000000000000000123", "4.9406564584124654e-324",
+    "1.7976931348623157e308", "2.2250738585072011e-308",
+    "-00000123.4500000"
+  };
+  const int kNumSpecialNumbers =
+      sizeof(kSpecialNumbers) / sizeof(kSpecialNumbers[0]);
+  if (index < kNumSpecialNumbers) {
+    return kSpecialNumbers[index];
+  }
+
+  static const char* kFormats[] = {
+    "%.17g", "%.6f", "%.3e", "%.25g", "%+.9g", "%.0f", "%.30e", "%020.12f"
+  };
+  const int kNumFormats = sizeof(kFormats) / sizeof(kFormats[0]);
+  const double value = (2.0 * rand() / RAND_MAX - 1.0) *
+      pow(10.0, rand() % 61 - 30);
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer), kFormats[index % kNumFormats], value);
+  return buffer;
+}
+
+void WriteNumber(std::ofstream* of, Numbers* numbers) {
+  const std::string text = FormatNumber(numbers->text.size());
+  *of << text << " ";
+  numbers->text.push_back(text);
+  numbers->values.push_back(strtod(text.c_str(), NULL));
+}
+
+// Write the test file. The rotations are identities, and the
+// observations refer to the intrinsics and poses in turn.
+void WriteTestFile(Numbers* numbers, std::vector<int>* num_observations) {
+  std::ofstream of(kFilename);
+  CHECK(of.good()) << "Unable to open file: " << kFilename;
+  of << kNumIntrinsics << "\n" << kNumPoses << "\n" << kNumPoints << "\n";
+  for (int i = 0; i < kNumIntrinsics; ++i) {
+    for (int j = 0; j < 6; ++j) {
+      WriteNumber(&of, numbers);
+    }
+    of << "\n";
+  }
+  for (int i = 0; i < kNumPoses; ++i) {
+    of << "1 0 0 0 1 0 0 0 1 ";
+    for (int j = 0; j < 3; ++j) {
+      WriteNumber(&of, numbers);
+    }
+    of << "\n";
+  }
+  for (int i = 0; i < kNumPoints; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      WriteNumber(&of, numbers);
+    }
+    num_observations->push_back(1 + i % 3);
+    of << num_observations->back();
+    for (int j = 0; j < num_observations->back(); ++j) {
+      of << " " << (i + j) % kNumIntrinsics << " " << (i + j) % kNumPoses
+         << " ";
+      WriteNumber(&of, numbers);
+      WriteNumber(&of, numbers);
+    }
+    of << "\n";
+  }
+  CHECK(of.good()) << "Error writing to file: " << kFilename;
+}
+
+// Compares value with the next number of numbers, including the sign
+// of zero. Returns the number of failures.
+int CheckNumber(const double value, const Numbers& numbers, int* index) {
+  const int i = (*index)++;
+  if (memcmp(&value, &numbers.values[i], sizeof(value)) != 0) {
+    LOG(ERROR) << "Read " << numbers.text[i] << " as "
+               << std::setprecision(17) << value << " instead of "
+               << numbers.values[i];
+    return 1;
+  }
+  return 0;
+}
+
+int CheckFile(const Numbers& numbers,
+              const std::vector<int>& num_observations,
+              BAFile* ba_file) {
+  CHECK_EQ(ba_file->num_intrinsics(), kNumIntrinsics);
+  CHECK_EQ(ba_file->num_poses(), kNumPoses);
+  CHECK_EQ(ba_file->num_points(), kNumPoints);
+
+  int num_failures = 0;
+  int index = 0;
+  for (int i = 0; i < kNumIntrinsics; ++i) {
+    for (int j = 0; j < 6; ++j) {
+      num_failures += CheckNumber(ba_file->GetIntrinsics(i)[j], numbers,
+                                  &index);
+    }
+  }
+  for (int i = 0; i < kNumPoses; ++i) {
+    const double* pose = ba_file->GetPose(i);
+    if (pose[0] != 0.0 || pose[1] != 0.0 || pose[2] != 0.0) {
+      LOG(ERROR) << "The rotation of pose " << i << " is not zero.";
+      ++num_failures;
+    }
+    for (int j = 3; j < 6; ++j) {
+      num_failures += CheckNumber(pose[j], numbers, &index);
+    }
+  }
+  for (int i = 0; i < kNumPoints; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      num_failures += CheckNumber(ba_file->GetPoint(i)[j], numbers, &index);
+    }
+    CHECK_EQ(static_cast<int>(ba_file->ObservationsForPoint(i).size()),
+             num_observations[i]);
+    for (int j = 0; j < num_observations[i]; ++j) {
+      const Observation observation = ba_file->ObservationsForPoint(i)[j];
+      if (observation.intrinsics_id != (i + j) % kNumIntrinsics ||
+          observation.pose_id != (i + j) % kNumPoses) {
+        LOG(ERROR) << "Wrong ids in observation " << j << " of point " << i;
+        ++num_failures;
+      }
+      num_failures += CheckNumber(observation.x, numbers, &index);
+      num_failures += CheckNumber(observation.y, numbers, &index);
+    }
+  }
+  return num_failures;
+}
+
+// The observations are numbered in the order of their points, and
+// GetObservation must return the same ones as ObservationsForPoint.
+// Returns the number of failures.
+int CheckObservationIds(const BAFile& ba_file) {
+  int num_failures = 0;
+  int observation_id = 0;
+  for (int i = 0; i < ba_file.num_points(); ++i) {
+    const ObservationSpan observations = ba_file.ObservationsForPoint(i);
+    for (int j = 0; j < observations.size(); ++j, ++observation_id) {
+      const Observation expected = observations[j];
+      const Observation actual = ba_file.GetObservation(observation_id);
+      if (actual.intrinsics_id != expected.intrinsics_id ||
+          actual.pose_id != expected.pose_id ||
+          actual.x != expected.x ||
+          actual.y != expected.y) {
+        LOG(ERROR) << "Observation " << observation_id << " differs from "
+                   << "observation " << j << " of point " << i;
+        ++num_failures;
+      }
+    }
+  }
+  if (observation_id != ba_file.num_observations()) {
+    LOG(ERROR) << "The points have " << observation_id << " observations "
+               << "instead of " << ba_file.num_observations();
+    ++num_failures;
+  }
+  return num_failures;
+}
+
+}  // namespace
+}  // namespace openMVG
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  srand(5);
+  openMVG::Numbers numbers;
+  std::vector<int> num_observations;
+  openMVG::WriteTestFile(&numbers, &num_observations);
+  openMVG::BAFile ba_file(openMVG::kFilename);
+  const int num_failures =
+      openMVG::CheckFile(numbers, num_observations, &ba_file) +
+      openMVG::CheckObservationIds(ba_file);
+  remove(openMVG::kFilename);
+
+  if (num_failures > 0) {
+    LOG(ERROR) << num_failures << " values were read incorrectly.";
+    return 1;
+  }
+  LOG(INFO) << "All " << numbers.values.size() << " numbers and the "
+            << "observations were read correctly.";
+  return 0;
+}
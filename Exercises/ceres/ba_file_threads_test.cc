@@ -0,0 +1,153 @@
+// Ceres Solver - A fast non-linear least squares minimizer
+// Copyright 2015 Google Inc. All rights reserved.
+// http://ceres-solver.org/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Reads a random text BAF file with different numbers of threads, and
+// exits with a non-zero status unless every read produces bit for bit
+// the same BAFile as the single threaded one.
+//
+// Usage: ba_file_threads_test [--logtostderr]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+
+#include "ba_file.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+namespace openMVG {
+namespace {
+
+const char kFilename[] = "ba_file_threads_test.baf";
+
+double RandomDouble(const double min, const double max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+// The points have varying numbers of observations, so that the blocks
+// the file is split into do not line up with anything.
+void WriteTestFile() {
+  const int num_intrinsics = 2;
+  const int num_poses = 50;
+  const int num_points = 20000;
+  std::ofstream of(kFilename);
+  CHECK(of.good()) << "Unable to open file: " << kFilename;
+  of.precision(17);
+  of << num_intrinsics << "\n" << num_poses << "\n" << num_points << "\n";
+  for (int i = 0; i < num_intrinsics; ++i) {
+    of << RandomDouble(500.0, 2000.0) << " 320 240 "
+       << RandomDouble(-0.3, 0.3) << " 0 0\n";
+  }
+  for (int i = 0; i < num_poses; ++i) {
+    of << "1 0 0 0 1 0 0 0 1 " << RandomDouble(-10.0, 10.0) << " "
+       << RandomDouble(-10.0, 10.0) << " " << RandomDouble(-10.0, 10.0)
+       << "\n";
+  }
+  for (int i = 0; i < num_points; ++i) {
+    const int num_observations = 1 + rand() % 8;
+    of << RandomDouble(-100.0, 100.0) << " " << RandomDouble(-100.0, 100.0)
+       << " " << RandomDouble(-100.0, 100.0) << " " << num_observations;
+    for (int j = 0; j < num_observations; ++j) {
+      of << " " << rand() % num_intrinsics << " " << rand() % num_poses
+         << " " << RandomDouble(0.0, 1000.0) << " "
+         << RandomDouble(0.0, 1000.0);
+    }
+    of << "\n";
+  }
+  CHECK(of.good()) << "Error writing to file: " << kFilename;
+}
+
+bool IsIdentical(const double* expected, const double* actual, int size) {
+  return memcmp(expected, actual, size * sizeof(*expected)) == 0;
+}
+
+// Returns the number of parameter blocks and observations of actual
+// which are not identical to those of expected.
+int CompareBAFiles(const BAFile& expected, const BAFile& actual) {
+  CHECK_EQ(actual.num_intrinsics(), expected.num_intrinsics());
+  CHECK_EQ(actual.num_poses(), expected.num_poses());
+  CHECK_EQ(actual.num_points(), expected.num_points());
+  CHECK_EQ(actual.num_observations(), expected.num_observations());
+
+  int num_failures = 0;
+  for (int i = 0; i < expected.num_intrinsics(); ++i) {
+    num_failures += !IsIdentical(expected.GetIntrinsics(i),
+                                 actual.GetIntrinsics(i),
+                                 6);
+  }
+  for (int i = 0; i < expected.num_poses(); ++i) {
+    num_failures += !IsIdentical(expected.GetPose(i), actual.GetPose(i), 6);
+  }
+  for (int i = 0; i < expected.num_points(); ++i) {
+    num_failures += !IsIdentical(expected.GetPoint(i), actual.GetPoint(i), 3);
+  }
+  for (int i = 0; i < expected.num_observations(); ++i) {
+    const Observation e = expected.GetObservation(i);
+    const Observation a = actual.GetObservation(i);
+    num_failures += a.intrinsics_id != e.intrinsics_id ||
+        a.pose_id != e.pose_id ||
+        !IsIdentical(&e.x, &a.x, 1) ||
+        !IsIdentical(&e.y, &a.y, 1);
+  }
+  return num_failures;
+}
+
+}  // namespace
+}  // namespace openMVG
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  srand(5);
+  openMVG::WriteTestFile();
+  const openMVG::BAFile expected(openMVG::kFilename);
+
+  const int kNumThreads[] = {2, 3, 4, 7, 16};
+  int num_failures = 0;
+  for (int i = 0; i < sizeof(kNumThreads) / sizeof(kNumThreads[0]); ++i) {
+    openMVG::BAFile::Options options;
+    options.num_threads = kNumThreads[i];
+    const openMVG::BAFile actual(openMVG::kFilename, options);
+    const int num_differences = openMVG::CompareBAFiles(expected, actual);
+    if (num_differences > 0) {
+      LOG(ERROR) << num_differences << " blocks or observations differ "
+                 << "when reading with " << kNumThreads[i] << " threads.";
+      ++num_failures;
+    }
+  }
+  remove(openMVG::kFilename);
+
+  if (num_failures > 0) {
+    LOG(ERROR) << num_failures << " of the multithreaded reads differ.";
+    return 1;
+  }
+  LOG(INFO) << "All multithreaded reads are identical.";
+  return 0;
+}
@@ -0,0 +1,92 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+//
+// ==========================================
+// Convert between text and binary BAF files.
+// ==========================================
+//
+// Usage: baf_convert --input=<baf_file> --output=<baf_file>
+//                    [--format=binary|text]
+//                    [--single_precision_observations]
+//                    [--merge_intrinsics_tolerance=<tolerance>]
+//
+// The format of the input file is detected automatically. Converting
+// the text BAF files written by openMVG to binary once avoids having
+// to parse them and convert the camera rotations to angle-axis form
+// on every run of bundle_adjuster. With
+// --single_precision_observations the observed coordinates of a
+// binary file are stored as floats, which makes it about a third
+// smaller. With --merge_intrinsics_tolerance the cameras of files
+// which repeat the same intrinsics for every view share them in the
+// output.
+
+#include <string>
+
+#include "ba_file.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_string(input, "", "Input BAF file, text or binary.");
+DEFINE_string(output, "", "Output BAF file.");
+DEFINE_string(format, "binary", "Format of the output file. Options are: "
+              "binary, text.");
+DEFINE_int32(num_threads, 1, "Number of threads used to read a text BAF "
+             "file.");
+DEFINE_bool(single_precision_observations, false, "Store the observed "
+            "coordinates of a binary BAF file in single precision.");
+DEFINE_double(merge_intrinsics_tolerance, -1.0, "If non-negative, merge "
+              "the intrinsics which are equal within this tolerance before "
+              "writing the output, see BAFile::MergeIntrinsics.");
+
+using openMVG::BAFile;
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  if (FLAGS_input.empty() || FLAGS_output.empty()) {
+    LOG(ERROR) << "Usage: baf_convert --input=baf_file --output=baf_file "
+               << "[--format=binary|text]";
+    return 1;
+  }
+
+  BAFile::Options options;
+  options.num_threads = FLAGS_num_threads;
+  options.single_precision_observations =
+      FLAGS_single_precision_observations;
+  options.merge_intrinsics_tolerance = FLAGS_merge_intrinsics_tolerance;
+  BAFile ba_file(FLAGS_input, options);
+  if (FLAGS_format == "binary") {
+    ba_file.WriteToBinaryBAFFile(FLAGS_output);
+  } else if (FLAGS_format == "text") {
+    ba_file.WriteToBAFFile(FLAGS_output);
+  } else {
+    LOG(ERROR) << "Unknown output format: " << FLAGS_format;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,502 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// ==============================================
+// Generate synthetic BAF files for scaling tests
+// ==============================================
+//
+// Usage: baf_generate --output=<baf_file> [--format=binary|text]
+//                     [--num_poses=1000] [--num_points=100000]
+//                     [--num_intrinsics=1]
+//                     [--min_track_length=2] [--mean_track_length=4]
+//                     [--max_track_length=50]
+//                     [--observation_sigma=0.5]
+//                     [--single_precision_observations]
+//
+// The cameras are evenly spaced on a circle, looking at its center,
+// like a camera walking around an object. Every point is placed in
+// front of a random camera and observed by it and the cameras that
+// follow it on the circle, so the covisibility graph is banded like
+// that of an image sequence. Track lengths follow a geometric
+// distribution, shifted to start at --min_track_length and capped at
+// --max_track_length. Pose i uses intrinsics i % --num_intrinsics, and
+// the observations are the projections of the points with normally
+// distributed noise added.
+//
+// Everything is generated from the counter based random number
+// generator of random.h, keyed by --random_seed and indexed by the id
+// of the element being generated. The points and observations are
+// therefore never stored: they are generated again for every section
+// of the file that needs them, and the file is written in one
+// sequential pass, using memory proportional to the number of poses
+// only.
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "binary_baf_format.h"
+#include "camera_models.h"
+#include "ceres/rotation.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "random.h"
+
+DEFINE_string(output, "", "Output BAF file.");
+DEFINE_string(format, "binary", "Format of the output file. Options are: "
+              "binary, text.");
+DEFINE_int32(num_poses, 1000, "Number of camera poses.");
+DEFINE_int32(num_points, 100000, "Number of points.");
+DEFINE_int32(num_intrinsics, 1, "Number of distinct camera intrinsics. "
+             "Pose i uses intrinsics i % num_intrinsics.");
+DEFINE_int32(min_track_length, 2, "Minimum number of observations of a "
+             "point.");
+DEFINE_double(mean_track_length, 4.0, "Mean number of observations of a "
+              "point, before the track lengths are capped at "
+              "max_track_length.");
+DEFINE_int32(max_track_length, 50, "Maximum number of observations of a "
+             "point. Also capped at num_poses.");
+DEFINE_double(observation_sigma, 0.5, "Standard deviation of the noise "
+              "added to the observations, in pixels.");
+DEFINE_bool(single_precision_observations, false, "Store the observed "
+            "coordinates of a binary BAF file in single precision.");
+DEFINE_int32(random_seed, 38401, "Random seed of the generated scene.");
+
+using openMVG::BinaryBAFHeader;
+using openMVG::BinaryBAFLayout;
+using openMVG::BinaryBAFWriter;
+using openMVG::CounterBasedRandom;
+
+namespace {
+
+// Streams of random numbers used by SyntheticScene.
+enum {
+  kIntrinsicsStream = 0,
+  kTrackStream = 1,
+  kPointStream = 2,
+  kObservationStream = 3
+};
+
+const double kCircleRadius = 10.0;
+const double kImageWidth = 1920.0;
+const double kImageHeight = 1080.0;
+const double kFocalLength = 1000.0;
+
+// Number of array elements written at a time.
+const int kChunkSize = 1 << 16;
+
+class SyntheticScene {
+ public:
+  SyntheticScene(const int num_intrinsics,
+                 const int num_poses,
+                 const int num_points,
+                 const uint32_t seed)
+      : random_(seed),
+        num_intrinsics_(num_intrinsics),
+        num_poses_(num_poses),
+        num_points_(num_points),
+        max_track_length_(std::min(FLAGS_max_track_length, num_poses)) {
+    CHECK_GE(num_intrinsics_, 1);
+    CHECK_GE(num_poses_, 1);
+    CHECK_GE(num_points_, 1);
+    CHECK_GE(FLAGS_min_track_length, 1);
+    CHECK_LE(FLAGS_min_track_length, max_track_length_)
+        << "min_track_length is larger than the number of poses or "
+        << "max_track_length.";
+    CHECK_GE(FLAGS_mean_track_length, FLAGS_min_track_length);
+
+    intrinsics_.resize(6 * num_intrinsics_);
+    for (int i = 0; i < num_intrinsics_; ++i) {
+      double n[4];
+      random_.Normal(i, kIntrinsicsStream, 0, &n[0], &n[1]);
+      random_.Normal(i, kIntrinsicsStream, 1, &n[2], &n[3]);
+      double* intrinsics = &intrinsics_[6 * i];
+      intrinsics[openMVG::OFFSET_FOCAL_LENGTH] =
+          kFocalLength * (1.0 + 0.05 * n[0]);
+      intrinsics[openMVG::OFFSET_PRINCIPAL_POINT_X] =
+          kImageWidth / 2.0 + 10.0 * n[1];
+      intrinsics[openMVG::OFFSET_PRINCIPAL_POINT_Y] =
+          kImageHeight / 2.0 + 10.0 * n[2];
+      intrinsics[openMVG::OFFSET_DISTO_K1] = -0.05 + 0.02 * n[3];
+      intrinsics[openMVG::OFFSET_DISTO_K2] = 0.0;
+      intrinsics[openMVG::OFFSET_DISTO_K3] = 0.0;
+    }
+
+    // Pose i is on the circle at angle theta, with its z axis pointing
+    // at the center and its y axis pointing down.
+    rotations_.resize(9 * num_poses_);
+    poses_.resize(6 * num_poses_);
+    for (int i = 0; i < num_poses_; ++i) {
+      const double theta = 2.0 * M_PI * i / num_poses_;
+      const double c = cos(theta);
+      const double s = sin(theta);
+      double* rotation = &rotations_[9 * i];
+      const double rows[9] = {
+        -s,  c,   0.0,
+        0.0, 0.0, -1.0,
+        -c,  -s,  0.0
+      };
+      std::copy(rows, rows + 9, rotation);
+      double* pose = &poses_[6 * i];
+      ceres::RotationMatrixToAngleAxis(
+          ceres::RowMajorAdapter3x3<const double>(rotation), pose);
+      pose[3] = kCircleRadius * c;
+      pose[4] = kCircleRadius * s;
+      pose[5] = 0.0;
+    }
+
+    // Track lengths are min_track_length plus a geometrically
+    // distributed number of additional observations.
+    const double extra = FLAGS_mean_track_length - FLAGS_min_track_length;
+    log_one_minus_p_ = (extra > 0.0) ? log(extra / (extra + 1.0)) : 0.0;
+  }
+
+  int num_intrinsics() const { return num_intrinsics_; }
+  int num_poses() const { return num_poses_; }
+  int num_points() const { return num_points_; }
+
+  const double* intrinsics(int intrinsics_id) const {
+    return &intrinsics_[6 * intrinsics_id];
+  }
+
+  // The rotation matrix of a pose, in row major order.
+  const double* rotation(int pose_id) const {
+    return &rotations_[9 * pose_id];
+  }
+
+  // Angle-axis rotation and camera center.
+  const double* pose(int pose_id) const { return &poses_[6 * pose_id]; }
+
+  int IntrinsicsIdForPose(int pose_id) const {
+    return pose_id % num_intrinsics_;
+  }
+
+  int TrackLength(const int point_id) const {
+    double u1, u2;
+    random_.Uniform(point_id, kTrackStream, 0, &u1, &u2);
+    int length = FLAGS_min_track_length;
+    if (log_one_minus_p_ < 0.0) {
+      // 1 - u2 is in (0, 1], so the logarithm is finite.
+      length += static_cast<int>(log(1.0 - u2) / log_one_minus_p_);
+    }
+    return std::min(length, max_track_length_);
+  }
+
+  // The pose making the i-th observation of a point.
+  int PoseIdForObservation(const int point_id, const int i) const {
+    double u1, u2;
+    random_.Uniform(point_id, kTrackStream, 0, &u1, &u2);
+    const int first_pose_id =
+        std::min(static_cast<int>(u1 * num_poses_), num_poses_ - 1);
+    return (first_pose_id + i) % num_poses_;
+  }
+
+  // A point in front of the first pose observing it, at a depth of
+  // 0.1 to 0.9 times the radius of the circle and within 25 degrees of
+  // its optical axis horizontally and 15 degrees vertically. Its
+  // distance from the axis of the circle is then less than the radius,
+  // so it is in front of every other pose too.
+  void GetPoint(const int point_id, double* point) const {
+    double u[4];
+    random_.Uniform(point_id, kPointStream, 0, &u[0], &u[1]);
+    random_.Uniform(point_id, kPointStream, 1, &u[2], &u[3]);
+    const double depth = kCircleRadius * (0.1 + 0.8 * u[0]);
+    const double camera_point[3] = {
+      depth * tan((2.0 * u[1] - 1.0) * 25.0 * M_PI / 180.0),
+      depth * tan((2.0 * u[2] - 1.0) * 15.0 * M_PI / 180.0),
+      depth
+    };
+
+    const int pose_id = PoseIdForObservation(point_id, 0);
+    const double* r = rotation(pose_id);
+    const double* center = pose(pose_id) + 3;
+    for (int j = 0; j < 3; ++j) {
+      point[j] = center[j] +
+          r[j] * camera_point[0] +
+          r[3 + j] * camera_point[1] +
+          r[6 + j] * camera_point[2];
+    }
+  }
+
+  // The i-th observation of a point, given the point.
+  void GetObservation(const int point_id,
+                      const int i,
+                      const double* point,
+                      int* intrinsics_id,
+                      int* pose_id,
+                      double* x,
+                      double* y) const {
+    *pose_id = PoseIdForObservation(point_id, i);
+    *intrinsics_id = IntrinsicsIdForPose(*pose_id);
+
+    // The residual of an observation at (0, 0) is the projection.
+    const openMVG::CameraReprojectionError<openMVG::RadialK3Camera>
+        projection(0.0, 0.0);
+    double xy[2];
+    projection(intrinsics(*intrinsics_id), pose(*pose_id), point, xy);
+
+    double n1, n2;
+    random_.Normal(point_id, kObservationStream, i, &n1, &n2);
+    *x = xy[0] + FLAGS_observation_sigma * n1;
+    *y = xy[1] + FLAGS_observation_sigma * n2;
+  }
+
+ private:
+  const CounterBasedRandom random_;
+  const int num_intrinsics_;
+  const int num_poses_;
+  const int num_points_;
+  const int max_track_length_;
+  double log_one_minus_p_;
+  std::vector<double> intrinsics_;
+  std::vector<double> rotations_;
+  std::vector<double> poses_;
+};
+
+void WriteTextBAFFile(const SyntheticScene& scene,
+                      const std::string& filename) {
+  std::ofstream of(filename.c_str());
+  CHECK(of.good()) << "Unable to open file: " << filename;
+  of.precision(17);
+
+  of << scene.num_intrinsics() << "\n"
+     << scene.num_poses() << "\n"
+     << scene.num_points() << "\n";
+  for (int i = 0; i < scene.num_intrinsics(); ++i) {
+    const double* intrinsics = scene.intrinsics(i);
+    for (int j = 0; j < 6; ++j) {
+      of << intrinsics[j] << " ";
+    }
+    of << "\n";
+  }
+
+  // Text BAF files store the rotation matrices in column major order.
+  for (int i = 0; i < scene.num_poses(); ++i) {
+    const double* rotation = scene.rotation(i);
+    for (int j = 0; j < 9; ++j) {
+      of << rotation[3 * (j % 3) + j / 3] << " ";
+    }
+    const double* center = scene.pose(i) + 3;
+    of << center[0] << " " << center[1] << " " << center[2] << " \n";
+  }
+
+  for (int i = 0; i < scene.num_points(); ++i) {
+    double point[3];
+    scene.GetPoint(i, point);
+    const int track_length = scene.TrackLength(i);
+    of << point[0] << " " << point[1] << " " << point[2] << " "
+       << track_length;
+    for (int j = 0; j < track_length; ++j) {
+      int intrinsics_id, pose_id;
+      double x, y;
+      scene.GetObservation(i, j, point, &intrinsics_id, &pose_id, &x, &y);
+      of << " " << intrinsics_id << " " << pose_id << " " << x << " " << y;
+    }
+    of << " \n";
+  }
+  CHECK(of.good()) << "Error writing to file: " << filename;
+}
+
+// Buffers the elements of a section of a binary BAF file and writes
+// them kChunkSize at a time.
+template <typename T>
+class SectionWriter {
+ public:
+  SectionWriter(const size_t offset, BinaryBAFWriter* writer)
+      : offset_(offset), writer_(writer) {
+    buffer_.reserve(kChunkSize);
+  }
+
+  ~SectionWriter() { Flush(); }
+
+  void Append(const T& value) {
+    buffer_.push_back(value);
+    if (buffer_.size() == kChunkSize) {
+      Flush();
+    }
+  }
+
+ private:
+  void Flush() {
+    if (buffer_.empty()) {
+      return;
+    }
+    writer_->Write(offset_, &buffer_[0], buffer_.size() * sizeof(T));
+    offset_ += buffer_.size() * sizeof(T);
+    buffer_.clear();
+  }
+
+  size_t offset_;
+  BinaryBAFWriter* writer_;
+  std::vector<T> buffer_;
+};
+
+// Which member of an observation an observation section stores.
+enum ObservationField {
+  INTRINSICS_ID,
+  POSE_ID,
+  X,
+  Y
+};
+
+template <typename T>
+void WriteObservationSection(const SyntheticScene& scene,
+                             const ObservationField field,
+                             const size_t offset,
+                             BinaryBAFWriter* writer) {
+  SectionWriter<T> section(offset, writer);
+  for (int i = 0; i < scene.num_points(); ++i) {
+    double point[3];
+    scene.GetPoint(i, point);
+    const int track_length = scene.TrackLength(i);
+    for (int j = 0; j < track_length; ++j) {
+      int intrinsics_id, pose_id;
+      double x, y;
+      scene.GetObservation(i, j, point, &intrinsics_id, &pose_id, &x, &y);
+      switch (field) {
+        case INTRINSICS_ID:
+          section.Append(static_cast<T>(intrinsics_id));
+          break;
+        case POSE_ID:
+          section.Append(static_cast<T>(pose_id));
+          break;
+        case X:
+          section.Append(static_cast<T>(x));
+          break;
+        case Y:
+          section.Append(static_cast<T>(y));
+          break;
+      }
+    }
+  }
+}
+
+void WriteBinaryBAFFile(const SyntheticScene& scene,
+                        const bool single_precision,
+                        const std::string& filename) {
+  int64_t num_observations = 0;
+  for (int i = 0; i < scene.num_points(); ++i) {
+    num_observations += scene.TrackLength(i);
+  }
+  CHECK_LE(num_observations, std::numeric_limits<int32_t>::max())
+      << "Too many observations for a BAF file.";
+
+  std::ofstream of(filename.c_str(), std::ios::out | std::ios::binary);
+  CHECK(of.good()) << "Unable to open file: " << filename;
+
+  BinaryBAFHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, openMVG::kBinaryBAFMagic,
+         sizeof(openMVG::kBinaryBAFMagic));
+  header.version = openMVG::kBinaryBAFVersion;
+  header.num_intrinsics = scene.num_intrinsics();
+  header.num_poses = scene.num_poses();
+  header.num_points = scene.num_points();
+  header.num_observations = num_observations;
+  if (single_precision) {
+    header.flags |= openMVG::kSinglePrecisionObservations;
+  }
+  const BinaryBAFLayout layout(header);
+
+  BinaryBAFWriter writer(&of);
+  writer.Write(layout.header, &header, sizeof(header));
+  writer.Write(layout.intrinsics, scene.intrinsics(0),
+               6 * scene.num_intrinsics() * sizeof(double));
+  writer.Write(layout.poses, scene.pose(0),
+               6 * scene.num_poses() * sizeof(double));
+
+  {
+    SectionWriter<double> points(layout.points, &writer);
+    for (int i = 0; i < scene.num_points(); ++i) {
+      double point[3];
+      scene.GetPoint(i, point);
+      points.Append(point[0]);
+      points.Append(point[1]);
+      points.Append(point[2]);
+    }
+  }
+
+  {
+    SectionWriter<int32_t> point_offsets(layout.point_offsets, &writer);
+    int32_t offset = 0;
+    point_offsets.Append(offset);
+    for (int i = 0; i < scene.num_points(); ++i) {
+      offset += scene.TrackLength(i);
+      point_offsets.Append(offset);
+    }
+  }
+
+  WriteObservationSection<int32_t>(
+      scene, INTRINSICS_ID, layout.intrinsics_ids, &writer);
+  WriteObservationSection<int32_t>(scene, POSE_ID, layout.pose_ids, &writer);
+  if (single_precision) {
+    WriteObservationSection<float>(scene, X, layout.x, &writer);
+    WriteObservationSection<float>(scene, Y, layout.y, &writer);
+  } else {
+    WriteObservationSection<double>(scene, X, layout.x, &writer);
+    WriteObservationSection<double>(scene, Y, layout.y, &writer);
+  }
+  writer.Write(layout.size, NULL, 0);
+  CHECK(of.good()) << "Error writing to file: " << filename;
+
+  LOG(INFO) << "Wrote " << scene.num_poses() << " poses, "
+            << scene.num_points() << " points and "
+            << num_observations << " observations to " << filename;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  if (FLAGS_output.empty()) {
+    LOG(ERROR) << "Usage: baf_generate --output=baf_file "
+               << "[--format=binary|text]";
+    return 1;
+  }
+
+  const SyntheticScene scene(FLAGS_num_intrinsics,
+                             FLAGS_num_poses,
+                             FLAGS_num_points,
+                             FLAGS_random_seed);
+  if (FLAGS_format == "binary") {
+    WriteBinaryBAFFile(scene,
+                       FLAGS_single_precision_observations,
+                       FLAGS_output);
+  } else if (FLAGS_format == "text") {
+    WriteTextBAFFile(scene, FLAGS_output);
+  } else {
+    LOG(ERROR) << "Unknown output format: " << FLAGS_format;
+    return 1;
+  }
+  return 0;
+}
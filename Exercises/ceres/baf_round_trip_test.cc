@@ -0,0 +1,193 @@
+// Ceres Solver - A fast non-linear least squares minimizer
+// Copyright 2015 Google Inc. All rights reserved.
+// http://ceres-solver.org/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Writes a random reconstruction as a text BAF file and checks that
+// writing it out with WriteToBinaryBAFFile and WriteToBAFFile and
+// reading it back reproduces it: exactly through the binary format,
+// and exactly except for the rotations through the text format, which
+// converts them to rotation matrices. Exits with a non-zero status if
+// it does not.
+//
+// Usage: baf_round_trip_test [--logtostderr]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+
+#include "ba_file.h"
+#include "ceres/rotation.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+namespace openMVG {
+namespace {
+
+const char kTextFilename[] = "baf_round_trip_test.baf";
+const char kBinaryFilename[] = "baf_round_trip_test.bafb";
+const char kRoundTripFilename[] = "baf_round_trip_test_2.baf";
+
+// Rotations differ by a few ulps after a round trip through a rotation
+// matrix.
+const double kRotationTolerance = 1e-12;
+
+double RandomDouble(const double min, const double max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+void WriteTestFile() {
+  const int num_intrinsics = 3;
+  const int num_poses = 20;
+  const int num_points = 1000;
+  std::ofstream of(kTextFilename);
+  CHECK(of.good()) << "Unable to open file: " << kTextFilename;
+  of.precision(17);
+  of << num_intrinsics << "\n" << num_poses << "\n" << num_points << "\n";
+  for (int i = 0; i < num_intrinsics; ++i) {
+    of << RandomDouble(500.0, 2000.0) << " " << RandomDouble(300.0, 700.0)
+       << " " << RandomDouble(200.0, 500.0) << " "
+       << RandomDouble(-0.3, 0.3) << " " << RandomDouble(-0.1, 0.1) << " "
+       << RandomDouble(-0.05, 0.05) << "\n";
+  }
+  for (int i = 0; i < num_poses; ++i) {
+    double angle_axis[3];
+    for (int j = 0; j < 3; ++j) {
+      angle_axis[j] = RandomDouble(-1.5, 1.5);
+    }
+    double rotation_matrix[9];
+    ceres::AngleAxisToRotationMatrix(
+        angle_axis, ceres::ColumnMajorAdapter3x3(rotation_matrix));
+    for (int j = 0; j < 9; ++j) {
+      of << rotation_matrix[j] << " ";
+    }
+    of << RandomDouble(-10.0, 10.0) << " " << RandomDouble(-10.0, 10.0)
+       << " " << RandomDouble(-10.0, 10.0) << "\n";
+  }
+  for (int i = 0; i < num_points; ++i) {
+    const int num_observations = 1 + rand() % 4;
+    of << RandomDouble(-100.0, 100.0) << " " << RandomDouble(-100.0, 100.0)
+       << " " << RandomDouble(-100.0, 100.0) << " " << num_observations;
+    for (int j = 0; j < num_observations; ++j) {
+      of << " " << rand() % num_intrinsics << " " << rand() % num_poses
+         << " " << RandomDouble(0.0, 1000.0) << " "
+         << RandomDouble(0.0, 1000.0);
+    }
+    of << "\n";
+  }
+  CHECK(of.good()) << "Error writing to file: " << kTextFilename;
+}
+
+// Returns the number of values of actual which differ from those of
+// expected, by more than rotation_tolerance for the rotations.
+int CompareBAFiles(const char* name,
+                   const double rotation_tolerance,
+                   BAFile* expected,
+                   BAFile* actual) {
+  if (actual->num_intrinsics() != expected->num_intrinsics() ||
+      actual->num_poses() != expected->num_poses() ||
+      actual->num_points() != expected->num_points() ||
+      actual->num_observations() != expected->num_observations()) {
+    LOG(ERROR) << name << ": the sizes differ.";
+    return 1;
+  }
+
+  int num_failures = 0;
+  for (int i = 0; i < expected->num_intrinsics(); ++i) {
+    for (int j = 0; j < 6; ++j) {
+      num_failures +=
+          actual->GetIntrinsics(i)[j] != expected->GetIntrinsics(i)[j];
+    }
+  }
+  for (int i = 0; i < expected->num_poses(); ++i) {
+    for (int j = 0; j < 6; ++j) {
+      const double difference =
+          fabs(actual->GetPose(i)[j] - expected->GetPose(i)[j]);
+      num_failures += !(difference <= (j < 3 ? rotation_tolerance : 0.0));
+    }
+  }
+  for (int i = 0; i < expected->num_points(); ++i) {
+    for (int j = 0; j < 3; ++j) {
+      num_failures += actual->GetPoint(i)[j] != expected->GetPoint(i)[j];
+    }
+    if (actual->ObservationsForPoint(i).size() !=
+        expected->ObservationsForPoint(i).size()) {
+      ++num_failures;
+      continue;
+    }
+    for (int j = 0; j < expected->ObservationsForPoint(i).size(); ++j) {
+      const Observation a = actual->ObservationsForPoint(i)[j];
+      const Observation e = expected->ObservationsForPoint(i)[j];
+      num_failures += a.intrinsics_id != e.intrinsics_id ||
+          a.pose_id != e.pose_id || a.x != e.x || a.y != e.y;
+    }
+  }
+
+  if (num_failures > 0) {
+    LOG(ERROR) << name << ": " << num_failures << " values differ.";
+  } else {
+    LOG(INFO) << name << ": passed.";
+  }
+  return num_failures;
+}
+
+}  // namespace
+}  // namespace openMVG
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  srand(5);
+  openMVG::WriteTestFile();
+  openMVG::BAFile text_file(openMVG::kTextFilename);
+  text_file.WriteToBinaryBAFFile(openMVG::kBinaryFilename);
+  text_file.WriteToBAFFile(openMVG::kRoundTripFilename);
+
+  int num_failures = 0;
+  {
+    openMVG::BAFile binary_file(openMVG::kBinaryFilename);
+    num_failures += openMVG::CompareBAFiles("Binary round trip", 0.0,
+                                            &text_file, &binary_file);
+  }
+  {
+    openMVG::BAFile round_trip_file(openMVG::kRoundTripFilename);
+    num_failures += openMVG::CompareBAFiles(
+        "Text round trip", openMVG::kRotationTolerance,
+        &text_file, &round_trip_file);
+  }
+  remove(openMVG::kTextFilename);
+  remove(openMVG::kBinaryFilename);
+  remove(openMVG::kRoundTripFilename);
+
+  if (num_failures > 0) {
+    LOG(ERROR) << "The round trips changed the reconstruction.";
+    return 1;
+  }
+  LOG(INFO) << "All round trips passed.";
+  return 0;
+}
@@ -0,0 +1,128 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_BINARY_BAF_FORMAT_H_
+#define EXERCISES_CERES_BINARY_BAF_FORMAT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <fstream>
+
+#include "glog/logging.h"
+
+namespace openMVG {
+
+// Binary BAF files consist of a BinaryBAFHeader followed by the
+// arrays
+//
+//   intrinsics      double[6 * num_intrinsics]
+//   poses           double[6 * num_poses] (angle-axis, camera center)
+//   points          double[3 * num_points]
+//   point_offsets   int32[num_points + 1]
+//   intrinsics_ids  int32[num_observations]
+//   pose_ids        int32[num_observations]
+//   x               double[num_observations]
+//   y               double[num_observations]
+//
+// in native byte order, each starting at an offset from the beginning
+// of the file that is a multiple of 8. This is exactly the in-memory
+// representation of a BAFile, so the arrays can be used directly from
+// a memory mapping of the file.
+//
+// If kSinglePrecisionObservations is set in the flags of the header,
+// x and y are float arrays instead. Files written before the flags
+// existed have zero there.
+const char kBinaryBAFMagic[8] = { 'B', 'A', 'F', 'B', 'I', 'N', '\r', '\n' };
+const int32_t kBinaryBAFVersion = 1;
+const int32_t kSinglePrecisionObservations = 1;
+
+struct BinaryBAFHeader {
+  char magic[8];
+  int32_t version;
+  int32_t num_intrinsics;
+  int32_t num_poses;
+  int32_t num_points;
+  int32_t num_observations;
+  int32_t flags;
+};
+
+// Byte offsets of the sections of a binary BAF file.
+struct BinaryBAFLayout {
+  explicit BinaryBAFLayout(const BinaryBAFHeader& h) {
+    header = 0;
+    intrinsics = Align(sizeof(BinaryBAFHeader));
+    poses = Align(intrinsics + 6 * sizeof(double) * h.num_intrinsics);
+    points = Align(poses + 6 * sizeof(double) * h.num_poses);
+    point_offsets = Align(points + 3 * sizeof(double) * h.num_points);
+    intrinsics_ids =
+        Align(point_offsets + sizeof(int32_t) * (h.num_points + 1));
+    pose_ids = Align(intrinsics_ids + sizeof(int32_t) * h.num_observations);
+    const size_t coordinate_size =
+        (h.flags & kSinglePrecisionObservations) ? sizeof(float)
+                                                  : sizeof(double);
+    x = Align(pose_ids + sizeof(int32_t) * h.num_observations);
+    y = Align(x + coordinate_size * h.num_observations);
+    size = Align(y + coordinate_size * h.num_observations);
+  }
+
+  static size_t Align(size_t offset) {
+    return (offset + 7) & ~static_cast<size_t>(7);
+  }
+
+  size_t header;
+  size_t intrinsics;
+  size_t poses;
+  size_t points;
+  size_t point_offsets;
+  size_t intrinsics_ids;
+  size_t pose_ids;
+  size_t x;
+  size_t y;
+  size_t size;
+};
+
+// Writes the sections of a binary BAF file in order, zero padding the
+// gaps between them.
+class BinaryBAFWriter {
+ public:
+  explicit BinaryBAFWriter(std::ofstream* of) : of_(of), offset_(0) {}
+
+  void Write(size_t offset, const void* data, size_t size) {
+    CHECK_GE(offset, offset_);
+    static const char kPadding[8] = { 0 };
+    of_->write(kPadding, offset - offset_);
+    of_->write(static_cast<const char*>(data), size);
+    offset_ = offset + size;
+  }
+
+ private:
+  std::ofstream* of_;
+  size_t offset_;
+};
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_BINARY_BAF_FORMAT_H_
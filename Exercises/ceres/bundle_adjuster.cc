@@ -36,6 +36,9 @@
 //
 // Usage:  bundle_adjuster --input <baf_file>
 //
+// The input can also be a binary BAF file created using baf_convert,
+// which loads much faster for large reconstructions.
+//
 // Use Data/MirebeauStHilaireStatue/sfm_data.baf as the data for this
 // exercise.
 //
@@ -74,15 +77,50 @@
 //
 // http://ceres-solver.org/nnls_solving.html#linearsolver
 
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
 #include <string>
+#include <vector>
 
+#include "analytic_reprojection_error.h"
 #include "ba_file.h"
+#include "bundle_adjustment.h"
+#include "camera_models.h"
+#include "checkpoint.h"
 #include "ceres/ceres.h"
+#include "cost_function_arena.h"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
-#include "reprojection_error.h"
+#include "incremental_problem.h"
+#include "iteration_trace.h"
+#include "keyframe_bundle_adjustment.h"
+#include "linear_solver_planner.h"
+#include "pose_graph_compression.h"
+#include "reprojection_statistics.h"
+#include "submap_bundle_adjustment.h"
+#include "time_budget.h"
+#include "wall_time.h"
 
-DEFINE_string(input, "", "BAF File containing an openMVG reconstruction.");
+DEFINE_string(input, "", "BAF File containing an openMVG reconstruction, "
+              "either in text or binary form.");
+DEFINE_string(input_list, "", "Instead of --input, bundle adjust every BAF "
+              "file listed in this file, one per line, each in a forked "
+              "child process, and write a summary of each to "
+              "--batch_summary. The outputs of a single run, e.g., "
+              "--final_ply, are not supported, and only "
+              "--local_window_size of the modes is.");
+DEFINE_string(batch_summary, "", "CSV file the summary of every dataset "
+              "of --input_list is written to, with a failed row for each "
+              "file which could not be bundle adjusted.");
+DEFINE_int32(batch_large_problem_mb, 64, "BAF files of --input_list at "
+             "least this large are solved one at a time with --num_threads "
+             "threads, the others concurrently with one thread each.");
 DEFINE_double(rotation_sigma, 0.0, "Standard deviation of camera rotation "
               "perturbation.");
 DEFINE_double(position_sigma, 0.0, "Standard deviation of the camera "
@@ -93,18 +131,590 @@ DEFINE_string(initial_ply, "", "Export the BAF file data as a PLY file after "
               "perturbation but before bundle adjustment.");
 DEFINE_string(final_ply, "", "Export the refined BAF file data as a PLY "
               "file after bundle adjustment.");
-DEFINE_int32(random_seed, 38401, "Random seed used to set the state "
-             "of the pseudo random number generator used to generate "
-             "the pertubations.");
+DEFINE_string(ply_format, "ascii", "Format of the PLY files written by "
+              "--initial_ply and --final_ply. Options are: ascii, binary.");
+DEFINE_int32(num_threads, 1, "Number of threads used to read, normalize, "
+             "perturb and export the BAF file, and by the solver.");
+DEFINE_string(reorder, "none", "Renumber the poses by covisibility and "
+              "sort the points before building the problem, to improve "
+              "memory locality. Options are: none, space_filling_curve, "
+              "dominant_camera.");
+DEFINE_string(linear_solver, "auto", "Linear solver used by the "
+              "Levenberg-Marquardt algorithm: auto, to choose one based on "
+              "the size and visibility structure of the problem, or the "
+              "name of a Ceres linear solver, e.g., dense_schur.");
+DEFINE_int32(linear_solver_memory_budget_mb, 4096, "Memory available to the "
+             "linear solver chosen by --linear_solver=auto.");
+DEFINE_string(reprojection_report, "", "Write the number of observations "
+              "and the RMS reprojection error of each pose after bundle "
+              "adjustment to this CSV file.");
+DEFINE_int32(random_seed, 38401, "Random seed used to key the counter based "
+             "pseudo random number generator used to generate the "
+             "pertubations.");
+DEFINE_bool(single_precision_observations, false, "Store the observed "
+            "coordinates in single precision to reduce memory use. The "
+            "problem is still solved in double precision.");
+DEFINE_double(merge_intrinsics_tolerance, -1.0, "If non-negative, merge "
+              "the intrinsics of the BAF file which are equal within this "
+              "tolerance, relative to the focal length for the focal length "
+              "and principal point, so that the cameras share them. Zero "
+              "only merges identical intrinsics.");
+DEFINE_string(camera_model, "radial_k3", "Camera model used for all the "
+              "intrinsics. Options are: pinhole, radial_k1, radial_k3 "
+              "(the model of BAF files), brown_t2, and auto, which picks "
+              "the simplest model that fits the distortion parameters of "
+              "each intrinsic exactly. Distortion terms the model does not "
+              "have are set to zero, with a warning if they were not.");
+DEFINE_string(cost_function, "autodiff", "How the Jacobians of the "
+              "reprojection error are computed. Options are: autodiff, "
+              "analytic. analytic only supports the radial_k3 camera "
+              "model.");
+DEFINE_bool(check_gradients, false, "Check the Jacobians of the cost "
+            "functions against numeric differentiation at every step. "
+            "Very slow, use on small problems only.");
+DEFINE_bool(pool_cost_functions, true, "Construct the cost functions in "
+            "large blocks of memory owned by the bundle adjuster instead of "
+            "allocating each of them separately, which makes building and "
+            "destroying large problems faster.");
+DEFINE_string(trace_json, "", "Write the time spent in each iteration of "
+              "the solver, its cost and trust region radius to this file as "
+              "Chrome trace events, one JSON object per line.");
+DEFINE_int32(submap_size, 0, "If positive, partition the poses into "
+             "submaps of this many poses, solve them independently in "
+             "worker processes, merge them and refine the variables they "
+             "share, instead of solving one problem over the whole "
+             "reconstruction. Bounds the memory used by each process.");
+DEFINE_int32(submap_overlap, 10, "Number of poses on either side of a "
+             "submap that it shares with its neighbors.");
+DEFINE_int32(local_window_size, 0, "If positive, only optimize the "
+             "poses with the largest ids in the BAF file, i.e., the newest "
+             "ones, and the points they observe. The other poses observing "
+             "those points and the intrinsics are held constant.");
+DEFINE_int32(num_submap_processes, 1, "Number of worker processes solving "
+             "the submaps. Each worker uses a single thread, so this, not "
+             "--num_threads, sets the parallelism of the submap solves.");
+DEFINE_string(checkpoint, "", "Periodically write the parameters to this "
+              "file while solving, so that the solve can be resumed with "
+              "--resume_from after a crash or pre-emption.");
+DEFINE_int32(checkpoint_every_iterations, 10, "Write a checkpoint every this "
+             "many iterations. Zero disables this trigger.");
+DEFINE_double(checkpoint_every_seconds, 600.0, "Write a checkpoint every "
+              "this many seconds. Zero disables this trigger.");
+DEFINE_string(resume_from, "", "Start from the parameters in this "
+              "checkpoint, written by a run with the same input and flags, "
+              "and do only the iterations that run had left.");
+DEFINE_double(time_budget_s, 0.0, "If positive, the wall clock seconds "
+              "available for reading, preparing and solving the problem. The "
+              "solver stops before an iteration which is not expected to "
+              "finish in time, with the best parameters found so far.");
+DEFINE_int32(time_budget_min_iterations, 5, "If fewer than this many "
+             "iterations of the chosen linear solver fit in --time_budget_s, "
+             "switch to iterative_schur after the first one. Zero disables "
+             "the switch.");
+DEFINE_int32(incremental_batch_size, 0, "If positive, add the poses to a "
+             "problem which is updated in place in batches of this many, in "
+             "the order of their ids in the BAF file, and solve it after "
+             "every batch, as an incremental reconstruction would. Requires "
+             "--cost_function=autodiff.");
+DEFINE_bool(pose_graph, false, "Marginalize the points into relative pose "
+            "constraints between covisible poses, optimize the resulting "
+            "pose graph and re-triangulate the points, instead of solving "
+            "the full problem. Much cheaper for long sequences, at the cost "
+            "of accuracy. The intrinsics are held constant.");
+DEFINE_int32(pose_graph_max_edges_per_pose, 5, "Number of the most covisible "
+             "poses each pose is connected to in the pose graph.");
+DEFINE_int32(pose_graph_min_shared_points, 30, "Minimum number of points "
+             "two poses must share to be connected in the pose graph.");
+DEFINE_int32(keyframe_interval, 0, "If positive, first bundle adjust every "
+             "this many-th pose in the order of their ids in the BAF file "
+             "and the points those keyframes observe, then initialize the "
+             "other poses by interpolation and resection, and finish with a "
+             "short solve of the whole problem. For dense video sequences.");
+DEFINE_int32(keyframe_final_iterations, 5, "Maximum number of iterations "
+             "of the final solve of --keyframe_interval.");
 
+using openMVG::AnalyticReprojectionError;
 using openMVG::BAFile;
+using openMVG::CameraModelType;
+using openMVG::CostFunctionArena;
 using openMVG::Observation;
-using openMVG::ReprojectionError;
+using openMVG::ReprojectionStatistics;
+using openMVG::WallTimeInSeconds;
+
+void SetCameraModels(BAFile* ba_file) {
+  for (int i = 0; i < ba_file->num_intrinsics(); ++i) {
+    CameraModelType type;
+    if (FLAGS_camera_model == "auto") {
+      type = openMVG::SimplestCameraModel(ba_file->GetIntrinsics(i));
+    } else {
+      CHECK(openMVG::StringToCameraModelType(FLAGS_camera_model, &type))
+          << "Unknown camera model: " << FLAGS_camera_model;
+    }
+    ba_file->SetCameraModel(i, type);
+    LOG(INFO) << "Intrinsics " << i << " use the "
+              << openMVG::CameraModelTypeToString(type) << " camera model.";
+  }
+}
+
+// The camera model is only looked at here, so the cost functions
+// evaluate no more distortion terms than their camera needs. If arena
+// is not NULL the cost function is constructed in it.
+ceres::CostFunction* CreateReprojectionError(const BAFile& ba_file,
+                                             const Observation& obs,
+                                             CostFunctionArena* arena) {
+  const CameraModelType type = ba_file.camera_model(obs.intrinsics_id);
+  if (FLAGS_cost_function == "analytic") {
+    CHECK_EQ(type, openMVG::RADIAL_K3)
+        << "--cost_function=analytic requires --camera_model=radial_k3.";
+    return AnalyticReprojectionError::Create(obs.x, obs.y, arena);
+  }
+  CHECK_EQ(FLAGS_cost_function, "autodiff") << "Unknown cost function.";
+  return openMVG::CreateAutoDiffReprojectionError(ba_file, obs, arena);
+}
+
+// Log the RMS reprojection error of the reconstruction and, if
+// filename is not empty, write the statistics of each pose to it.
+void ReportReprojectionError(const BAFile& ba_file,
+                             const std::string& label,
+                             const std::string& filename) {
+  ReprojectionStatistics statistics;
+  openMVG::ComputeReprojectionStatistics(ba_file,
+                                         FLAGS_num_threads,
+                                         NULL,
+                                         &statistics);
+  LOG(INFO) << label << " RMS reprojection error: " << statistics.rms
+            << " pixels.";
+  if (filename.empty()) {
+    return;
+  }
+
+  std::ofstream of(filename.c_str());
+  CHECK(of.good()) << "Unable to open file: " << filename;
+  of << "pose_id,num_observations,rms\n";
+  for (int i = 0; i < ba_file.num_poses(); ++i) {
+    of << ba_file.OriginalPoseId(i) << ","
+       << statistics.num_observations_per_pose[i] << ","
+       << statistics.rms_per_pose[i] << "\n";
+  }
+  CHECK(of.good()) << "Error writing to file: " << filename;
+}
+
+// Residual blocks are added in point order, so sorting the points
+// such that consecutive points are seen by the same cameras improves
+// the memory locality of the Jacobian evaluation and the Schur
+// complement computation.
+void ReorderBAFile(BAFile* ba_file) {
+  if (FLAGS_reorder == "none") {
+    return;
+  }
+  const double start_time = WallTimeInSeconds();
+  if (FLAGS_reorder == "space_filling_curve") {
+    ba_file->Reorder(BAFile::SPACE_FILLING_CURVE);
+  } else if (FLAGS_reorder == "dominant_camera") {
+    ba_file->Reorder(BAFile::DOMINANT_CAMERA);
+  } else {
+    LOG(FATAL) << "Unknown reordering: " << FLAGS_reorder;
+  }
+  LOG(INFO) << "Reordering took "
+            << WallTimeInSeconds() - start_time << " seconds.";
+}
+
+// Replay the reconstruction the way an incremental reconstruction
+// would build it: the poses are added in the order of their original
+// ids, batch_size at a time, together with their observations, and the
+// problem is solved after every batch. A point is added with its
+// second observation, as a single observation does not determine it,
+// and points observed only once are left unchanged. The problem is
+// updated in place and never rebuilt. The result is copied back into
+// ba_file, and summary is the one of the last solve, which is the only
+// one the callbacks of options are called for.
+void SolveIncrementally(const ceres::Solver::Options& options,
+                        const int batch_size,
+                        BAFile* ba_file,
+                        ceres::Solver::Summary* summary) {
+  openMVG::IncrementalProblem problem;
+  for (int i = 0; i < ba_file->num_intrinsics(); ++i) {
+    problem.AddIntrinsics(ba_file->camera_model(i),
+                          ba_file->GetIntrinsics(i));
+  }
+
+  const int num_poses = ba_file->num_poses();
+  std::vector<int> poses_by_original_id(num_poses);
+  for (int pose_id = 0; pose_id < num_poses; ++pose_id) {
+    poses_by_original_id[ba_file->OriginalPoseId(pose_id)] = pose_id;
+  }
+
+  ceres::Solver::Options batch_options = options;
+  batch_options.callbacks.clear();
+
+  ba_file->IndexObservationsByPose();
+  std::vector<int> incremental_pose_ids(num_poses, -1);
+  std::vector<int> incremental_point_ids(ba_file->num_points(), -1);
+  // The first observation of each point which is not in the problem
+  // yet.
+  std::vector<int> first_observation_ids(ba_file->num_points(), -1);
+  for (int begin = 0; begin < num_poses; begin += batch_size) {
+    const double start_time = WallTimeInSeconds();
+    const int end = std::min(begin + batch_size, num_poses);
+    for (int i = begin; i < end; ++i) {
+      const int pose_id = poses_by_original_id[i];
+      incremental_pose_ids[pose_id] =
+          problem.AddPose(ba_file->GetPose(pose_id));
+      const int* observation_ids = ba_file->ObservationIdsForPose(pose_id);
+      const int* point_ids = ba_file->PointIdsForPose(pose_id);
+      for (int j = 0; j < ba_file->NumObservationsForPose(pose_id); ++j) {
+        const int point_id = point_ids[j];
+        if (incremental_point_ids[point_id] < 0) {
+          if (first_observation_ids[point_id] < 0) {
+            first_observation_ids[point_id] = observation_ids[j];
+            continue;
+          }
+          incremental_point_ids[point_id] =
+              problem.AddPoint(ba_file->GetPoint(point_id));
+          const Observation first_obs =
+              ba_file->GetObservation(first_observation_ids[point_id]);
+          problem.AddObservation(
+              first_obs.intrinsics_id,
+              incremental_pose_ids[first_obs.pose_id],
+              incremental_point_ids[point_id],
+              first_obs.x,
+              first_obs.y);
+        }
+        const Observation obs = ba_file->GetObservation(observation_ids[j]);
+        problem.AddObservation(obs.intrinsics_id,
+                               incremental_pose_ids[pose_id],
+                               incremental_point_ids[point_id],
+                               obs.x,
+                               obs.y);
+      }
+    }
+    const double update_time = WallTimeInSeconds() - start_time;
+    problem.Solve(end == num_poses ? options : batch_options, summary);
+    LOG(INFO) << "Solved " << end << " of " << num_poses << " poses, "
+              << problem.num_points() << " points and "
+              << problem.num_observations() << " observations. Updating "
+              << "the problem took " << update_time << " seconds. "
+              << summary->BriefReport();
+  }
+
+  for (int i = 0; i < ba_file->num_intrinsics(); ++i) {
+    std::copy(problem.GetIntrinsics(i),
+              problem.GetIntrinsics(i) + openMVG::kMaxNumIntrinsicParameters,
+              ba_file->GetIntrinsics(i));
+  }
+  for (int pose_id = 0; pose_id < num_poses; ++pose_id) {
+    const double* pose = problem.GetPose(incremental_pose_ids[pose_id]);
+    std::copy(pose, pose + 6, ba_file->GetPose(pose_id));
+  }
+  for (int point_id = 0; point_id < ba_file->num_points(); ++point_id) {
+    if (incremental_point_ids[point_id] >= 0) {
+      const double* point = problem.GetPoint(incremental_point_ids[point_id]);
+      std::copy(point, point + 3, ba_file->GetPoint(point_id));
+    }
+  }
+}
+
+void WriteToPLYFile(const BAFile& ba_file, const std::string& filename) {
+  if (FLAGS_ply_format == "binary") {
+    ba_file.WriteToBinaryPLYFile(filename);
+  } else {
+    CHECK_EQ(FLAGS_ply_format, "ascii") << "Unknown PLY format.";
+    ba_file.WriteToPLYFile(filename);
+  }
+}
+
+// Sent from the child process bundle adjusting a dataset of a batch to
+// the parent.
+struct BatchResult {
+  BatchResult()
+      : is_solved(false),
+        num_threads(0),
+        num_poses(0),
+        num_points(0),
+        num_observations(0),
+        linear_solver_type(ceres::DENSE_SCHUR),
+        num_iterations(0),
+        initial_cost(0.0),
+        final_cost(0.0),
+        initial_rms(0.0),
+        final_rms(0.0),
+        termination_type(ceres::FAILURE),
+        time(0.0) {}
+
+  bool is_solved;
+  int num_threads;
+  int num_poses;
+  int num_points;
+  int num_observations;
+  ceres::LinearSolverType linear_solver_type;
+  int num_iterations;
+  double initial_cost;
+  double final_cost;
+  double initial_rms;
+  double final_rms;
+  ceres::TerminationType termination_type;
+  double time;
+};
+
+// Bundle adjust one dataset of a batch with num_threads threads, the
+// same way a single run would, but silently and without writing any
+// of the outputs of a single run.
+void BundleAdjustDataset(const std::string& input,
+                         const int num_threads,
+                         BatchResult* result) {
+  const double start_time = WallTimeInSeconds();
+  BAFile::Options ba_file_options;
+  ba_file_options.num_threads = num_threads;
+  ba_file_options.single_precision_observations =
+      FLAGS_single_precision_observations;
+  ba_file_options.merge_intrinsics_tolerance =
+      FLAGS_merge_intrinsics_tolerance;
+  BAFile ba_file(input, ba_file_options);
+  if (FLAGS_camera_model != "radial_k3") {
+    SetCameraModels(&ba_file);
+  }
+  ba_file.Normalize();
+  ba_file.Perturb(FLAGS_rotation_sigma,
+                  FLAGS_position_sigma,
+                  FLAGS_point_sigma,
+                  FLAGS_random_seed);
+  ReorderBAFile(&ba_file);
+
+  ReprojectionStatistics statistics;
+  openMVG::ComputeReprojectionStatistics(ba_file, num_threads, NULL,
+                                         &statistics);
+  result->initial_rms = statistics.rms;
+
+  ceres::Solver::Options options;
+  options.logging_type = ceres::SILENT;
+  options.check_gradients = FLAGS_check_gradients;
+  openMVG::SetLinearSolver(
+      ba_file,
+      FLAGS_local_window_size,
+      FLAGS_linear_solver,
+      static_cast<int64_t>(FLAGS_linear_solver_memory_budget_mb) << 20,
+      num_threads,
+      &options);
+
+  ceres::Solver::Summary summary;
+  {
+    CostFunctionArena arena;
+    ceres::Problem::Options problem_options;
+    if (FLAGS_pool_cost_functions) {
+      problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    }
+    ceres::Problem problem(problem_options);
+    openMVG::BuildProblem(CreateReprojectionError,
+                          FLAGS_local_window_size,
+                          FLAGS_pool_cost_functions ? &arena : NULL,
+                          &ba_file,
+                          &problem);
+    ceres::Solve(options, &problem, &summary);
+  }
+
+  openMVG::ComputeReprojectionStatistics(ba_file, num_threads, NULL,
+                                         &statistics);
+  result->is_solved = true;
+  result->num_threads = num_threads;
+  result->num_poses = ba_file.num_poses();
+  result->num_points = ba_file.num_points();
+  result->num_observations = ba_file.num_observations();
+  result->linear_solver_type = options.linear_solver_type;
+  result->num_iterations =
+      summary.num_successful_steps + summary.num_unsuccessful_steps;
+  result->initial_cost = summary.initial_cost;
+  result->final_cost = summary.final_cost;
+  result->final_rms = statistics.rms;
+  result->termination_type = summary.termination_type;
+  result->time = WallTimeInSeconds() - start_time;
+}
+
+// A dataset of a batch being bundle adjusted in a child process, which
+// writes its BatchResult to fd.
+struct RunningDataset {
+  int id;
+  pid_t pid;
+  int fd;
+};
+
+// Bundle adjust inputs[id] with num_threads threads in a child process,
+// so that a file which fails a CHECK, e.g., because it is malformed,
+// only fails its own dataset. The parent does not use OpenMP in batch
+// mode, so the children are free to.
+RunningDataset StartDataset(const std::vector<std::string>& inputs,
+                            const int id,
+                            const int num_threads) {
+  int fds[2];
+  CHECK_EQ(pipe(fds), 0) << "pipe failed: " << strerror(errno);
+  const pid_t pid = fork();
+  CHECK_GE(pid, 0) << "fork failed: " << strerror(errno);
+  if (pid == 0) {
+    close(fds[0]);
+    BatchResult result;
+    BundleAdjustDataset(inputs[id], num_threads, &result);
+    const ssize_t num_written = write(fds[1], &result, sizeof(result));
+    _exit(num_written == sizeof(result) ? 0 : 1);
+  }
+  close(fds[1]);
+
+  RunningDataset dataset;
+  dataset.id = id;
+  dataset.pid = pid;
+  dataset.fd = fds[0];
+  return dataset;
+}
+
+// Wait for any of the running datasets to finish, store its result in
+// results and remove it from running. Returns false if it failed, in
+// which case its result is left not solved.
+bool FinishDataset(const std::vector<std::string>& inputs,
+                   std::vector<RunningDataset>* running,
+                   std::vector<BatchResult>* results) {
+  int status = 0;
+  const pid_t pid = waitpid(-1, &status, 0);
+  CHECK_GT(pid, 0) << "waitpid failed: " << strerror(errno);
+  int i = 0;
+  while ((*running)[i].pid != pid) {
+    ++i;
+    CHECK_LT(i, running->size()) << "Unknown child process " << pid;
+  }
+  const RunningDataset dataset = (*running)[i];
+  running->erase(running->begin() + i);
+
+  BatchResult result;
+  const ssize_t num_read = read(dataset.fd, &result, sizeof(result));
+  close(dataset.fd);
+  if (num_read != sizeof(result) ||
+      !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    LOG(ERROR) << "Unable to bundle adjust " << inputs[dataset.id] << ".";
+    return false;
+  }
+  (*results)[dataset.id] = result;
+  LOG(INFO) << "Solved " << inputs[dataset.id] << " in " << result.time
+            << " seconds.";
+  return true;
+}
+
+// Bundle adjust every BAF file listed in --input_list without starting
+// bundle_adjuster again for each of them: every dataset is solved in a
+// forked child process. Files of at least --batch_large_problem_mb are
+// solved one after the other with --num_threads threads each, and the
+// rest are packed onto --num_threads concurrent children, one thread
+// each, largest first so that the long solves do not start last. A file
+// which cannot be bundle adjusted gets a failed row in --batch_summary.
+// Returns the number of such files.
+int BundleAdjustBatch() {
+  CHECK_GE(FLAGS_num_threads, 1);
+  std::ifstream list(FLAGS_input_list.c_str());
+  CHECK(list.good()) << "Unable to open file: " << FLAGS_input_list;
+  std::vector<std::string> inputs;
+  std::string line;
+  while (std::getline(list, line)) {
+    if (!line.empty() && line[0] != '#') {
+      inputs.push_back(line);
+    }
+  }
+
+  const double start_time = WallTimeInSeconds();
+  const int64_t large_problem_bytes =
+      static_cast<int64_t>(FLAGS_batch_large_problem_mb) << 20;
+  std::vector<std::pair<int64_t, int> > large_problems;
+  std::vector<std::pair<int64_t, int> > small_problems;
+  int num_failed = 0;
+  for (int i = 0; i < inputs.size(); ++i) {
+    struct stat file_stat;
+    if (stat(inputs[i].c_str(), &file_stat) != 0) {
+      LOG(ERROR) << "Unable to open file: " << inputs[i];
+      ++num_failed;
+      continue;
+    }
+    const std::pair<int64_t, int> problem(-file_stat.st_size, i);
+    if (file_stat.st_size >= large_problem_bytes) {
+      large_problems.push_back(problem);
+    } else {
+      small_problems.push_back(problem);
+    }
+  }
+  std::sort(large_problems.begin(), large_problems.end());
+  std::sort(small_problems.begin(), small_problems.end());
+  LOG(INFO) << "Solving " << large_problems.size() << " large and "
+            << small_problems.size() << " small problems.";
+
+  std::vector<BatchResult> results(inputs.size());
+  std::vector<RunningDataset> running;
+  for (int i = 0; i < large_problems.size(); ++i) {
+    running.push_back(
+        StartDataset(inputs, large_problems[i].second, FLAGS_num_threads));
+    num_failed += !FinishDataset(inputs, &running, &results);
+  }
+  for (int i = 0; i < small_problems.size(); ++i) {
+    if (running.size() >= FLAGS_num_threads) {
+      num_failed += !FinishDataset(inputs, &running, &results);
+    }
+    running.push_back(StartDataset(inputs, small_problems[i].second, 1));
+  }
+  while (!running.empty()) {
+    num_failed += !FinishDataset(inputs, &running, &results);
+  }
+
+  const double time = WallTimeInSeconds() - start_time;
+  const int num_solved = inputs.size() - num_failed;
+  LOG(INFO) << "Solved " << num_solved << " datasets in " << time
+            << " seconds, " << num_solved * 3600.0 / time
+            << " datasets per hour.";
+
+  std::ofstream of(FLAGS_batch_summary.c_str());
+  CHECK(of.good()) << "Unable to open file: " << FLAGS_batch_summary;
+  of << "input,status,num_threads,num_poses,num_points,num_observations,"
+     << "linear_solver_used,num_iterations,initial_cost,final_cost,"
+     << "initial_rms,final_rms,termination_type,time\n";
+  for (int i = 0; i < inputs.size(); ++i) {
+    const BatchResult& result = results[i];
+    if (!result.is_solved) {
+      // The other twelve columns are left empty.
+      of << inputs[i] << ",failed" << std::string(12, ',') << "\n";
+      continue;
+    }
+    of << inputs[i] << ","
+       << "solved,"
+       << result.num_threads << ","
+       << result.num_poses << ","
+       << result.num_points << ","
+       << result.num_observations << ","
+       << ceres::LinearSolverTypeToString(result.linear_solver_type) << ","
+       << result.num_iterations << ","
+       << result.initial_cost << ","
+       << result.final_cost << ","
+       << result.initial_rms << ","
+       << result.final_rms << ","
+       << ceres::TerminationTypeToString(result.termination_type) << ","
+       << result.time << "\n";
+  }
+  CHECK(of.good()) << "Error writing to file: " << FLAGS_batch_summary;
+  return num_failed;
+}
 
 int main(int argc, char** argv) {
   // Initialize gflags and glog.
   google::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
+  const double program_start_time = WallTimeInSeconds();
+
+  if (!FLAGS_input_list.empty()) {
+    CHECK(!FLAGS_batch_summary.empty())
+        << "--input_list requires --batch_summary.";
+    CHECK(FLAGS_submap_size <= 0 && FLAGS_incremental_batch_size <= 0 &&
+          !FLAGS_pose_graph && FLAGS_keyframe_interval <= 0 &&
+          FLAGS_checkpoint.empty() && FLAGS_resume_from.empty() &&
+          FLAGS_time_budget_s <= 0.0 && FLAGS_initial_ply.empty() &&
+          FLAGS_final_ply.empty() && FLAGS_trace_json.empty() &&
+          FLAGS_reprojection_report.empty())
+        << "--input_list is not supported with --submap_size, "
+        << "--incremental_batch_size, --pose_graph, --keyframe_interval, "
+        << "--checkpoint, --resume_from, --time_budget_s, --initial_ply, "
+        << "--final_ply, --trace_json or --reprojection_report.";
+    return BundleAdjustBatch() == 0 ? 0 : 1;
+  }
 
  if (FLAGS_input.empty()) {
    LOG(ERROR) << "Usage: bundle_adjuster --input=baf_file";
@@ -112,64 +722,211 @@ int main(int argc, char** argv) {
   }
 
   // Read in the OpenMVG BAF file.
-  BAFile ba_file(FLAGS_input);
-  srand(FLAGS_random_seed);
+  BAFile::Options ba_file_options;
+  ba_file_options.num_threads = FLAGS_num_threads;
+  ba_file_options.single_precision_observations =
+      FLAGS_single_precision_observations;
+  ba_file_options.merge_intrinsics_tolerance =
+      FLAGS_merge_intrinsics_tolerance;
+  BAFile ba_file(FLAGS_input, ba_file_options);
+  if (FLAGS_camera_model != "radial_k3") {
+    SetCameraModels(&ba_file);
+  }
   ba_file.Normalize();
   ba_file.Perturb(FLAGS_rotation_sigma,
                   FLAGS_position_sigma,
-                  FLAGS_point_sigma);
+                  FLAGS_point_sigma,
+                  FLAGS_random_seed);
+
+  // The checkpoint is in the order of the BAF file, so it is read
+  // before any reordering.
+  openMVG::CheckpointHeader checkpoint;
+  if (!FLAGS_resume_from.empty()) {
+    openMVG::ReadCheckpoint(FLAGS_resume_from, &ba_file, &checkpoint);
+    LOG(INFO) << "Resuming from the checkpoint of iteration "
+              << checkpoint.num_iterations << ".";
+  }
 
   if (!FLAGS_initial_ply.empty()) {
-    ba_file.WriteToPLYFile(FLAGS_initial_ply);
-  }
-
-  // Construct the ceres Problem, adding one residual block for each
-  // observation.
-  ceres::Problem problem;
-  for (int point_id = 0; point_id < ba_file.num_points(); ++point_id) {
-    // BAF files store all observations for a 3d point/landmark
-    // together.
-    const std::vector<Observation>& observations =
-        ba_file.ObservationsForPoint(point_id);
-    double* point = ba_file.GetPoint(point_id);
-    for (int i = 0; i < observations.size(); ++i) {
-      const Observation& obs = observations[i];
-      // Add a residual block per observation, with the intrinsics and
-      // pose for the camera obtained from the BAFile object.
-      //
-      // Notice that we are not doing anything special to deal with
-      // the fact that intrinsics may or may not be shared across
-      // cameras.
-      //
-      // Ceres will automatically account for it by looking at the
-      // parameter blocks passed to it.
-      problem.AddResidualBlock(ReprojectionError::Create(obs.x, obs.y),
-                               NULL,
-                               ba_file.GetIntrinsics(obs.intrinsics_id),
-                               ba_file.GetPose(obs.pose_id),
-                               point);
-    }
+    WriteToPLYFile(ba_file, FLAGS_initial_ply);
   }
 
+  ReorderBAFile(&ba_file);
+
   ceres::Solver::Options options;
+  options.minimizer_progress_to_stdout = true;
+  options.check_gradients = FLAGS_check_gradients;
 
-  // DENSE_SCHUR constructs the Schur complement and solves the
-  // reduced linear system using a dense Cholesky factorization. For
-  // small to medium sized problem this is a perfectly suitable
-  // solver.
+  // DENSE_SCHUR constructs the Schur complement and solves the reduced
+  // linear system using a dense Cholesky factorization. For small to
+  // medium sized problem this is a perfectly suitable solver.
   //
   // For larger problem one can use SPARSE_SCHUR, or if the problem is
   // so large that factoring the Schur complement is not an option,
-  // then ITERATIVE_SCHUR can be used with a suitable preconditioner.
-  options.linear_solver_type = ceres::DENSE_SCHUR;
-  options.minimizer_progress_to_stdout = true;
+  // then ITERATIVE_SCHUR can be used with a suitable preconditioner. By
+  // default the planner chooses between them.
+  openMVG::SetLinearSolver(
+      ba_file,
+      FLAGS_local_window_size,
+      FLAGS_linear_solver,
+      static_cast<int64_t>(FLAGS_linear_solver_memory_budget_mb) << 20,
+      FLAGS_num_threads,
+      &options);
+
+  int num_previous_iterations = 0;
+  if (!FLAGS_resume_from.empty()) {
+    num_previous_iterations = checkpoint.num_iterations;
+    options.max_num_iterations =
+        std::max(0, options.max_num_iterations - num_previous_iterations);
+    options.initial_trust_region_radius = checkpoint.trust_region_radius;
+  }
+
+  openMVG::CheckpointWriter* checkpoint_writer = NULL;
+  if (!FLAGS_checkpoint.empty()) {
+    CHECK(FLAGS_submap_size <= 0 && FLAGS_incremental_batch_size <= 0 &&
+          !FLAGS_pose_graph && FLAGS_keyframe_interval <= 0)
+        << "--checkpoint is not supported with --submap_size, "
+        << "--incremental_batch_size, --pose_graph or --keyframe_interval.";
+    // The checkpoints are written from the parameters in ba_file.
+    options.update_state_every_iteration = true;
+    checkpoint_writer =
+        new openMVG::CheckpointWriter(FLAGS_checkpoint,
+                                      FLAGS_checkpoint_every_iterations,
+                                      FLAGS_checkpoint_every_seconds,
+                                      num_previous_iterations,
+                                      &ba_file);
+    options.callbacks.push_back(checkpoint_writer);
+  }
+
+  openMVG::IterationTrace* trace = NULL;
+  if (!FLAGS_trace_json.empty()) {
+    trace = new openMVG::IterationTrace(FLAGS_trace_json);
+    options.callbacks.push_back(trace);
+  }
+
+  // The budget starts with the program, and stops the solver when the
+  // next iteration is not expected to finish in time.
+  openMVG::TimeBudget* time_budget = NULL;
+  if (FLAGS_time_budget_s > 0.0) {
+    CHECK(FLAGS_submap_size <= 0 && FLAGS_incremental_batch_size <= 0 &&
+          !FLAGS_pose_graph && FLAGS_keyframe_interval <= 0)
+        << "--time_budget_s is not supported with --submap_size, "
+        << "--incremental_batch_size, --pose_graph or --keyframe_interval.";
+    const bool has_cheaper_linear_solver =
+        options.linear_solver_type != ceres::ITERATIVE_SCHUR;
+    time_budget = new openMVG::TimeBudget(
+        program_start_time + FLAGS_time_budget_s,
+        has_cheaper_linear_solver ? FLAGS_time_budget_min_iterations : 0);
+    options.callbacks.push_back(time_budget);
+  }
 
   ceres::Solver::Summary summary;
-  ceres::Solve(options, &problem, &summary);
+  ReportReprojectionError(ba_file, "Initial", "");
+  CHECK_LE((FLAGS_submap_size > 0) + (FLAGS_local_window_size > 0) +
+           (FLAGS_incremental_batch_size > 0) + FLAGS_pose_graph +
+           (FLAGS_keyframe_interval > 0), 1)
+      << "--submap_size, --local_window_size, --incremental_batch_size, "
+      << "--pose_graph and --keyframe_interval are mutually exclusive.";
+  if (FLAGS_incremental_batch_size > 0) {
+    CHECK_EQ(FLAGS_cost_function, "autodiff")
+        << "--incremental_batch_size requires --cost_function=autodiff.";
+    SolveIncrementally(options, FLAGS_incremental_batch_size, &ba_file,
+                       &summary);
+  } else if (FLAGS_submap_size > 0) {
+    openMVG::SubmapOptions submap_options;
+    submap_options.max_num_poses = FLAGS_submap_size;
+    submap_options.num_overlapping_poses = FLAGS_submap_overlap;
+    submap_options.num_processes = FLAGS_num_submap_processes;
+    submap_options.solver_options = options;
+    submap_options.create_reprojection_error = CreateReprojectionError;
+    openMVG::SolveInSubmaps(submap_options, &ba_file, &summary);
+  } else if (FLAGS_pose_graph) {
+    openMVG::PoseGraphOptions pose_graph_options;
+    pose_graph_options.max_edges_per_pose =
+        FLAGS_pose_graph_max_edges_per_pose;
+    pose_graph_options.min_shared_points = FLAGS_pose_graph_min_shared_points;
+    pose_graph_options.solver_options = options;
+    pose_graph_options.create_reprojection_error = CreateReprojectionError;
+    openMVG::SolveWithPoseGraph(pose_graph_options, &ba_file, &summary);
+  } else if (FLAGS_keyframe_interval > 0) {
+    openMVG::KeyframeOptions keyframe_options;
+    keyframe_options.keyframe_interval = FLAGS_keyframe_interval;
+    keyframe_options.final_num_iterations = FLAGS_keyframe_final_iterations;
+    keyframe_options.solver_options = options;
+    keyframe_options.create_reprojection_error = CreateReprojectionError;
+    openMVG::SolveWithKeyframes(keyframe_options, &ba_file, &summary);
+  } else {
+    // With millions of observations allocating every cost function
+    // separately dominates the time it takes to build and destroy the
+    // problem, so by default they are constructed in an arena which
+    // the problem does not own. The arena is declared first so that
+    // it outlives the problem.
+    CostFunctionArena arena;
+    ceres::Problem::Options problem_options;
+    if (FLAGS_pool_cost_functions) {
+      problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    }
+    ceres::Problem problem(problem_options);
+    openMVG::BuildProblem(CreateReprojectionError,
+                          FLAGS_local_window_size,
+                          FLAGS_pool_cost_functions ? &arena : NULL,
+                          &ba_file,
+                          &problem);
+    if (time_budget != NULL) {
+      options.max_solver_time_in_seconds = time_budget->RemainingSeconds();
+    }
+    ceres::Solve(options, &problem, &summary);
+
+    // Trade the quality of the steps for more of them by continuing
+    // with a linear solver whose iterations are cheaper.
+    if (time_budget != NULL && time_budget->is_too_slow()) {
+      LOG(INFO) << "Continuing with iterative_schur instead of "
+                << ceres::LinearSolverTypeToString(options.linear_solver_type)
+                << " for the rest of the time budget.";
+      const double initial_cost = summary.initial_cost;
+      options.linear_solver_type = ceres::ITERATIVE_SCHUR;
+      options.preconditioner_type = ceres::SCHUR_JACOBI;
+      options.max_num_iterations = std::max(
+          0,
+          options.max_num_iterations -
+              (summary.num_successful_steps + summary.num_unsuccessful_steps));
+      time_budget->DisableFallback();
+      options.max_solver_time_in_seconds = time_budget->RemainingSeconds();
+      // The second solve numbers its iterations and times them from 0
+      // again, so the callbacks continue from where the first left.
+      if (checkpoint_writer != NULL) {
+        checkpoint_writer->ContinueAfter(summary);
+      }
+      if (trace != NULL) {
+        trace->ContinueAfter(summary);
+      }
+      ceres::Solve(options, &problem, &summary);
+      // Report the reduction over both solves.
+      summary.initial_cost = initial_cost;
+    }
+  }
+  if (trace != NULL) {
+    trace->WriteSummary(summary);
+    delete trace;
+  }
+  delete checkpoint_writer;
   std::cout << summary.FullReport() << "\n";
+  if (time_budget != NULL) {
+    std::cout << "Time budget: the cost went from " << summary.initial_cost
+              << " to " << summary.final_cost << ", a reduction of "
+              << 100.0 * (1.0 - summary.final_cost / summary.initial_cost)
+              << "%, in " << WallTimeInSeconds() - program_start_time
+              << " of " << FLAGS_time_budget_s << " seconds"
+              << (time_budget->is_out_of_time()
+                      ? ", stopped by the deadline.\n"
+                      : ".\n");
+    delete time_budget;
+  }
 
+  ba_file.RestoreOriginalOrder();
+  ReportReprojectionError(ba_file, "Final", FLAGS_reprojection_report);
   if (!FLAGS_final_ply.empty()) {
-    ba_file.WriteToPLYFile(FLAGS_final_ply);
+    WriteToPLYFile(ba_file, FLAGS_final_ply);
   }
 
   return 0;
@@ -0,0 +1,345 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// ======================================
+// Benchmark bundle adjustment with Ceres
+// ======================================
+//
+// Usage: bundle_adjuster_benchmark --inputs=<baf_file>[,<baf_file>...]
+//                                  --output=<csv_file>
+//                                  [--perturbations=0:0:0,...]
+//                                  [--linear_solvers=auto,...]
+//                                  [--num_threads=1,...]
+//
+// Runs the stages of bundle_adjuster, i.e., loading the BAF file,
+// normalizing and perturbing it, building the problem and solving it,
+// for every combination of input, perturbation, linear solver and
+// number of threads, and writes the wall time of each stage, the
+// number of iterations, the final cost and the peak resident memory of
+// every run to a CSV file, e.g., to compare releases of Ceres on
+//
+//   Data/Castle/sfm_data.baf
+//
+// and on synthetic problems written as BAF files.
+//
+// Every run is made in a child process of its own, so that the peak
+// resident memory reported by wait4 is that of the run alone and runs
+// do not share caches or allocator state.
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ba_file.h"
+#include "bundle_adjustment.h"
+#include "ceres/ceres.h"
+#include "cost_function_arena.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "linear_solver_planner.h"
+#include "wall_time.h"
+
+DEFINE_string(inputs, "", "Comma separated list of BAF files, text or "
+              "binary.");
+DEFINE_string(output, "", "CSV file the results are written to.");
+DEFINE_string(perturbations, "0:0:0", "Comma separated list of "
+              "rotation_sigma:position_sigma:point_sigma triples, the "
+              "standard deviations of the perturbations applied to the "
+              "reconstruction before solving.");
+DEFINE_string(linear_solvers, "auto", "Comma separated list of linear "
+              "solvers, either auto, to let the planner choose, or the "
+              "names of Ceres linear solvers, e.g., dense_schur.");
+DEFINE_string(num_threads, "1", "Comma separated list of thread counts.");
+DEFINE_int32(num_repetitions, 1, "Number of times each combination is "
+             "run.");
+DEFINE_int32(max_num_iterations, 50, "Maximum number of iterations of the "
+             "solver.");
+DEFINE_int32(linear_solver_memory_budget_mb, 4096, "Memory available to the "
+             "linear solver chosen by --linear_solvers=auto.");
+DEFINE_int32(random_seed, 38401, "Random seed of the perturbations.");
+
+using openMVG::BAFile;
+using openMVG::CostFunctionArena;
+using openMVG::WallTimeInSeconds;
+
+namespace {
+
+struct Perturbation {
+  double rotation_sigma;
+  double position_sigma;
+  double point_sigma;
+};
+
+struct BenchmarkCase {
+  std::string input;
+  Perturbation perturbation;
+  std::string linear_solver;
+  int num_threads;
+  int repetition;
+};
+
+// Sent from the child process running a case to the parent, which
+// adds the peak resident memory of the child.
+struct BenchmarkResult {
+  int num_poses;
+  int num_points;
+  int num_observations;
+  double load_time;
+  double normalize_time;
+  double perturb_time;
+  double build_time;
+  double solve_time;
+  int num_iterations;
+  double initial_cost;
+  double final_cost;
+  ceres::LinearSolverType linear_solver_type;
+  ceres::TerminationType termination_type;
+};
+
+std::vector<std::string> SplitString(const std::string& value,
+                                     const char delimiter) {
+  std::vector<std::string> pieces;
+  std::istringstream is(value);
+  std::string piece;
+  while (std::getline(is, piece, delimiter)) {
+    if (!piece.empty()) {
+      pieces.push_back(piece);
+    }
+  }
+  return pieces;
+}
+
+Perturbation ParsePerturbation(const std::string& value) {
+  const std::vector<std::string> sigmas = SplitString(value, ':');
+  CHECK_EQ(sigmas.size(), 3)
+      << "Expected rotation_sigma:position_sigma:point_sigma, got: "
+      << value;
+  Perturbation perturbation;
+  perturbation.rotation_sigma = strtod(sigmas[0].c_str(), NULL);
+  perturbation.position_sigma = strtod(sigmas[1].c_str(), NULL);
+  perturbation.point_sigma = strtod(sigmas[2].c_str(), NULL);
+  return perturbation;
+}
+
+void RunBenchmarkCase(const BenchmarkCase& benchmark_case,
+                      BenchmarkResult* result) {
+  double start_time = WallTimeInSeconds();
+  BAFile::Options ba_file_options;
+  ba_file_options.num_threads = benchmark_case.num_threads;
+  BAFile ba_file(benchmark_case.input, ba_file_options);
+  result->load_time = WallTimeInSeconds() - start_time;
+  result->num_poses = ba_file.num_poses();
+  result->num_points = ba_file.num_points();
+  result->num_observations = ba_file.num_observations();
+
+  start_time = WallTimeInSeconds();
+  ba_file.Normalize();
+  result->normalize_time = WallTimeInSeconds() - start_time;
+
+  start_time = WallTimeInSeconds();
+  ba_file.Perturb(benchmark_case.perturbation.rotation_sigma,
+                  benchmark_case.perturbation.position_sigma,
+                  benchmark_case.perturbation.point_sigma,
+                  FLAGS_random_seed);
+  result->perturb_time = WallTimeInSeconds() - start_time;
+
+  // The same problem and linear solver as bundle_adjuster uses with its
+  // default flags.
+  start_time = WallTimeInSeconds();
+  CostFunctionArena arena;
+  ceres::Problem::Options problem_options;
+  problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  ceres::Problem problem(problem_options);
+  openMVG::BuildProblem(openMVG::CreateAutoDiffReprojectionError,
+                        0,
+                        &arena,
+                        &ba_file,
+                        &problem);
+  result->build_time = WallTimeInSeconds() - start_time;
+
+  ceres::Solver::Options options;
+  options.max_num_iterations = FLAGS_max_num_iterations;
+  options.logging_type = ceres::SILENT;
+  openMVG::SetLinearSolver(
+      ba_file,
+      0,
+      benchmark_case.linear_solver,
+      static_cast<int64_t>(FLAGS_linear_solver_memory_budget_mb) << 20,
+      benchmark_case.num_threads,
+      &options);
+
+  start_time = WallTimeInSeconds();
+  ceres::Solver::Summary summary;
+  ceres::Solve(options, &problem, &summary);
+  result->solve_time = WallTimeInSeconds() - start_time;
+  // Iteration 0 is the evaluation at the initial parameters, so it is
+  // not counted, the same as in the --batch_summary of bundle_adjuster.
+  result->num_iterations =
+      summary.num_successful_steps + summary.num_unsuccessful_steps;
+  result->initial_cost = summary.initial_cost;
+  result->final_cost = summary.final_cost;
+  result->linear_solver_type = summary.linear_solver_type_used;
+  result->termination_type = summary.termination_type;
+}
+
+// Run benchmark_case in a child process. Returns false if the child
+// did not complete, e.g., because a CHECK failed.
+bool RunBenchmarkCaseInChild(const BenchmarkCase& benchmark_case,
+                             BenchmarkResult* result,
+                             int64_t* peak_memory_bytes) {
+  int fds[2];
+  CHECK_EQ(pipe(fds), 0) << "pipe failed: " << strerror(errno);
+  const pid_t pid = fork();
+  CHECK_GE(pid, 0) << "fork failed: " << strerror(errno);
+  if (pid == 0) {
+    close(fds[0]);
+    BenchmarkResult child_result;
+    RunBenchmarkCase(benchmark_case, &child_result);
+    const ssize_t num_written =
+        write(fds[1], &child_result, sizeof(child_result));
+    _exit(num_written == sizeof(child_result) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  const ssize_t num_read = read(fds[0], result, sizeof(*result));
+  close(fds[0]);
+
+  int status = 0;
+  rusage usage;
+  CHECK_EQ(wait4(pid, &status, 0, &usage), pid)
+      << "wait4 failed: " << strerror(errno);
+  // ru_maxrss is in kilobytes on Linux.
+  *peak_memory_bytes = static_cast<int64_t>(usage.ru_maxrss) * 1024;
+  return num_read == sizeof(*result) &&
+      WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  if (FLAGS_inputs.empty() || FLAGS_output.empty()) {
+    LOG(ERROR) << "Usage: bundle_adjuster_benchmark "
+               << "--inputs=baf_file[,baf_file...] --output=csv_file";
+    return 1;
+  }
+
+  const std::vector<std::string> inputs = SplitString(FLAGS_inputs, ',');
+  const std::vector<std::string> perturbations =
+      SplitString(FLAGS_perturbations, ',');
+  const std::vector<std::string> linear_solvers =
+      SplitString(FLAGS_linear_solvers, ',');
+  const std::vector<std::string> num_threads =
+      SplitString(FLAGS_num_threads, ',');
+
+  std::vector<BenchmarkCase> benchmark_cases;
+  for (int i = 0; i < inputs.size(); ++i) {
+    for (int j = 0; j < perturbations.size(); ++j) {
+      for (int k = 0; k < linear_solvers.size(); ++k) {
+        for (int l = 0; l < num_threads.size(); ++l) {
+          for (int r = 0; r < FLAGS_num_repetitions; ++r) {
+            BenchmarkCase benchmark_case;
+            benchmark_case.input = inputs[i];
+            benchmark_case.perturbation = ParsePerturbation(perturbations[j]);
+            benchmark_case.linear_solver = linear_solvers[k];
+            benchmark_case.num_threads = atoi(num_threads[l].c_str());
+            CHECK_GT(benchmark_case.num_threads, 0)
+                << "Invalid number of threads: " << num_threads[l];
+            benchmark_case.repetition = r;
+            benchmark_cases.push_back(benchmark_case);
+          }
+        }
+      }
+    }
+  }
+
+  std::ofstream of(FLAGS_output.c_str());
+  CHECK(of.good()) << "Unable to open file: " << FLAGS_output;
+  of << "input,rotation_sigma,position_sigma,point_sigma,linear_solver,"
+     << "linear_solver_used,num_threads,repetition,num_poses,num_points,"
+     << "num_observations,load_time,normalize_time,perturb_time,"
+     << "build_time,solve_time,total_time,num_iterations,initial_cost,"
+     << "final_cost,termination_type,peak_memory_mb\n";
+
+  int num_failed = 0;
+  for (int i = 0; i < benchmark_cases.size(); ++i) {
+    const BenchmarkCase& benchmark_case = benchmark_cases[i];
+    LOG(INFO) << "Case " << i + 1 << " of " << benchmark_cases.size() << ": "
+              << benchmark_case.input << " "
+              << benchmark_case.linear_solver << " "
+              << benchmark_case.num_threads << " threads.";
+    BenchmarkResult result;
+    int64_t peak_memory_bytes = 0;
+    if (!RunBenchmarkCaseInChild(benchmark_case,
+                                 &result,
+                                 &peak_memory_bytes)) {
+      LOG(ERROR) << "Case " << i + 1 << " failed.";
+      ++num_failed;
+      continue;
+    }
+
+    const double total_time = result.load_time + result.normalize_time +
+        result.perturb_time + result.build_time + result.solve_time;
+    of << benchmark_case.input << ","
+       << benchmark_case.perturbation.rotation_sigma << ","
+       << benchmark_case.perturbation.position_sigma << ","
+       << benchmark_case.perturbation.point_sigma << ","
+       << benchmark_case.linear_solver << ","
+       << ceres::LinearSolverTypeToString(result.linear_solver_type) << ","
+       << benchmark_case.num_threads << ","
+       << benchmark_case.repetition << ","
+       << result.num_poses << ","
+       << result.num_points << ","
+       << result.num_observations << ","
+       << result.load_time << ","
+       << result.normalize_time << ","
+       << result.perturb_time << ","
+       << result.build_time << ","
+       << result.solve_time << ","
+       << total_time << ","
+       << result.num_iterations << ","
+       << result.initial_cost << ","
+       << result.final_cost << ","
+       << ceres::TerminationTypeToString(result.termination_type) << ","
+       << peak_memory_bytes / (1024.0 * 1024.0) << "\n";
+    of.flush();
+  }
+  CHECK(of.good()) << "Error writing to file: " << FLAGS_output;
+
+  return num_failed == 0 ? 0 : 1;
+}
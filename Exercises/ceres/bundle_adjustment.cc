@@ -0,0 +1,209 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "bundle_adjustment.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "ba_file.h"
+#include "camera_models.h"
+#include "ceres/ceres.h"
+#include "cost_function_arena.h"
+#include "glog/logging.h"
+#include "memory_usage.h"
+#include "wall_time.h"
+
+namespace openMVG {
+namespace {
+
+// Local bundle adjustment of the window_size newest poses and the
+// points they observe. All the observations of those points are added,
+// and the other poses observing them and the intrinsics are held
+// constant. The points are found using the index of the observations
+// by pose, so apart from building that index the problem only grows
+// with the window, not with the reconstruction.
+void AddLocalWindowResidualBlocks(
+    ReprojectionErrorFactory create_reprojection_error,
+    const int window_size,
+    CostFunctionArena* arena,
+    BAFile* ba_file,
+    ceres::Problem* problem) {
+  const int num_poses = ba_file->num_poses();
+  std::vector<bool> is_window_pose;
+  ComputeLocalWindowPoses(*ba_file, window_size, &is_window_pose);
+
+  ba_file->IndexObservationsByPose();
+  std::vector<int> point_ids;
+  for (int pose_id = 0; pose_id < num_poses; ++pose_id) {
+    if (is_window_pose[pose_id]) {
+      const int* pose_point_ids = ba_file->PointIdsForPose(pose_id);
+      const int num_observations = ba_file->NumObservationsForPose(pose_id);
+      point_ids.insert(point_ids.end(),
+                       pose_point_ids,
+                       pose_point_ids + num_observations);
+    }
+  }
+  std::sort(point_ids.begin(), point_ids.end());
+  point_ids.erase(std::unique(point_ids.begin(), point_ids.end()),
+                  point_ids.end());
+
+  for (int i = 0; i < point_ids.size(); ++i) {
+    AddResidualBlocksForPoint(create_reprojection_error,
+                              point_ids[i],
+                              arena,
+                              ba_file,
+                              problem);
+  }
+
+  int num_constant_poses = 0;
+  for (int pose_id = 0; pose_id < num_poses; ++pose_id) {
+    double* pose = ba_file->GetPose(pose_id);
+    if (!is_window_pose[pose_id] && problem->HasParameterBlock(pose)) {
+      problem->SetParameterBlockConstant(pose);
+      ++num_constant_poses;
+    }
+  }
+  for (int i = 0; i < ba_file->num_intrinsics(); ++i) {
+    double* intrinsics = ba_file->GetIntrinsics(i);
+    if (problem->HasParameterBlock(intrinsics)) {
+      problem->SetParameterBlockConstant(intrinsics);
+    }
+  }
+
+  LOG(INFO) << "Local window of " << std::min(window_size, num_poses)
+            << " poses observing " << point_ids.size() << " points, with "
+            << num_constant_poses << " constant poses.";
+}
+
+}  // namespace
+
+ceres::CostFunction* CreateAutoDiffReprojectionError(
+    const BAFile& ba_file,
+    const Observation& observation,
+    CostFunctionArena* arena) {
+  return CreateCameraReprojectionError(
+      ba_file.camera_model(observation.intrinsics_id),
+      observation.x,
+      observation.y,
+      arena);
+}
+
+void AddResidualBlocksForPoint(ReprojectionErrorFactory
+                                   create_reprojection_error,
+                               const int point_id,
+                               CostFunctionArena* arena,
+                               BAFile* ba_file,
+                               ceres::Problem* problem) {
+  // BAF files store all observations for a 3d point/landmark
+  // together.
+  const ObservationSpan observations =
+      ba_file->ObservationsForPoint(point_id);
+  double* point = ba_file->GetPoint(point_id);
+  for (int i = 0; i < observations.size(); ++i) {
+    const Observation obs = observations[i];
+    // Add a residual block per observation, with the intrinsics and
+    // pose for the camera obtained from the BAFile object.
+    //
+    // Notice that we are not doing anything special to deal with
+    // the fact that intrinsics may or may not be shared across
+    // cameras.
+    //
+    // Ceres will automatically account for it by looking at the
+    // parameter blocks passed to it.
+    problem->AddResidualBlock(
+        create_reprojection_error(*ba_file, obs, arena),
+        NULL,
+        ba_file->GetIntrinsics(obs.intrinsics_id),
+        ba_file->GetPose(obs.pose_id),
+        point);
+  }
+}
+
+void ComputeLocalWindowPoses(const BAFile& ba_file,
+                             const int window_size,
+                             std::vector<bool>* is_window_pose) {
+  const int num_poses = ba_file.num_poses();
+  is_window_pose->resize(num_poses);
+  for (int pose_id = 0; pose_id < num_poses; ++pose_id) {
+    (*is_window_pose)[pose_id] =
+        ba_file.OriginalPoseId(pose_id) >= num_poses - window_size;
+  }
+}
+
+void BuildProblem(ReprojectionErrorFactory create_reprojection_error,
+                  const int window_size,
+                  CostFunctionArena* arena,
+                  BAFile* ba_file,
+                  ceres::Problem* problem) {
+  const double start_time = WallTimeInSeconds();
+  const int64_t start_memory = ResidentMemoryInBytes();
+  if (window_size > 0) {
+    AddLocalWindowResidualBlocks(create_reprojection_error,
+                                 window_size,
+                                 arena,
+                                 ba_file,
+                                 problem);
+  } else {
+    for (int point_id = 0; point_id < ba_file->num_points(); ++point_id) {
+      AddResidualBlocksForPoint(create_reprojection_error,
+                                point_id,
+                                arena,
+                                ba_file,
+                                problem);
+    }
+  }
+
+  // Reported separately from the solver time, which does not include
+  // it.
+  LOG(INFO) << "Building the problem took "
+            << WallTimeInSeconds() - start_time << " seconds.";
+  if (start_memory >= 0) {
+    LOG(INFO) << "Building the problem used "
+              << (ResidentMemoryInBytes() - start_memory) /
+                 (1024.0 * 1024.0)
+              << " MB, of which the cost function arena is "
+              << (arena != NULL ? arena->bytes_allocated() : 0) /
+                 (1024.0 * 1024.0)
+              << " MB.";
+  }
+}
+
+void SolveDecoupled(const ceres::Solver::Options& options,
+                    ceres::Problem* problem,
+                    ceres::Solver::Summary* summary) {
+  ceres::Solver::Options solver_options = options;
+  solver_options.linear_solver_type = ceres::CGNR;
+  solver_options.preconditioner_type = ceres::JACOBI;
+  solver_options.linear_solver_ordering.reset();
+  solver_options.minimizer_progress_to_stdout = false;
+  solver_options.logging_type = ceres::SILENT;
+  solver_options.callbacks.clear();
+  ceres::Solve(solver_options, problem, summary);
+}
+
+}  // namespace openMVG
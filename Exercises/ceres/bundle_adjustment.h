@@ -0,0 +1,95 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_BUNDLE_ADJUSTMENT_H_
+#define EXERCISES_CERES_BUNDLE_ADJUSTMENT_H_
+
+#include <vector>
+
+#include "ceres/ceres.h"
+
+namespace openMVG {
+
+class BAFile;
+class CostFunctionArena;
+struct Observation;
+
+// Creates the cost function of an observation, in arena if it is not
+// NULL.
+typedef ceres::CostFunction* (*ReprojectionErrorFactory)(
+    const BAFile& ba_file,
+    const Observation& observation,
+    CostFunctionArena* arena);
+
+// The automatically differentiated reprojection error of the camera
+// model of the intrinsics of observation.
+ceres::CostFunction* CreateAutoDiffReprojectionError(
+    const BAFile& ba_file,
+    const Observation& observation,
+    CostFunctionArena* arena);
+
+// Add a residual block for each observation of a point, created by
+// create_reprojection_error with the cost functions in arena if it is
+// not NULL.
+void AddResidualBlocksForPoint(ReprojectionErrorFactory
+                                   create_reprojection_error,
+                               int point_id,
+                               CostFunctionArena* arena,
+                               BAFile* ba_file,
+                               ceres::Problem* problem);
+
+// Set is_window_pose[pose_id] to true for the poses in the local
+// window of the window_size newest poses of ba_file, i.e., those with
+// the largest original ids, and to false for the others.
+void ComputeLocalWindowPoses(const BAFile& ba_file,
+                             int window_size,
+                             std::vector<bool>* is_window_pose);
+
+// Construct the bundle adjustment problem of ba_file, adding one
+// residual block for each observation, or if window_size is positive
+// for the observations of the points in the local window of the
+// window_size newest poses, see ComputeLocalWindowPoses. The other
+// poses observing those points and the intrinsics are then held
+// constant. The time and memory it takes are logged.
+void BuildProblem(ReprojectionErrorFactory create_reprojection_error,
+                  int window_size,
+                  CostFunctionArena* arena,
+                  BAFile* ba_file,
+                  ceres::Problem* problem);
+
+// Solve a problem whose variables are all independent of each other,
+// e.g., only poses with the points constant or only points with the
+// poses constant. Its normal equations are block diagonal, so the
+// Jacobi preconditioner of CGNR is exact, and it replaces the linear
+// solver and ordering of options. The problem is solved silently and
+// without the callbacks of options.
+void SolveDecoupled(const ceres::Solver::Options& options,
+                    ceres::Problem* problem,
+                    ceres::Solver::Summary* summary);
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_BUNDLE_ADJUSTMENT_H_
@@ -0,0 +1,301 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// The camera models supported by the bundle adjuster.
+//
+// All models share the layout of the intrinsic parameters
+//
+//   [focal, principal point x, principal point y, k1, k2, k3, t1, t2]
+//
+// and each of them uses a prefix of it as its parameter block, so the
+// parameters of a camera can be stored in a slot of
+// kMaxNumIntrinsicParameters doubles whatever its model. RADIAL_K3 is
+// the openMVG Pinhole_Intrinsic_Radial_K3 model used by BAF files,
+// and the others are obtained from it by dropping or adding
+// distortion terms.
+//
+// The distortion of each model is a template parameter of
+// CameraReprojectionError, so the residual of a camera only evaluates
+// the terms of its own model.
+
+#ifndef EXERCISES_CERES_CAMERA_MODELS_H_
+#define EXERCISES_CERES_CAMERA_MODELS_H_
+
+#include <string>
+
+#include "ceres/ceres.h"
+#include "ceres/rotation.h"
+#include "cost_function_arena.h"
+#include "glog/logging.h"
+
+namespace openMVG {
+
+enum CameraModelType {
+  // No distortion: [focal, principal point].
+  PINHOLE,
+
+  // Radial distortion 1 + k1 r^2.
+  RADIAL_K1,
+
+  // Radial distortion 1 + k1 r^2 + k2 r^4 + k3 r^6.
+  RADIAL_K3,
+
+  // RADIAL_K3 plus the tangential distortion terms t1, t2 of the
+  // Brown-Conrady model.
+  BROWN_T2
+};
+
+enum {
+  OFFSET_FOCAL_LENGTH = 0,
+  OFFSET_PRINCIPAL_POINT_X = 1,
+  OFFSET_PRINCIPAL_POINT_Y = 2,
+  OFFSET_DISTO_K1 = 3,
+  OFFSET_DISTO_K2 = 4,
+  OFFSET_DISTO_K3 = 5,
+  OFFSET_DISTO_T1 = 6,
+  OFFSET_DISTO_T2 = 7
+};
+
+const int kMaxNumIntrinsicParameters = 8;
+
+struct PinholeCamera {
+  enum { kNumParameters = 3 };
+
+  template <typename T>
+  static void Distort(const T* intrinsics, const T& x_u, const T& y_u,
+                      T* x_d, T* y_d) {
+    *x_d = x_u;
+    *y_d = y_u;
+  }
+};
+
+struct RadialK1Camera {
+  enum { kNumParameters = 4 };
+
+  template <typename T>
+  static void Distort(const T* intrinsics, const T& x_u, const T& y_u,
+                      T* x_d, T* y_d) {
+    const T& k1 = intrinsics[OFFSET_DISTO_K1];
+    const T r2 = x_u * x_u + y_u * y_u;
+    const T r_coeff = T(1.0) + k1 * r2;
+    *x_d = x_u * r_coeff;
+    *y_d = y_u * r_coeff;
+  }
+};
+
+struct RadialK3Camera {
+  enum { kNumParameters = 6 };
+
+  template <typename T>
+  static void Distort(const T* intrinsics, const T& x_u, const T& y_u,
+                      T* x_d, T* y_d) {
+    const T& k1 = intrinsics[OFFSET_DISTO_K1];
+    const T& k2 = intrinsics[OFFSET_DISTO_K2];
+    const T& k3 = intrinsics[OFFSET_DISTO_K3];
+    const T r2 = x_u * x_u + y_u * y_u;
+    const T r4 = r2 * r2;
+    const T r6 = r4 * r2;
+    const T r_coeff = T(1.0) + k1 * r2 + k2 * r4 + k3 * r6;
+    *x_d = x_u * r_coeff;
+    *y_d = y_u * r_coeff;
+  }
+};
+
+struct BrownT2Camera {
+  enum { kNumParameters = 8 };
+
+  template <typename T>
+  static void Distort(const T* intrinsics, const T& x_u, const T& y_u,
+                      T* x_d, T* y_d) {
+    const T& k1 = intrinsics[OFFSET_DISTO_K1];
+    const T& k2 = intrinsics[OFFSET_DISTO_K2];
+    const T& k3 = intrinsics[OFFSET_DISTO_K3];
+    const T& t1 = intrinsics[OFFSET_DISTO_T1];
+    const T& t2 = intrinsics[OFFSET_DISTO_T2];
+    const T r2 = x_u * x_u + y_u * y_u;
+    const T r4 = r2 * r2;
+    const T r6 = r4 * r2;
+    const T r_coeff = T(1.0) + k1 * r2 + k2 * r4 + k3 * r6;
+    const T xy = x_u * y_u;
+    *x_d = x_u * r_coeff + T(2.0) * t1 * xy + t2 * (r2 + T(2.0) * x_u * x_u);
+    *y_d = y_u * r_coeff + t1 * (r2 + T(2.0) * y_u * y_u) + T(2.0) * t2 * xy;
+  }
+};
+
+// The reprojection error of a camera with the given model. For
+// RadialK3Camera this is the same as ReprojectionError.
+template <typename Camera>
+class CameraReprojectionError {
+ public:
+  CameraReprojectionError(const double x, const double y)
+      : x_(x), y_(y) {}
+
+  template <typename T> bool operator()(const T* const intrinsics,
+                                        const T* const pose,
+                                        const T* const point,
+                                        T* residuals) const {
+    const T* rotation = pose;
+    const T* center = pose + 3;
+
+    T translated_point[3];
+    translated_point[0] = point[0] - center[0];
+    translated_point[1] = point[1] - center[1];
+    translated_point[2] = point[2] - center[2];
+
+    T rotated_translated_point[3];
+    ceres::AngleAxisRotatePoint(rotation,
+                                translated_point,
+                                rotated_translated_point);
+
+    const T x_u = rotated_translated_point[0] / rotated_translated_point[2];
+    const T y_u = rotated_translated_point[1] / rotated_translated_point[2];
+
+    T x_d;
+    T y_d;
+    Camera::Distort(intrinsics, x_u, y_u, &x_d, &y_d);
+
+    const T& focal = intrinsics[OFFSET_FOCAL_LENGTH];
+    residuals[0] = intrinsics[OFFSET_PRINCIPAL_POINT_X] + focal * x_d - T(x_);
+    residuals[1] = intrinsics[OFFSET_PRINCIPAL_POINT_Y] + focal * y_d - T(y_);
+    return true;
+  }
+
+  static ceres::CostFunction* Create(const double x, const double y) {
+    return new ceres::AutoDiffCostFunction<CameraReprojectionError<Camera>,
+                                           2,
+                                           Camera::kNumParameters,
+                                           6,
+                                           3>(
+        new CameraReprojectionError<Camera>(x, y));
+  }
+
+  static ceres::CostFunction* Create(const double x,
+                                     const double y,
+                                     CostFunctionArena* arena) {
+    if (arena == NULL) {
+      return Create(x, y);
+    }
+    return arena->Construct<
+        InlineAutoDiffCostFunction<CameraReprojectionError<Camera>,
+                                   2,
+                                   Camera::kNumParameters,
+                                   6,
+                                   3> >(CameraReprojectionError<Camera>(x, y));
+  }
+
+ private:
+  double x_;
+  double y_;
+};
+
+inline int NumIntrinsicParameters(CameraModelType type) {
+  switch (type) {
+    case PINHOLE:
+      return PinholeCamera::kNumParameters;
+    case RADIAL_K1:
+      return RadialK1Camera::kNumParameters;
+    case RADIAL_K3:
+      return RadialK3Camera::kNumParameters;
+    case BROWN_T2:
+      return BrownT2Camera::kNumParameters;
+  }
+  LOG(FATAL) << "Unknown camera model: " << type;
+  return 0;
+}
+
+// The reprojection error of an observation made by a camera of the
+// given type. The type is only looked at here, when the problem is
+// built. If arena is not NULL the cost function is constructed in it.
+inline ceres::CostFunction* CreateCameraReprojectionError(
+    CameraModelType type,
+    const double x,
+    const double y,
+    CostFunctionArena* arena = NULL) {
+  switch (type) {
+    case PINHOLE:
+      return CameraReprojectionError<PinholeCamera>::Create(x, y, arena);
+    case RADIAL_K1:
+      return CameraReprojectionError<RadialK1Camera>::Create(x, y, arena);
+    case RADIAL_K3:
+      return CameraReprojectionError<RadialK3Camera>::Create(x, y, arena);
+    case BROWN_T2:
+      return CameraReprojectionError<BrownT2Camera>::Create(x, y, arena);
+  }
+  LOG(FATAL) << "Unknown camera model: " << type;
+  return NULL;
+}
+
+// The model with the fewest parameters which describes a camera with
+// the given parameters exactly, i.e., whose omitted distortion terms
+// are all zero.
+inline CameraModelType SimplestCameraModel(const double* intrinsics) {
+  if (intrinsics[OFFSET_DISTO_T1] != 0.0 ||
+      intrinsics[OFFSET_DISTO_T2] != 0.0) {
+    return BROWN_T2;
+  }
+  if (intrinsics[OFFSET_DISTO_K2] != 0.0 ||
+      intrinsics[OFFSET_DISTO_K3] != 0.0) {
+    return RADIAL_K3;
+  }
+  if (intrinsics[OFFSET_DISTO_K1] != 0.0) {
+    return RADIAL_K1;
+  }
+  return PINHOLE;
+}
+
+inline const char* CameraModelTypeToString(CameraModelType type) {
+  switch (type) {
+    case PINHOLE:
+      return "pinhole";
+    case RADIAL_K1:
+      return "radial_k1";
+    case RADIAL_K3:
+      return "radial_k3";
+    case BROWN_T2:
+      return "brown_t2";
+  }
+  return "unknown";
+}
+
+inline bool StringToCameraModelType(const std::string& value,
+                                    CameraModelType* type) {
+  if (value == "pinhole") {
+    *type = PINHOLE;
+  } else if (value == "radial_k1") {
+    *type = RADIAL_K1;
+  } else if (value == "radial_k3") {
+    *type = RADIAL_K3;
+  } else if (value == "brown_t2") {
+    *type = BROWN_T2;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_CAMERA_MODELS_H_
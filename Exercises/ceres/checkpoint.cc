@@ -0,0 +1,247 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "checkpoint.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ba_file.h"
+#include "ceres/ceres.h"
+#include "glog/logging.h"
+#include "mapped_file.h"
+#include "wall_time.h"
+
+namespace openMVG {
+namespace {
+
+// Size of the buffer the poses and points are gathered into.
+const size_t kBufferSize = 1 << 20;
+
+bool WriteAll(const int fd, const char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t num_written = write(fd, data, size);
+    if (num_written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += num_written;
+    size -= num_written;
+  }
+  return true;
+}
+
+// Write the parameter blocks of size block_size starting at
+// parameters + block_size * ids[i], in order, through buffer.
+bool WriteBlocks(const int fd,
+                 const double* parameters,
+                 const int block_size,
+                 const std::vector<int>& ids,
+                 std::vector<char>* buffer) {
+  const size_t block_bytes = block_size * sizeof(double);
+  const size_t num_blocks_per_buffer = buffer->size() / block_bytes;
+  for (size_t begin = 0; begin < ids.size();
+       begin += num_blocks_per_buffer) {
+    const size_t end = std::min(begin + num_blocks_per_buffer, ids.size());
+    char* cursor = &(*buffer)[0];
+    for (size_t i = begin; i < end; ++i) {
+      memcpy(cursor, parameters + block_size * ids[i], block_bytes);
+      cursor += block_bytes;
+    }
+    if (!WriteAll(fd, &(*buffer)[0], cursor - &(*buffer)[0])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+CheckpointWriter::CheckpointWriter(const std::string& filename,
+                                   const int num_iterations,
+                                   const double num_seconds,
+                                   const int num_previous_iterations,
+                                   const BAFile* ba_file)
+    : filename_(filename),
+      temporary_filename_(filename + ".tmp"),
+      num_iterations_(num_iterations),
+      num_seconds_(num_seconds),
+      num_previous_iterations_(num_previous_iterations),
+      ba_file_(ba_file),
+      pose_ids_(ba_file->num_poses()),
+      point_ids_(ba_file->num_points()),
+      buffer_(kBufferSize),
+      child_(-1),
+      last_iteration_(num_previous_iterations),
+      last_time_(WallTimeInSeconds()) {
+  for (int i = 0; i < ba_file->num_poses(); ++i) {
+    pose_ids_[ba_file->OriginalPoseId(i)] = i;
+  }
+  for (int i = 0; i < ba_file->num_points(); ++i) {
+    point_ids_[ba_file->OriginalPointId(i)] = i;
+  }
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  Reap(true);
+}
+
+ceres::CallbackReturnType CheckpointWriter::operator()(
+    const ceres::IterationSummary& summary) {
+  const int iteration = num_previous_iterations_ + summary.iteration;
+  const double time = WallTimeInSeconds();
+  const bool is_due =
+      (num_iterations_ > 0 && iteration - last_iteration_ >= num_iterations_) ||
+      (num_seconds_ > 0.0 && time - last_time_ >= num_seconds_);
+  if (summary.iteration == 0 || !is_due) {
+    return ceres::SOLVER_CONTINUE;
+  }
+  if (!Reap(false)) {
+    LOG(WARNING) << "Skipping the checkpoint at iteration " << iteration
+                 << ", the previous one is still being written.";
+    return ceres::SOLVER_CONTINUE;
+  }
+
+  CheckpointHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kCheckpointMagic, sizeof(header.magic));
+  header.version = kCheckpointVersion;
+  header.num_intrinsics = ba_file_->num_intrinsics();
+  header.num_poses = ba_file_->num_poses();
+  header.num_points = ba_file_->num_points();
+  header.num_iterations = iteration;
+  header.trust_region_radius = summary.trust_region_radius;
+
+  const pid_t pid = fork();
+  if (pid < 0) {
+    LOG(ERROR) << "Unable to fork the checkpoint writer: "
+               << strerror(errno);
+    return ceres::SOLVER_CONTINUE;
+  }
+  if (pid == 0) {
+    _exit(Write(header) ? 0 : 1);
+  }
+  child_ = pid;
+  last_iteration_ = iteration;
+  last_time_ = time;
+  return ceres::SOLVER_CONTINUE;
+}
+
+void CheckpointWriter::ContinueAfter(const ceres::Solver::Summary& summary) {
+  num_previous_iterations_ +=
+      summary.num_successful_steps + summary.num_unsuccessful_steps;
+}
+
+bool CheckpointWriter::Write(const CheckpointHeader& header) const {
+  const int fd = open(temporary_filename_.c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC,
+                      0644);
+  if (fd < 0) {
+    return false;
+  }
+  const int num_intrinsic_parameters =
+      kMaxNumIntrinsicParameters * ba_file_->num_intrinsics();
+  const bool ok =
+      WriteAll(fd, reinterpret_cast<const char*>(&header), sizeof(header)) &&
+      WriteAll(fd,
+               reinterpret_cast<const char*>(ba_file_->GetIntrinsics(0)),
+               num_intrinsic_parameters * sizeof(double)) &&
+      WriteBlocks(fd, ba_file_->GetPose(0), 6, pose_ids_, &buffer_) &&
+      WriteBlocks(fd, ba_file_->GetPoint(0), 3, point_ids_, &buffer_) &&
+      fsync(fd) == 0;
+  if (close(fd) != 0 || !ok) {
+    return false;
+  }
+  return rename(temporary_filename_.c_str(), filename_.c_str()) == 0;
+}
+
+bool CheckpointWriter::Reap(const bool block) {
+  if (child_ < 0) {
+    return true;
+  }
+  int status;
+  const pid_t pid = waitpid(child_, &status, block ? 0 : WNOHANG);
+  if (pid == 0) {
+    return false;
+  }
+  if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    LOG(ERROR) << "Writing the checkpoint of iteration " << last_iteration_
+               << " to " << filename_ << " failed.";
+  } else {
+    LOG(INFO) << "Wrote the checkpoint of iteration " << last_iteration_
+              << " to " << filename_ << ".";
+  }
+  child_ = -1;
+  return true;
+}
+
+void ReadCheckpoint(const std::string& filename,
+                    BAFile* ba_file,
+                    CheckpointHeader* header) {
+  MappedFile file;
+  CHECK(file.Open(filename)) << "Error reading checkpoint: " << filename;
+  CHECK_GE(file.size(), sizeof(*header))
+      << "Truncated checkpoint: " << filename;
+  memcpy(header, file.data(), sizeof(*header));
+  CHECK_EQ(memcmp(header->magic, kCheckpointMagic, sizeof(header->magic)), 0)
+      << "Not a checkpoint: " << filename;
+  CHECK_EQ(header->version, kCheckpointVersion)
+      << "Unsupported checkpoint version: " << filename;
+  CHECK(header->num_intrinsics == ba_file->num_intrinsics() &&
+        header->num_poses == ba_file->num_poses() &&
+        header->num_points == ba_file->num_points())
+      << "The checkpoint " << filename << " was not written from this "
+      << "BAF file.";
+
+  const size_t num_intrinsic_parameters =
+      kMaxNumIntrinsicParameters * ba_file->num_intrinsics();
+  const size_t num_parameters = num_intrinsic_parameters +
+      6 * ba_file->num_poses() + 3 * ba_file->num_points();
+  CHECK_EQ(file.size(), sizeof(*header) + num_parameters * sizeof(double))
+      << "Truncated checkpoint: " << filename;
+
+  const char* data = file.data() + sizeof(*header);
+  memcpy(ba_file->GetIntrinsics(0), data,
+         num_intrinsic_parameters * sizeof(double));
+  data += num_intrinsic_parameters * sizeof(double);
+  memcpy(ba_file->GetPose(0), data, 6 * ba_file->num_poses() * sizeof(double));
+  data += 6 * ba_file->num_poses() * sizeof(double);
+  memcpy(ba_file->GetPoint(0), data,
+         3 * ba_file->num_points() * sizeof(double));
+}
+
+}  // namespace openMVG
@@ -0,0 +1,141 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_CHECKPOINT_H_
+#define EXERCISES_CERES_CHECKPOINT_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+#include "ceres/ceres.h"
+
+namespace openMVG {
+
+class BAFile;
+
+// Checkpoints consist of a CheckpointHeader followed by the arrays
+//
+//   intrinsics  double[kMaxNumIntrinsicParameters * num_intrinsics]
+//   poses       double[6 * num_poses]
+//   points      double[3 * num_points]
+//
+// in native byte order, with the poses and points in the order of
+// their ids in the BAF file, whether or not the BAFile was reordered.
+const char kCheckpointMagic[8] = { 'B', 'A', 'F', 'C', 'K', 'P', '\r', '\n' };
+const int32_t kCheckpointVersion = 1;
+
+struct CheckpointHeader {
+  char magic[8];
+  int32_t version;
+  int32_t num_intrinsics;
+  int32_t num_poses;
+  int32_t num_points;
+
+  // The number of iterations done and the trust region radius when
+  // the checkpoint was written, used to continue the solve from it.
+  int32_t num_iterations;
+  int32_t padding;
+  double trust_region_radius;
+};
+
+// Writes the parameters of a BAFile to a checkpoint every
+// num_iterations iterations or every num_seconds seconds, whichever
+// comes first. Zero disables either trigger. The parameters are only
+// up to date at every iteration if the solver is run with
+// Solver::Options::update_state_every_iteration.
+//
+// The checkpoint is written by a forked child process, which sees the
+// parameters as they were when it was forked, so the minimizer only
+// stalls for the duration of the fork. The child writes to a temporary
+// file and renames it over the checkpoint, so a crash never leaves a
+// partially written checkpoint behind. If the previous checkpoint is
+// still being written when the next one is due, the next one is
+// skipped.
+class CheckpointWriter : public ceres::IterationCallback {
+ public:
+  // num_previous_iterations is added to the iteration counts, for
+  // solves resumed from a checkpoint. ba_file is not owned and must
+  // not be reordered while the writer exists.
+  CheckpointWriter(const std::string& filename,
+                   int num_iterations,
+                   double num_seconds,
+                   int num_previous_iterations,
+                   const BAFile* ba_file);
+
+  // Waits for the checkpoint being written, if any.
+  virtual ~CheckpointWriter();
+
+  virtual ceres::CallbackReturnType operator()(
+      const ceres::IterationSummary& summary);
+
+  // Count the iterations of the following solve after those of the
+  // solve summarized by summary, for a solve continued by another one
+  // with the same callbacks. Ceres numbers the iterations of every
+  // solve from 0.
+  void ContinueAfter(const ceres::Solver::Summary& summary);
+
+ private:
+  // Write the checkpoint. Runs in the child process, so it only makes
+  // system calls and does not allocate.
+  bool Write(const CheckpointHeader& header) const;
+
+  // Wait for the child writing a checkpoint and log its outcome. If
+  // block is false, returns false if it is still running.
+  bool Reap(bool block);
+
+  const std::string filename_;
+  const std::string temporary_filename_;
+  const int num_iterations_;
+  const double num_seconds_;
+  int num_previous_iterations_;
+  const BAFile* ba_file_;
+
+  // The current ids of the poses and points in the order of their ids
+  // in the BAF file, and the buffer the child writes through, both
+  // set up in the parent.
+  std::vector<int> pose_ids_;
+  std::vector<int> point_ids_;
+  mutable std::vector<char> buffer_;
+
+  // The child writing a checkpoint, or -1, and the iteration count
+  // and time at which the last checkpoint was started.
+  pid_t child_;
+  int last_iteration_;
+  double last_time_;
+};
+
+// Copy the parameters stored in a checkpoint into ba_file, which must
+// be the BAF file the checkpoint was written from, before any
+// reordering. Returns the header of the checkpoint in header.
+void ReadCheckpoint(const std::string& filename,
+                    BAFile* ba_file,
+                    CheckpointHeader* header);
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_CHECKPOINT_H_
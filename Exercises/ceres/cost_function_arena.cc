@@ -0,0 +1,75 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "cost_function_arena.h"
+
+#include <stddef.h>
+#include <vector>
+
+#include "glog/logging.h"
+
+namespace openMVG {
+namespace {
+
+// Alignment of the objects constructed in the arena, enough for any
+// of the cost functions.
+const size_t kAlignment = 16;
+
+}  // namespace
+
+CostFunctionArena::CostFunctionArena(const size_t block_size)
+    : block_size_(block_size),
+      block_used_(block_size) {
+}
+
+CostFunctionArena::~CostFunctionArena() {
+  for (int i = cost_functions_.size() - 1; i >= 0; --i) {
+    cost_functions_[i]->~CostFunction();
+  }
+  for (int i = 0; i < blocks_.size(); ++i) {
+    delete[] blocks_[i];
+  }
+}
+
+void* CostFunctionArena::Allocate(size_t size) {
+  size = (size + kAlignment - 1) & ~(kAlignment - 1);
+  CHECK_LE(size, block_size_);
+  if (block_used_ + size > block_size_) {
+    // new[] returns memory aligned for any fundamental type.
+    blocks_.push_back(new char[block_size_]);
+    block_used_ = 0;
+  }
+  void* memory = blocks_.back() + block_used_;
+  block_used_ += size;
+  return memory;
+}
+
+size_t CostFunctionArena::bytes_allocated() const {
+  return blocks_.size() * block_size_ +
+      cost_functions_.capacity() * sizeof(cost_functions_[0]);
+}
+
+}  // namespace openMVG
@@ -0,0 +1,142 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_COST_FUNCTION_ARENA_H_
+#define EXERCISES_CERES_COST_FUNCTION_ARENA_H_
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+#include "ceres/ceres.h"
+#include "ceres/jet.h"
+
+namespace openMVG {
+
+// Constructs cost functions in large blocks of memory instead of
+// allocating each of them separately, and destroys them all at once.
+//
+// A problem using cost functions from an arena must be created with
+// Problem::Options::cost_function_ownership = DO_NOT_TAKE_OWNERSHIP,
+// and be destroyed before the arena.
+class CostFunctionArena {
+ public:
+  explicit CostFunctionArena(size_t block_size = 1 << 20);
+  ~CostFunctionArena();
+
+  template <typename CostFunctionType, typename Arg>
+  CostFunctionType* Construct(const Arg& arg) {
+    CostFunctionType* cost_function =
+        new (Allocate(sizeof(CostFunctionType))) CostFunctionType(arg);
+    cost_functions_.push_back(cost_function);
+    return cost_function;
+  }
+
+  template <typename CostFunctionType, typename Arg1, typename Arg2>
+  CostFunctionType* Construct(const Arg1& arg1, const Arg2& arg2) {
+    CostFunctionType* cost_function =
+        new (Allocate(sizeof(CostFunctionType))) CostFunctionType(arg1, arg2);
+    cost_functions_.push_back(cost_function);
+    return cost_function;
+  }
+
+  int num_cost_functions() const { return cost_functions_.size(); }
+
+  // Memory allocated by the arena itself.
+  size_t bytes_allocated() const;
+
+ private:
+  void* Allocate(size_t size);
+
+  const size_t block_size_;
+  std::vector<char*> blocks_;
+  size_t block_used_;
+  std::vector<ceres::CostFunction*> cost_functions_;
+
+  CostFunctionArena(const CostFunctionArena&);
+  void operator=(const CostFunctionArena&);
+};
+
+// Same as ceres::AutoDiffCostFunction with three parameter blocks, but
+// the functor is stored by value instead of being allocated
+// separately, which together with CostFunctionArena saves two
+// allocations per residual block. The derivatives are propagated with
+// ceres::Jet directly, which unlike the machinery behind
+// AutoDiffCostFunction is part of the public API of every version of
+// Ceres.
+template <typename CostFunctor, int kNumResiduals, int N0, int N1, int N2>
+class InlineAutoDiffCostFunction
+    : public ceres::SizedCostFunction<kNumResiduals, N0, N1, N2> {
+ public:
+  explicit InlineAutoDiffCostFunction(const CostFunctor& functor)
+      : functor_(functor) {}
+
+  virtual ~InlineAutoDiffCostFunction() {}
+
+  virtual bool Evaluate(double const* const* parameters,
+                        double* residuals,
+                        double** jacobians) const {
+    if (jacobians == NULL) {
+      return functor_(parameters[0], parameters[1], parameters[2], residuals);
+    }
+
+    typedef ceres::Jet<double, N0 + N1 + N2> JetT;
+    const int sizes[3] = {N0, N1, N2};
+    JetT x[N0 + N1 + N2];
+    for (int block = 0, k = 0; block < 3; ++block) {
+      for (int i = 0; i < sizes[block]; ++i, ++k) {
+        x[k] = JetT(parameters[block][i], k);
+      }
+    }
+
+    JetT y[kNumResiduals];
+    if (!functor_(x, x + N0, x + N0 + N1, y)) {
+      return false;
+    }
+
+    for (int r = 0; r < kNumResiduals; ++r) {
+      residuals[r] = y[r].a;
+    }
+    for (int block = 0, offset = 0; block < 3; offset += sizes[block++]) {
+      if (jacobians[block] == NULL) {
+        continue;
+      }
+      for (int r = 0; r < kNumResiduals; ++r) {
+        for (int i = 0; i < sizes[block]; ++i) {
+          jacobians[block][r * sizes[block] + i] = y[r].v[offset + i];
+        }
+      }
+    }
+    return true;
+  }
+
+ private:
+  CostFunctor functor_;
+};
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_COST_FUNCTION_ARENA_H_
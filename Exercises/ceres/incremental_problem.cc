@@ -0,0 +1,277 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "incremental_problem.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "ba_file.h"
+#include "camera_models.h"
+#include "ceres/ceres.h"
+#include "glog/logging.h"
+
+namespace openMVG {
+
+ParameterBlockStorage::ParameterBlockStorage(const int block_size)
+    : block_size_(block_size), size_(0) {
+}
+
+ParameterBlockStorage::~ParameterBlockStorage() {
+  for (int i = 0; i < chunks_.size(); ++i) {
+    delete[] chunks_[i];
+  }
+}
+
+int ParameterBlockStorage::Add(const double* values) {
+  if (size_ == chunks_.size() * kNumBlocksPerChunk) {
+    chunks_.push_back(new double[kNumBlocksPerChunk * block_size_]);
+  }
+  const int id = size_++;
+  std::copy(values, values + block_size_, Get(id));
+  return id;
+}
+
+IncrementalProblem::IncrementalProblem()
+    : intrinsics_(kMaxNumIntrinsicParameters),
+      poses_(6),
+      points_(3),
+      num_intrinsics_(0),
+      num_poses_(0),
+      num_points_(0),
+      num_observations_(0),
+      problem_(ProblemOptions()) {
+}
+
+IncrementalProblem::IncrementalProblem(const BAFile& ba_file)
+    : intrinsics_(kMaxNumIntrinsicParameters),
+      poses_(6),
+      points_(3),
+      num_intrinsics_(0),
+      num_poses_(0),
+      num_points_(0),
+      num_observations_(0),
+      problem_(ProblemOptions()) {
+  for (int i = 0; i < ba_file.num_intrinsics(); ++i) {
+    AddIntrinsics(ba_file.camera_model(i), ba_file.GetIntrinsics(i));
+  }
+  for (int i = 0; i < ba_file.num_poses(); ++i) {
+    AddPose(ba_file.GetPose(i));
+  }
+  for (int point_id = 0; point_id < ba_file.num_points(); ++point_id) {
+    AddPoint(ba_file.GetPoint(point_id));
+    const ObservationSpan observations =
+        ba_file.ObservationsForPoint(point_id);
+    for (int i = 0; i < observations.size(); ++i) {
+      const Observation obs = observations[i];
+      AddObservation(obs.intrinsics_id, obs.pose_id, point_id, obs.x, obs.y);
+    }
+  }
+}
+
+ceres::Problem::Options IncrementalProblem::ProblemOptions() {
+  ceres::Problem::Options options;
+  options.enable_fast_removal = true;
+  return options;
+}
+
+int IncrementalProblem::AddIntrinsics(const CameraModelType type,
+                                      const double* intrinsics) {
+  const int id = intrinsics_.Add(intrinsics);
+  camera_models_.push_back(type);
+  is_removed_intrinsics_.push_back(false);
+  intrinsics_observation_ids_.push_back(std::vector<int>());
+  ++num_intrinsics_;
+  problem_.AddParameterBlock(intrinsics_.Get(id),
+                             NumIntrinsicParameters(type));
+  ordering_.AddElementToGroup(intrinsics_.Get(id), 1);
+  return id;
+}
+
+int IncrementalProblem::AddPose(const double* pose) {
+  const int id = poses_.Add(pose);
+  is_removed_pose_.push_back(false);
+  pose_observation_ids_.push_back(std::vector<int>());
+  ++num_poses_;
+  problem_.AddParameterBlock(poses_.Get(id), 6);
+  ordering_.AddElementToGroup(poses_.Get(id), 1);
+  return id;
+}
+
+int IncrementalProblem::AddPoint(const double* point) {
+  const int id = points_.Add(point);
+  is_removed_point_.push_back(false);
+  point_observation_ids_.push_back(std::vector<int>());
+  ++num_points_;
+  problem_.AddParameterBlock(points_.Get(id), 3);
+  ordering_.AddElementToGroup(points_.Get(id), 0);
+  return id;
+}
+
+int IncrementalProblem::AddObservation(const int intrinsics_id,
+                                       const int pose_id,
+                                       const int point_id,
+                                       const double x,
+                                       const double y) {
+  ObservationRecord record;
+  record.intrinsics_id = intrinsics_id;
+  record.pose_id = pose_id;
+  record.point_id = point_id;
+  record.residual_block_id = problem_.AddResidualBlock(
+      CreateCameraReprojectionError(camera_models_[intrinsics_id], x, y),
+      NULL,
+      GetIntrinsics(intrinsics_id),
+      GetPose(pose_id),
+      GetPoint(point_id));
+  const int id = static_cast<int>(observations_.size());
+  observations_.push_back(record);
+  intrinsics_observation_ids_[intrinsics_id].push_back(id);
+  pose_observation_ids_[pose_id].push_back(id);
+  point_observation_ids_[point_id].push_back(id);
+  ++num_observations_;
+  return id;
+}
+
+void IncrementalProblem::RemoveParameterBlock(
+    double* parameter_block,
+    const std::vector<int>& observation_ids) {
+  for (int i = 0; i < observation_ids.size(); ++i) {
+    ObservationRecord& record = observations_[observation_ids[i]];
+    if (record.residual_block_id != NULL) {
+      record.residual_block_id = NULL;
+      --num_observations_;
+    }
+  }
+  // Also removes the residual blocks.
+  problem_.RemoveParameterBlock(parameter_block);
+  ordering_.Remove(parameter_block);
+}
+
+void IncrementalProblem::RemoveIntrinsics(const int intrinsics_id) {
+  RemoveParameterBlock(GetIntrinsics(intrinsics_id),
+                       intrinsics_observation_ids_[intrinsics_id]);
+  is_removed_intrinsics_[intrinsics_id] = true;
+  --num_intrinsics_;
+}
+
+void IncrementalProblem::RemovePose(const int pose_id) {
+  RemoveParameterBlock(GetPose(pose_id), pose_observation_ids_[pose_id]);
+  is_removed_pose_[pose_id] = true;
+  --num_poses_;
+}
+
+void IncrementalProblem::RemovePoint(const int point_id) {
+  RemoveParameterBlock(GetPoint(point_id),
+                       point_observation_ids_[point_id]);
+  is_removed_point_[point_id] = true;
+  --num_points_;
+}
+
+void IncrementalProblem::RemoveObservation(const int observation_id) {
+  CHECK(HasObservation(observation_id))
+      << "Unknown observation: " << observation_id;
+  ObservationRecord& record = observations_[observation_id];
+  problem_.RemoveResidualBlock(record.residual_block_id);
+  record.residual_block_id = NULL;
+  --num_observations_;
+}
+
+void IncrementalProblem::SetPoseConstant(const int pose_id) {
+  problem_.SetParameterBlockConstant(GetPose(pose_id));
+}
+
+void IncrementalProblem::SetPoseVariable(const int pose_id) {
+  problem_.SetParameterBlockVariable(GetPose(pose_id));
+}
+
+void IncrementalProblem::Solve(const ceres::Solver::Options& options,
+                               ceres::Solver::Summary* summary) {
+  ceres::Solver::Options solver_options = options;
+  if (ceres::IsSchurType(options.linear_solver_type) &&
+      options.linear_solver_ordering.get() == NULL &&
+      num_points_ > 0) {
+    // The solver removes the blocks it does not optimize from the
+    // ordering it is given, so it gets a copy.
+    solver_options.linear_solver_ordering.reset(
+        new ceres::ParameterBlockOrdering(ordering_));
+  }
+  ceres::Solve(solver_options, &problem_, summary);
+}
+
+bool IncrementalProblem::HasIntrinsics(const int intrinsics_id) const {
+  return intrinsics_id >= 0 && intrinsics_id < intrinsics_.size() &&
+      !is_removed_intrinsics_[intrinsics_id];
+}
+
+bool IncrementalProblem::HasPose(const int pose_id) const {
+  return pose_id >= 0 && pose_id < poses_.size() &&
+      !is_removed_pose_[pose_id];
+}
+
+bool IncrementalProblem::HasPoint(const int point_id) const {
+  return point_id >= 0 && point_id < points_.size() &&
+      !is_removed_point_[point_id];
+}
+
+bool IncrementalProblem::HasObservation(const int observation_id) const {
+  return observation_id >= 0 && observation_id < observations_.size() &&
+      observations_[observation_id].residual_block_id != NULL;
+}
+
+double* IncrementalProblem::GetIntrinsics(const int intrinsics_id) {
+  CHECK(HasIntrinsics(intrinsics_id))
+      << "Unknown intrinsics: " << intrinsics_id;
+  return intrinsics_.Get(intrinsics_id);
+}
+
+double* IncrementalProblem::GetPose(const int pose_id) {
+  CHECK(HasPose(pose_id)) << "Unknown pose: " << pose_id;
+  return poses_.Get(pose_id);
+}
+
+double* IncrementalProblem::GetPoint(const int point_id) {
+  CHECK(HasPoint(point_id)) << "Unknown point: " << point_id;
+  return points_.Get(point_id);
+}
+
+const double* IncrementalProblem::GetIntrinsics(
+    const int intrinsics_id) const {
+  CHECK(HasIntrinsics(intrinsics_id))
+      << "Unknown intrinsics: " << intrinsics_id;
+  return intrinsics_.Get(intrinsics_id);
+}
+
+const double* IncrementalProblem::GetPose(const int pose_id) const {
+  CHECK(HasPose(pose_id)) << "Unknown pose: " << pose_id;
+  return poses_.Get(pose_id);
+}
+
+const double* IncrementalProblem::GetPoint(const int point_id) const {
+  CHECK(HasPoint(point_id)) << "Unknown point: " << point_id;
+  return points_.Get(point_id);
+}
+
+}  // namespace openMVG
@@ -0,0 +1,193 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// A bundle adjustment problem which is updated in place as cameras,
+// points and observations are added to and removed from the
+// reconstruction, instead of being rebuilt from a BAF file after every
+// change.
+
+#ifndef EXERCISES_CERES_INCREMENTAL_PROBLEM_H_
+#define EXERCISES_CERES_INCREMENTAL_PROBLEM_H_
+
+#include <vector>
+
+#include "camera_models.h"
+#include "ceres/ceres.h"
+
+namespace openMVG {
+
+class BAFile;
+
+// Parameter blocks of a fixed size, allocated in chunks so that a
+// block never moves once it has been added, which is required of the
+// parameter blocks of a ceres::Problem.
+class ParameterBlockStorage {
+ public:
+  explicit ParameterBlockStorage(int block_size);
+  ~ParameterBlockStorage();
+
+  // Append a block initialized with values, and return its id.
+  int Add(const double* values);
+
+  double* Get(int id) {
+    return chunks_[id / kNumBlocksPerChunk] +
+        (id % kNumBlocksPerChunk) * block_size_;
+  }
+  const double* Get(int id) const {
+    return chunks_[id / kNumBlocksPerChunk] +
+        (id % kNumBlocksPerChunk) * block_size_;
+  }
+
+  int size() const { return size_; }
+
+ private:
+  static const int kNumBlocksPerChunk = 4096;
+
+  const int block_size_;
+  int size_;
+  std::vector<double*> chunks_;
+
+  ParameterBlockStorage(const ParameterBlockStorage&);
+  void operator=(const ParameterBlockStorage&);
+};
+
+// A long lived bundle adjustment problem with the same parameter
+// layout as BAFile. Every intrinsic, pose, point and observation gets
+// an id when it is added. Ids are never reused, and removing an
+// element does not renumber the others.
+//
+// The ceres::Problem is constructed with enable_fast_removal, so
+// removing an element takes time proportional to the number of its
+// observations. Between calls to Solve the values of the parameters
+// are kept, so every solve starts from the result of the previous
+// one, and so is the elimination ordering used by the Schur type
+// linear solvers, which is updated as parameter blocks come and go
+// instead of being recomputed by the solver.
+//
+// The cost functions are allocated on the heap and owned by the
+// problem, so that removing an observation frees its cost function.
+// The storage of removed parameter blocks and observations is not
+// reclaimed.
+class IncrementalProblem {
+ public:
+  IncrementalProblem();
+
+  // Start with the contents of ba_file. The ids of its intrinsics,
+  // poses, points and observations are the same as in ba_file.
+  explicit IncrementalProblem(const BAFile& ba_file);
+
+  int AddIntrinsics(CameraModelType type, const double* intrinsics);
+  int AddPose(const double* pose);
+  int AddPoint(const double* point);
+  int AddObservation(int intrinsics_id,
+                     int pose_id,
+                     int point_id,
+                     double x,
+                     double y);
+
+  // Removing a parameter block also removes all of its observations.
+  void RemoveIntrinsics(int intrinsics_id);
+  void RemovePose(int pose_id);
+  void RemovePoint(int point_id);
+  void RemoveObservation(int observation_id);
+
+  // Hold the pose constant, or let it vary again.
+  void SetPoseConstant(int pose_id);
+  void SetPoseVariable(int pose_id);
+
+  // Solve the problem as it is now. Unless options has an ordering of
+  // its own, the Schur type linear solvers eliminate the points first
+  // using the ordering maintained by the problem.
+  void Solve(const ceres::Solver::Options& options,
+             ceres::Solver::Summary* summary);
+
+  bool HasIntrinsics(int intrinsics_id) const;
+  bool HasPose(int pose_id) const;
+  bool HasPoint(int point_id) const;
+  bool HasObservation(int observation_id) const;
+
+  // The parameters have the layout of the ones of BAFile.
+  double* GetIntrinsics(int intrinsics_id);
+  double* GetPose(int pose_id);
+  double* GetPoint(int point_id);
+  const double* GetIntrinsics(int intrinsics_id) const;
+  const double* GetPose(int pose_id) const;
+  const double* GetPoint(int point_id) const;
+
+  // The number of elements in the problem, not counting removed ones.
+  int num_intrinsics() const { return num_intrinsics_; }
+  int num_poses() const { return num_poses_; }
+  int num_points() const { return num_points_; }
+  int num_observations() const { return num_observations_; }
+
+  const ceres::Problem& problem() const { return problem_; }
+
+ private:
+  struct ObservationRecord {
+    ceres::ResidualBlockId residual_block_id;
+    int intrinsics_id;
+    int pose_id;
+    int point_id;
+  };
+
+  static ceres::Problem::Options ProblemOptions();
+
+  // Remove a parameter block, its observations, whose ids are in
+  // observation_ids, and its entry in the ordering.
+  void RemoveParameterBlock(double* parameter_block,
+                            const std::vector<int>& observation_ids);
+
+  ParameterBlockStorage intrinsics_;
+  ParameterBlockStorage poses_;
+  ParameterBlockStorage points_;
+  std::vector<CameraModelType> camera_models_;
+  std::vector<bool> is_removed_intrinsics_;
+  std::vector<bool> is_removed_pose_;
+  std::vector<bool> is_removed_point_;
+  int num_intrinsics_;
+  int num_poses_;
+  int num_points_;
+  int num_observations_;
+
+  // residual_block_id is NULL for removed observations.
+  std::vector<ObservationRecord> observations_;
+
+  // The ids of the observations of every parameter block, in the order
+  // they were added. Removing an observation does not remove its id
+  // from these, so they also contain removed observations.
+  std::vector<std::vector<int> > intrinsics_observation_ids_;
+  std::vector<std::vector<int> > pose_observation_ids_;
+  std::vector<std::vector<int> > point_observation_ids_;
+
+  ceres::Problem problem_;
+
+  // Points in group 0, poses and intrinsics in group 1.
+  ceres::ParameterBlockOrdering ordering_;
+};
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_INCREMENTAL_PROBLEM_H_
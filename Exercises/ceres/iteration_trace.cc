@@ -0,0 +1,170 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "iteration_trace.h"
+
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include "ceres/ceres.h"
+#include "glog/logging.h"
+
+namespace openMVG {
+namespace {
+
+// JSON has no representation for infinities and NaNs, the only values
+// for which value - value is not zero.
+std::string JsonNumber(const double value) {
+  if (!(value - value == 0.0)) {
+    return "null";
+  }
+  std::ostringstream os;
+  os.precision(std::numeric_limits<double>::digits10 + 2);
+  os << value;
+  return os.str();
+}
+
+// Chrome trace timestamps are in microseconds.
+std::string JsonMicroseconds(const double seconds) {
+  std::ostringstream os;
+  os.setf(std::ios::fixed);
+  os.precision(3);
+  os << seconds * 1e6;
+  return os.str();
+}
+
+const char* JsonBool(const bool value) {
+  return value ? "true" : "false";
+}
+
+void WriteCompleteEvent(const char* name,
+                        const double start_time_in_seconds,
+                        const double duration_in_seconds,
+                        const std::string& args,
+                        std::ofstream* of) {
+  *of << "{\"name\":\"" << name << "\",\"cat\":\"solver\",\"ph\":\"X\","
+      << "\"pid\":0,\"tid\":0,"
+      << "\"ts\":" << JsonMicroseconds(start_time_in_seconds) << ","
+      << "\"dur\":" << JsonMicroseconds(duration_in_seconds) << ","
+      << "\"args\":{" << args << "}}\n";
+}
+
+}  // namespace
+
+IterationTrace::IterationTrace(const std::string& filename)
+    : of_(filename.c_str()),
+      num_previous_iterations_(0),
+      previous_time_(0.0) {
+  CHECK(of_.good()) << "Unable to open file: " << filename;
+}
+
+IterationTrace::~IterationTrace() {
+}
+
+ceres::CallbackReturnType IterationTrace::operator()(
+    const ceres::IterationSummary& summary) {
+  const double start_time = previous_time_ +
+      summary.cumulative_time_in_seconds - summary.iteration_time_in_seconds;
+
+  std::ostringstream args;
+  args << "\"iteration\":" << num_previous_iterations_ + summary.iteration
+       << ","
+       << "\"cost\":" << JsonNumber(summary.cost) << ","
+       << "\"cost_change\":" << JsonNumber(summary.cost_change) << ","
+       << "\"gradient_max_norm\":" << JsonNumber(summary.gradient_max_norm)
+       << ","
+       << "\"step_norm\":" << JsonNumber(summary.step_norm) << ","
+       << "\"relative_decrease\":" << JsonNumber(summary.relative_decrease)
+       << ","
+       << "\"trust_region_radius\":"
+       << JsonNumber(summary.trust_region_radius) << ","
+       << "\"step_is_successful\":" << JsonBool(summary.step_is_successful)
+       << ","
+       << "\"linear_solver_iterations\":" << summary.linear_solver_iterations;
+  WriteCompleteEvent("iteration",
+                     start_time,
+                     summary.iteration_time_in_seconds,
+                     args.str(),
+                     &of_);
+
+  // The step is computed first, and the candidate point evaluated
+  // after it.
+  WriteCompleteEvent("linear_solve",
+                     start_time,
+                     summary.step_solver_time_in_seconds,
+                     "",
+                     &of_);
+  WriteCompleteEvent("evaluation",
+                     start_time + summary.step_solver_time_in_seconds,
+                     summary.iteration_time_in_seconds -
+                         summary.step_solver_time_in_seconds,
+                     "",
+                     &of_);
+  of_.flush();
+  return ceres::SOLVER_CONTINUE;
+}
+
+void IterationTrace::WriteSummary(const ceres::Solver::Summary& summary) {
+  std::ostringstream args;
+  args << "\"linear_solver_type\":\""
+       << ceres::LinearSolverTypeToString(summary.linear_solver_type_used)
+       << "\","
+       << "\"initial_cost\":" << JsonNumber(summary.initial_cost) << ","
+       << "\"final_cost\":" << JsonNumber(summary.final_cost) << ","
+       << "\"num_successful_steps\":" << summary.num_successful_steps << ","
+       << "\"num_unsuccessful_steps\":" << summary.num_unsuccessful_steps
+       << ","
+       << "\"preprocessor_time\":"
+       << JsonNumber(summary.preprocessor_time_in_seconds) << ","
+       << "\"residual_evaluation_time\":"
+       << JsonNumber(summary.residual_evaluation_time_in_seconds) << ","
+       << "\"jacobian_evaluation_time\":"
+       << JsonNumber(summary.jacobian_evaluation_time_in_seconds) << ","
+       << "\"linear_solver_time\":"
+       << JsonNumber(summary.linear_solver_time_in_seconds) << ","
+       << "\"minimizer_time\":"
+       << JsonNumber(summary.minimizer_time_in_seconds) << ","
+       << "\"postprocessor_time\":"
+       << JsonNumber(summary.postprocessor_time_in_seconds) << ","
+       << "\"total_time\":" << JsonNumber(summary.total_time_in_seconds);
+  WriteCompleteEvent("summary",
+                     previous_time_,
+                     summary.total_time_in_seconds,
+                     args.str(),
+                     &of_);
+  of_.flush();
+}
+
+void IterationTrace::ContinueAfter(const ceres::Solver::Summary& summary) {
+  WriteSummary(summary);
+  num_previous_iterations_ +=
+      summary.num_successful_steps + summary.num_unsuccessful_steps;
+  previous_time_ += summary.total_time_in_seconds;
+}
+
+}  // namespace openMVG
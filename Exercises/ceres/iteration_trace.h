@@ -0,0 +1,80 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_ITERATION_TRACE_H_
+#define EXERCISES_CERES_ITERATION_TRACE_H_
+
+#include <fstream>
+#include <string>
+
+#include "ceres/ceres.h"
+
+namespace openMVG {
+
+// Writes the time spent in each iteration of the solver to a file as
+// Chrome trace events, one JSON object per line, so that it can be
+// read line by line or loaded in chrome://tracing once the lines are
+// wrapped in a JSON array.
+//
+// Every iteration produces an "iteration" event with its cost, cost
+// change, trust region radius and step statistics, nested in which
+// are a "linear_solve" event for the time spent computing the step and
+// an "evaluation" event for the rest of the iteration, i.e., the
+// evaluation of the residuals and Jacobians at the new point. Ceres
+// only splits residual and Jacobian evaluation for the solve as a
+// whole, so those are written by WriteSummary as a "summary" event
+// once the solver is done.
+//
+// Timestamps are in microseconds since the start of the solver.
+class IterationTrace : public ceres::IterationCallback {
+ public:
+  explicit IterationTrace(const std::string& filename);
+  virtual ~IterationTrace();
+
+  virtual ceres::CallbackReturnType operator()(
+      const ceres::IterationSummary& summary);
+
+  void WriteSummary(const ceres::Solver::Summary& summary);
+
+  // For a solve continued by another one with the same callbacks:
+  // write the summary of the solve summarized by summary, and place
+  // the iterations and timestamps of the following solve after its
+  // own, so that the trace reads as one solve with one "summary" event
+  // per call to ceres::Solve.
+  void ContinueAfter(const ceres::Solver::Summary& summary);
+
+ private:
+  std::ofstream of_;
+
+  // The number of iterations and the time of the solves before the
+  // current one.
+  int num_previous_iterations_;
+  double previous_time_;
+};
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_ITERATION_TRACE_H_
@@ -0,0 +1,310 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "keyframe_bundle_adjustment.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "Eigen/Core"
+#include "ba_file.h"
+#include "bundle_adjustment.h"
+#include "ceres/ceres.h"
+#include "ceres/rotation.h"
+#include "cost_function_arena.h"
+#include "glog/logging.h"
+#include "reprojection_statistics.h"
+#include "wall_time.h"
+
+namespace openMVG {
+namespace {
+
+// The rigid change of coordinates x' = Q x + t which takes a pose from
+// its value before the keyframe problem to its value after it, with
+// the rotation Q as an angle-axis vector.
+struct Correction {
+  double rotation[3];
+  double translation[3];
+};
+
+// A camera maps x to R (x - c), so after the change of coordinates it
+// is R' = R Q^T and c' = Q c + t.
+void ComputeCorrection(const double* pose,
+                       const double* corrected_pose,
+                       Correction* correction) {
+  Eigen::Matrix3d rotation;
+  Eigen::Matrix3d corrected_rotation;
+  ceres::AngleAxisToRotationMatrix(
+      pose, ceres::ColumnMajorAdapter3x3(rotation.data()));
+  ceres::AngleAxisToRotationMatrix(
+      corrected_pose, ceres::ColumnMajorAdapter3x3(corrected_rotation.data()));
+  const Eigen::Matrix3d q = corrected_rotation.transpose() * rotation;
+  ceres::RotationMatrixToAngleAxis(
+      ceres::ColumnMajorAdapter3x3(q.data()), correction->rotation);
+  Eigen::Map<Eigen::Vector3d> translation(correction->translation);
+  translation = Eigen::Map<const Eigen::Vector3d>(corrected_pose + 3) -
+      q * Eigen::Map<const Eigen::Vector3d>(pose + 3);
+}
+
+// Apply the correction (1 - s) a + s b to pose. The corrections of
+// neighboring keyframes are small and close to each other, so they
+// are interpolated linearly in their parameters.
+void ApplyInterpolatedCorrection(const Correction& a,
+                                 const Correction& b,
+                                 const double s,
+                                 double* pose) {
+  Correction correction;
+  for (int i = 0; i < 3; ++i) {
+    correction.rotation[i] = (1.0 - s) * a.rotation[i] + s * b.rotation[i];
+    correction.translation[i] =
+        (1.0 - s) * a.translation[i] + s * b.translation[i];
+  }
+
+  Eigen::Matrix3d q;
+  Eigen::Matrix3d rotation;
+  ceres::AngleAxisToRotationMatrix(
+      correction.rotation, ceres::ColumnMajorAdapter3x3(q.data()));
+  ceres::AngleAxisToRotationMatrix(
+      pose, ceres::ColumnMajorAdapter3x3(rotation.data()));
+  const Eigen::Matrix3d corrected_rotation = rotation * q.transpose();
+  ceres::RotationMatrixToAngleAxis(
+      ceres::ColumnMajorAdapter3x3(corrected_rotation.data()), pose);
+  Eigen::Map<Eigen::Vector3d> center(pose + 3);
+  center = q * center +
+      Eigen::Map<const Eigen::Vector3d>(correction.translation);
+}
+
+void SetIntrinsicsConstant(BAFile* ba_file, ceres::Problem* problem) {
+  for (int i = 0; i < ba_file->num_intrinsics(); ++i) {
+    double* intrinsics = ba_file->GetIntrinsics(i);
+    if (problem->HasParameterBlock(intrinsics)) {
+      problem->SetParameterBlockConstant(intrinsics);
+    }
+  }
+}
+
+}  // namespace
+
+void SolveWithKeyframes(const KeyframeOptions& options,
+                        BAFile* ba_file,
+                        ceres::Solver::Summary* summary) {
+  CHECK_GE(options.keyframe_interval, 1);
+  CHECK(options.create_reprojection_error != NULL);
+
+  const int num_poses = ba_file->num_poses();
+  const int num_points = ba_file->num_points();
+  std::vector<int> poses_by_original_id(num_poses);
+  for (int pose_id = 0; pose_id < num_poses; ++pose_id) {
+    poses_by_original_id[ba_file->OriginalPoseId(pose_id)] = pose_id;
+  }
+  // The original ids of the keyframes, in increasing order.
+  std::vector<bool> is_keyframe(num_poses, false);
+  std::vector<int> keyframe_ids;
+  for (int i = 0; i < num_poses; ++i) {
+    if (i % options.keyframe_interval == 0 || i == num_poses - 1) {
+      is_keyframe[poses_by_original_id[i]] = true;
+      keyframe_ids.push_back(i);
+    }
+  }
+
+  // The points observed by at least two keyframes.
+  std::vector<bool> is_keyframe_point(num_points, false);
+  for (int point_id = 0; point_id < num_points; ++point_id) {
+    const ObservationSpan observations =
+        ba_file->ObservationsForPoint(point_id);
+    int num_keyframe_observations = 0;
+    for (int i = 0; i < observations.size(); ++i) {
+      num_keyframe_observations += is_keyframe[observations.pose_id(i)];
+    }
+    is_keyframe_point[point_id] = num_keyframe_observations >= 2;
+  }
+
+  const double initial_cost =
+      ReprojectionCost(*ba_file, options.solver_options.num_threads);
+
+  // 1. The keyframe problem.
+  std::vector<double> initial_keyframe_poses(6 * keyframe_ids.size());
+  for (int k = 0; k < keyframe_ids.size(); ++k) {
+    const double* pose =
+        ba_file->GetPose(poses_by_original_id[keyframe_ids[k]]);
+    std::copy(pose, pose + 6, &initial_keyframe_poses[6 * k]);
+  }
+  double start_time = WallTimeInSeconds();
+  {
+    CostFunctionArena arena;
+    ceres::Problem::Options problem_options;
+    problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    ceres::Problem problem(problem_options);
+    int num_keyframe_points = 0;
+    for (int point_id = 0; point_id < num_points; ++point_id) {
+      if (!is_keyframe_point[point_id]) {
+        continue;
+      }
+      ++num_keyframe_points;
+      const ObservationSpan observations =
+          ba_file->ObservationsForPoint(point_id);
+      for (int i = 0; i < observations.size(); ++i) {
+        const Observation obs = observations[i];
+        if (!is_keyframe[obs.pose_id]) {
+          continue;
+        }
+        problem.AddResidualBlock(
+            options.create_reprojection_error(*ba_file, obs, &arena),
+            NULL,
+            ba_file->GetIntrinsics(obs.intrinsics_id),
+            ba_file->GetPose(obs.pose_id),
+            ba_file->GetPoint(point_id));
+      }
+    }
+    LOG(INFO) << "Keyframe problem: " << keyframe_ids.size() << " of "
+              << num_poses << " poses, " << num_keyframe_points << " of "
+              << num_points << " points, " << problem.NumResidualBlocks()
+              << " residual blocks.";
+    // The callbacks only see the final solve, so that they observe a
+    // single sequence of iterations.
+    ceres::Solver::Options solver_options = options.solver_options;
+    solver_options.callbacks.clear();
+    ceres::Solver::Summary keyframe_summary;
+    ceres::Solve(solver_options, &problem, &keyframe_summary);
+    LOG(INFO) << "Keyframes: " << keyframe_summary.BriefReport();
+  }
+  LOG(INFO) << "Solving the keyframes took "
+            << WallTimeInSeconds() - start_time << " seconds.";
+
+  // 2. Interpolate and resect the other poses.
+  start_time = WallTimeInSeconds();
+  std::vector<Correction> corrections(keyframe_ids.size());
+  for (int k = 0; k < keyframe_ids.size(); ++k) {
+    ComputeCorrection(&initial_keyframe_poses[6 * k],
+                      ba_file->GetPose(poses_by_original_id[keyframe_ids[k]]),
+                      &corrections[k]);
+  }
+  for (int k = 0; k + 1 < keyframe_ids.size(); ++k) {
+    const int begin = keyframe_ids[k];
+    const int end = keyframe_ids[k + 1];
+    for (int i = begin + 1; i < end; ++i) {
+      ApplyInterpolatedCorrection(
+          corrections[k],
+          corrections[k + 1],
+          static_cast<double>(i - begin) / (end - begin),
+          ba_file->GetPose(poses_by_original_id[i]));
+    }
+  }
+  {
+    CostFunctionArena arena;
+    ceres::Problem::Options problem_options;
+    problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    ceres::Problem problem(problem_options);
+    for (int point_id = 0; point_id < num_points; ++point_id) {
+      if (!is_keyframe_point[point_id]) {
+        continue;
+      }
+      const ObservationSpan observations =
+          ba_file->ObservationsForPoint(point_id);
+      bool has_point = false;
+      for (int i = 0; i < observations.size(); ++i) {
+        const Observation obs = observations[i];
+        if (is_keyframe[obs.pose_id]) {
+          continue;
+        }
+        problem.AddResidualBlock(
+            options.create_reprojection_error(*ba_file, obs, &arena),
+            NULL,
+            ba_file->GetIntrinsics(obs.intrinsics_id),
+            ba_file->GetPose(obs.pose_id),
+            ba_file->GetPoint(point_id));
+        has_point = true;
+      }
+      if (has_point) {
+        problem.SetParameterBlockConstant(ba_file->GetPoint(point_id));
+      }
+    }
+    SetIntrinsicsConstant(ba_file, &problem);
+    ceres::Solver::Summary resection_summary;
+    SolveDecoupled(options.solver_options, &problem, &resection_summary);
+    LOG(INFO) << "Resection: " << resection_summary.BriefReport();
+  }
+
+  // 3. Triangulate the other points.
+  {
+    CostFunctionArena arena;
+    ceres::Problem::Options problem_options;
+    problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    ceres::Problem problem(problem_options);
+    for (int point_id = 0; point_id < num_points; ++point_id) {
+      if (is_keyframe_point[point_id]) {
+        continue;
+      }
+      const ObservationSpan observations =
+          ba_file->ObservationsForPoint(point_id);
+      for (int i = 0; i < observations.size(); ++i) {
+        const Observation obs = observations[i];
+        problem.AddResidualBlock(
+            options.create_reprojection_error(*ba_file, obs, &arena),
+            NULL,
+            ba_file->GetIntrinsics(obs.intrinsics_id),
+            ba_file->GetPose(obs.pose_id),
+            ba_file->GetPoint(point_id));
+      }
+    }
+    SetIntrinsicsConstant(ba_file, &problem);
+    for (int pose_id = 0; pose_id < num_poses; ++pose_id) {
+      if (problem.HasParameterBlock(ba_file->GetPose(pose_id))) {
+        problem.SetParameterBlockConstant(ba_file->GetPose(pose_id));
+      }
+    }
+    ceres::Solver::Summary triangulation_summary;
+    SolveDecoupled(options.solver_options, &problem, &triangulation_summary);
+    LOG(INFO) << "Triangulation: " << triangulation_summary.BriefReport();
+  }
+  LOG(INFO) << "Resection and triangulation took "
+            << WallTimeInSeconds() - start_time << " seconds.";
+
+  // 4. The final solve.
+  CostFunctionArena arena;
+  ceres::Problem::Options problem_options;
+  problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  ceres::Problem problem(problem_options);
+  for (int point_id = 0; point_id < num_points; ++point_id) {
+    const ObservationSpan observations =
+        ba_file->ObservationsForPoint(point_id);
+    for (int i = 0; i < observations.size(); ++i) {
+      const Observation obs = observations[i];
+      problem.AddResidualBlock(
+          options.create_reprojection_error(*ba_file, obs, &arena),
+          NULL,
+          ba_file->GetIntrinsics(obs.intrinsics_id),
+          ba_file->GetPose(obs.pose_id),
+          ba_file->GetPoint(point_id));
+    }
+  }
+  ceres::Solver::Options solver_options = options.solver_options;
+  solver_options.max_num_iterations = options.final_num_iterations;
+  ceres::Solve(solver_options, &problem, summary);
+  summary->initial_cost = initial_cost;
+}
+
+}  // namespace openMVG
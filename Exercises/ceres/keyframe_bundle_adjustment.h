@@ -0,0 +1,86 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_KEYFRAME_BUNDLE_ADJUSTMENT_H_
+#define EXERCISES_CERES_KEYFRAME_BUNDLE_ADJUSTMENT_H_
+
+#include "bundle_adjustment.h"
+#include "ceres/ceres.h"
+
+namespace openMVG {
+
+class BAFile;
+
+struct KeyframeOptions {
+  KeyframeOptions()
+      : keyframe_interval(5),
+        final_num_iterations(5),
+        create_reprojection_error(NULL) {}
+
+  // Every keyframe_interval-th pose, in the order of the original pose
+  // ids, is a keyframe, and so is the last one.
+  int keyframe_interval;
+
+  // Maximum number of iterations of the final solve of all the poses
+  // and points.
+  int final_num_iterations;
+
+  // Used for the keyframe problem and the final problem. The
+  // callbacks are only called by the final solve. The resection and
+  // triangulation problems in between are solved silently.
+  ceres::Solver::Options solver_options;
+
+  ReprojectionErrorFactory create_reprojection_error;
+};
+
+// Hierarchical bundle adjustment of ba_file for dense sequences, in
+// which neighboring poses see mostly the same points.
+//
+//  1. The keyframes and the points observed by at least two of them
+//     are bundle adjusted, using the observations of the keyframes
+//     only.
+//
+//  2. Every other pose is moved by the correction of the keyframes
+//     on either side of it, interpolated by its position between
+//     them, and then resected from the points of step 1 with those
+//     points held constant.
+//
+//  3. The remaining points are triangulated with all the poses held
+//     constant.
+//
+//  4. All the poses and points are refined by a full solve of at most
+//     final_num_iterations iterations. Its summary is returned in
+//     summary, except that the initial cost is the reprojection cost
+//     of ba_file before step 1.
+//
+// The intrinsics are held constant in steps 2 and 3 only.
+void SolveWithKeyframes(const KeyframeOptions& options,
+                        BAFile* ba_file,
+                        ceres::Solver::Summary* summary);
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_KEYFRAME_BUNDLE_ADJUSTMENT_H_
@@ -0,0 +1,203 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "linear_solver_planner.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ba_file.h"
+#include "bundle_adjustment.h"
+#include "camera_models.h"
+#include "ceres/ceres.h"
+#include "ceres/version.h"
+#include "glog/logging.h"
+
+namespace openMVG {
+namespace {
+
+// Largest reduced camera matrix for which DENSE_SCHUR is used. Its
+// Cholesky factorization takes n^3 / 3 flops per iteration, which at
+// this size is still only a few seconds.
+const int kMaxDenseSchurSize = 2000;
+
+// The Cholesky factor of the reduced camera matrix of a bundle
+// adjustment problem, with a fill reducing ordering, is typically a
+// few times larger than the matrix itself. This is a rough guess, the
+// actual fill in depends on the visibility structure.
+const int kSparseFillFactor = 4;
+
+double Megabytes(int64_t bytes) {
+  return bytes / (1024.0 * 1024.0);
+}
+
+}  // namespace
+
+void PlanLinearSolver(const BAFile& ba_file,
+                      const int window_size,
+                      const int64_t memory_budget_bytes,
+                      const int num_threads,
+                      ceres::Solver::Options* options,
+                      LinearSolverPlan* plan) {
+  CHECK_GE(num_threads, 1);
+  std::vector<CovisibilityEdge> edges;
+  ba_file.ComputeCovisibilityGraph(&edges);
+
+  // The variables of the problem: all the parameters, or in a local
+  // window only its poses and the points they observe.
+  int64_t num_poses = ba_file.num_poses();
+  int64_t num_points = ba_file.num_points();
+  int64_t num_covisible_pose_pairs = edges.size();
+  int64_t num_intrinsic_parameters = 0;
+  int64_t num_intrinsic_parameters_squared = 0;
+  if (window_size > 0) {
+    std::vector<bool> is_window_pose;
+    ComputeLocalWindowPoses(ba_file, window_size, &is_window_pose);
+    num_poses = std::count(is_window_pose.begin(), is_window_pose.end(),
+                           true);
+    num_points = 0;
+    for (int i = 0; i < ba_file.num_points(); ++i) {
+      const ObservationSpan observations = ba_file.ObservationsForPoint(i);
+      for (int j = 0; j < observations.size(); ++j) {
+        if (is_window_pose[observations.pose_id(j)]) {
+          ++num_points;
+          break;
+        }
+      }
+    }
+    num_covisible_pose_pairs = 0;
+    for (int i = 0; i < edges.size(); ++i) {
+      num_covisible_pose_pairs += is_window_pose[edges[i].pose_id1] &&
+          is_window_pose[edges[i].pose_id2];
+    }
+  } else {
+    for (int i = 0; i < ba_file.num_intrinsics(); ++i) {
+      const int size = NumIntrinsicParameters(ba_file.camera_model(i));
+      num_intrinsic_parameters += size;
+      num_intrinsic_parameters_squared += size * size;
+    }
+  }
+
+  plan->num_poses = num_poses;
+  plan->num_camera_parameters = 6 * num_poses + num_intrinsic_parameters;
+  plan->num_covisible_pose_pairs = num_covisible_pose_pairs;
+  plan->average_covisibility =
+      num_poses > 0 ? 2.0 * num_covisible_pose_pairs / num_poses : 0.0;
+
+  const int64_t n = plan->num_camera_parameters;
+  plan->dense_schur_bytes = 2 * n * n * sizeof(double);
+
+  // The upper triangular blocks of the reduced camera matrix: the
+  // diagonal and covisible pose blocks, and, assuming every intrinsic
+  // is used by points seen from every pose, all the blocks involving
+  // intrinsics.
+  const int64_t num_nonzeros =
+      36 * (num_poses + plan->num_covisible_pose_pairs) +
+      6 * num_poses * num_intrinsic_parameters +
+      (num_intrinsic_parameters * num_intrinsic_parameters +
+       num_intrinsic_parameters_squared) / 2;
+  plan->sparse_schur_bytes =
+      (1 + kSparseFillFactor) * num_nonzeros * sizeof(double);
+
+  // The SCHUR_JACOBI preconditioner and the inverses of the point
+  // blocks used by the implicit Schur complement.
+  plan->iterative_schur_bytes =
+      (36 * num_poses + num_intrinsic_parameters_squared +
+       9 * num_points) * sizeof(double);
+
+  ceres::Solver::Options sparse_options = *options;
+  sparse_options.linear_solver_type = ceres::SPARSE_SCHUR;
+  std::string error;
+  const bool sparse_schur_available = sparse_options.IsValid(&error);
+
+  if (n <= kMaxDenseSchurSize &&
+      plan->dense_schur_bytes <= memory_budget_bytes) {
+    plan->linear_solver_type = ceres::DENSE_SCHUR;
+  } else if (sparse_schur_available &&
+             plan->sparse_schur_bytes <= memory_budget_bytes) {
+    plan->linear_solver_type = ceres::SPARSE_SCHUR;
+  } else {
+    plan->linear_solver_type = ceres::ITERATIVE_SCHUR;
+    plan->preconditioner_type = ceres::SCHUR_JACOBI;
+    if (plan->iterative_schur_bytes > memory_budget_bytes) {
+      LOG(WARNING) << "ITERATIVE_SCHUR is expected to need "
+                   << Megabytes(plan->iterative_schur_bytes)
+                   << " MB, more than the memory budget of "
+                   << Megabytes(memory_budget_bytes) << " MB.";
+    }
+  }
+
+  options->linear_solver_type = plan->linear_solver_type;
+  options->preconditioner_type = plan->preconditioner_type;
+  SetNumThreads(num_threads, options);
+
+  LOG(INFO) << "Linear solver planner: "
+            << num_poses << " poses, "
+            << plan->num_camera_parameters << " camera parameters, "
+            << plan->num_covisible_pose_pairs << " covisible pose pairs, "
+            << "average covisibility " << plan->average_covisibility << ".";
+  LOG(INFO) << "Estimated linear solver memory: "
+            << "DENSE_SCHUR " << Megabytes(plan->dense_schur_bytes) << " MB, "
+            << "SPARSE_SCHUR " << Megabytes(plan->sparse_schur_bytes) << " MB"
+            << (sparse_schur_available ? "" : " (not available)") << ", "
+            << "ITERATIVE_SCHUR " << Megabytes(plan->iterative_schur_bytes)
+            << " MB, budget " << Megabytes(memory_budget_bytes) << " MB.";
+  LOG(INFO) << "Using "
+            << ceres::LinearSolverTypeToString(plan->linear_solver_type)
+            << (plan->linear_solver_type == ceres::ITERATIVE_SCHUR
+                ? std::string(" with ") +
+                  ceres::PreconditionerTypeToString(plan->preconditioner_type)
+                : std::string())
+            << " and " << num_threads << " threads.";
+}
+
+void SetLinearSolver(const BAFile& ba_file,
+                     const int window_size,
+                     const std::string& linear_solver,
+                     const int64_t memory_budget_bytes,
+                     const int num_threads,
+                     ceres::Solver::Options* options) {
+  if (linear_solver == "auto") {
+    LinearSolverPlan plan;
+    PlanLinearSolver(ba_file, window_size, memory_budget_bytes, num_threads,
+                     options, &plan);
+  } else {
+    CHECK(ceres::StringToLinearSolverType(linear_solver,
+                                          &options->linear_solver_type))
+        << "Unknown linear solver: " << linear_solver;
+    SetNumThreads(num_threads, options);
+  }
+}
+
+void SetNumThreads(const int num_threads, ceres::Solver::Options* options) {
+  options->num_threads = num_threads;
+#if CERES_VERSION_MAJOR < 2
+  options->num_linear_solver_threads = num_threads;
+#endif
+}
+
+}  // namespace openMVG
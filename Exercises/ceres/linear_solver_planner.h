@@ -0,0 +1,117 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_LINEAR_SOLVER_PLANNER_H_
+#define EXERCISES_CERES_LINEAR_SOLVER_PLANNER_H_
+
+#include <stdint.h>
+#include <string>
+
+#include "ceres/ceres.h"
+
+namespace openMVG {
+
+class BAFile;
+
+// The visibility structure of a bundle adjustment problem and the
+// memory each of the Schur complement based linear solvers is expected
+// to need for it.
+struct LinearSolverPlan {
+  LinearSolverPlan()
+      : num_poses(0),
+        num_camera_parameters(0),
+        num_covisible_pose_pairs(0),
+        average_covisibility(0.0),
+        dense_schur_bytes(0),
+        sparse_schur_bytes(0),
+        iterative_schur_bytes(0),
+        linear_solver_type(ceres::DENSE_SCHUR),
+        preconditioner_type(ceres::JACOBI) {}
+
+  int num_poses;
+
+  // The size of the reduced camera matrix, i.e., the Schur complement
+  // of the points: the pose parameters plus the intrinsic parameters
+  // of the camera models in use.
+  int num_camera_parameters;
+
+  // The number of pairs of poses which observe at least one point in
+  // common, and the average number of poses a pose shares points with.
+  int num_covisible_pose_pairs;
+  double average_covisibility;
+
+  // Estimated memory used by the linear solver. For DENSE_SCHUR this is
+  // the reduced camera matrix and its Cholesky factor, for SPARSE_SCHUR
+  // its non-zero blocks plus a factor kSparseFillFactor times as large,
+  // and for ITERATIVE_SCHUR the SCHUR_JACOBI preconditioner.
+  int64_t dense_schur_bytes;
+  int64_t sparse_schur_bytes;
+  int64_t iterative_schur_bytes;
+
+  ceres::LinearSolverType linear_solver_type;
+  ceres::PreconditionerType preconditioner_type;
+};
+
+// Estimate the structure of the reduced camera matrix of ba_file, or if
+// window_size is positive of the local window problem built by
+// BuildProblem, in which only the window poses and the points they
+// observe vary, and choose the linear solver in the order
+//
+//   DENSE_SCHUR, if the reduced camera matrix is small enough for the
+//     cubic cost of a dense factorization to be negligible and fits in
+//     memory_budget_bytes,
+//   SPARSE_SCHUR, if Ceres was built with a sparse linear algebra
+//     library and the estimate fits in memory_budget_bytes,
+//   ITERATIVE_SCHUR with the SCHUR_JACOBI preconditioner otherwise,
+//     with a warning if even it does not fit in memory_budget_bytes.
+//
+// options is updated with the choice, and its threads are set with
+// SetNumThreads. The estimates and the choice are logged.
+void PlanLinearSolver(const BAFile& ba_file,
+                      int window_size,
+                      int64_t memory_budget_bytes,
+                      int num_threads,
+                      ceres::Solver::Options* options,
+                      LinearSolverPlan* plan);
+
+// Set the linear solver of options to linear_solver, the name of a
+// Ceres linear solver, e.g., "dense_schur", or if it is "auto" to the
+// one chosen by PlanLinearSolver with window_size and
+// memory_budget_bytes, and its threads to num_threads.
+void SetLinearSolver(const BAFile& ba_file,
+                     int window_size,
+                     const std::string& linear_solver,
+                     int64_t memory_budget_bytes,
+                     int num_threads,
+                     ceres::Solver::Options* options);
+
+// Set the number of threads used by the solver. Versions of Ceres
+// before 2.0 also have num_linear_solver_threads, which is set too.
+void SetNumThreads(int num_threads, ceres::Solver::Options* options);
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_LINEAR_SOLVER_PLANNER_H_
@@ -0,0 +1,64 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_MAPPED_FILE_H_
+#define EXERCISES_CERES_MAPPED_FILE_H_
+
+#include <stddef.h>
+#include <string>
+
+namespace openMVG {
+
+// A private memory mapping of the entire contents of a file.
+//
+// The mapping is copy-on-write, so the contents can be modified
+// through mutable_data() without the changes ever being written back
+// to the file.
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+
+  // Map the contents of filename into memory, replacing any existing
+  // mapping. Returns false if the file could not be opened or mapped.
+  bool Open(const std::string& filename);
+  void Close();
+
+  const char* data() const { return data_; }
+  char* mutable_data() { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  MappedFile(const MappedFile&);
+  void operator=(const MappedFile&);
+
+  char* data_;
+  size_t size_;
+};
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_MAPPED_FILE_H_
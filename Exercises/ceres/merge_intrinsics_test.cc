@@ -0,0 +1,237 @@
+// Ceres Solver - A fast non-linear least squares minimizer
+// Copyright 2015 Google Inc. All rights reserved.
+// http://ceres-solver.org/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Writes a reconstruction whose intrinsics are identical, equal within
+// a tolerance, or different, and exits with a non-zero status unless
+// MergeIntrinsics, called directly or through
+// Options::merge_intrinsics_tolerance on a text or binary BAF file,
+// keeps the expected intrinsics and remaps the observations to them.
+//
+// Usage: merge_intrinsics_test [--logtostderr]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ba_file.h"
+#include "camera_models.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+namespace openMVG {
+namespace {
+
+const char kTextFilename[] = "merge_intrinsics_test.baf";
+const char kBinaryFilename[] = "merge_intrinsics_test.bafb";
+const double kTolerance = 1e-6;
+
+// The intrinsics of the test file. With kTolerance, 2 and 5 match 0,
+// and 4 is identical to 1. 3 differs from 0 by 1e-3 in k1 only.
+const int kNumIntrinsics = 6;
+const char* kIntrinsics[kNumIntrinsics] = {
+  "1000 320 240 0.1 0.01 0",
+  "1200 320 240 0.1 0.01 0",
+  "1000 320.0001 240 0.1 0.01 0",
+  "1000 320 240 0.101 0.01 0",
+  "1200 320 240 0.1 0.01 0",
+  "1000 320 240 0.1000000005 0.01 0"
+};
+
+double RandomDouble(const double min, const double max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+void WriteTestFile() {
+  const int num_poses = 10;
+  const int num_points = 1000;
+  std::ofstream of(kTextFilename);
+  CHECK(of.good()) << "Unable to open file: " << kTextFilename;
+  of.precision(17);
+  of << kNumIntrinsics << "\n" << num_poses << "\n" << num_points << "\n";
+  for (int i = 0; i < kNumIntrinsics; ++i) {
+    of << kIntrinsics[i] << "\n";
+  }
+  for (int i = 0; i < num_poses; ++i) {
+    of << "1 0 0 0 1 0 0 0 1 " << RandomDouble(-10.0, 10.0) << " "
+       << RandomDouble(-10.0, 10.0) << " " << RandomDouble(-10.0, 10.0)
+       << "\n";
+  }
+  for (int i = 0; i < num_points; ++i) {
+    const int num_observations = 1 + rand() % 5;
+    of << RandomDouble(-100.0, 100.0) << " " << RandomDouble(-100.0, 100.0)
+       << " " << RandomDouble(-100.0, 100.0) << " " << num_observations;
+    for (int j = 0; j < num_observations; ++j) {
+      of << " " << rand() % kNumIntrinsics << " " << rand() % num_poses
+         << " " << RandomDouble(0.0, 640.0) << " "
+         << RandomDouble(0.0, 480.0);
+    }
+    of << "\n";
+  }
+  CHECK(of.good()) << "Error writing to file: " << kTextFilename;
+}
+
+// Returns the number of failures. new_intrinsics_ids maps the
+// intrinsics of original to those of merged, whose parameters must be
+// those of the first original intrinsic mapped to them.
+int CheckMerge(const std::string& name,
+               const BAFile& original,
+               const BAFile& merged,
+               const std::vector<int>& new_intrinsics_ids) {
+  const int num_intrinsics =
+      *std::max_element(new_intrinsics_ids.begin(),
+                        new_intrinsics_ids.end()) + 1;
+  int num_failures = 0;
+  if (merged.num_intrinsics() != num_intrinsics) {
+    LOG(ERROR) << name << ": " << merged.num_intrinsics()
+               << " intrinsics instead of " << num_intrinsics;
+    return 1;
+  }
+
+  std::vector<bool> is_checked(num_intrinsics, false);
+  for (int i = 0; i < original.num_intrinsics(); ++i) {
+    const int new_id = new_intrinsics_ids[i];
+    if (is_checked[new_id]) {
+      continue;
+    }
+    is_checked[new_id] = true;
+    if (!std::equal(original.GetIntrinsics(i),
+                    original.GetIntrinsics(i) + kMaxNumIntrinsicParameters,
+                    merged.GetIntrinsics(new_id)) ||
+        original.camera_model(i) != merged.camera_model(new_id)) {
+      LOG(ERROR) << name << ": intrinsics " << new_id << " are not "
+                 << "intrinsics " << i << " of the original file.";
+      ++num_failures;
+    }
+  }
+
+  CHECK_EQ(merged.num_observations(), original.num_observations());
+  int num_wrong_observations = 0;
+  for (int i = 0; i < merged.num_observations(); ++i) {
+    const Observation m = merged.GetObservation(i);
+    const Observation o = original.GetObservation(i);
+    num_wrong_observations +=
+        m.intrinsics_id != new_intrinsics_ids[o.intrinsics_id] ||
+        m.pose_id != o.pose_id || m.x != o.x || m.y != o.y;
+  }
+  if (num_wrong_observations > 0) {
+    LOG(ERROR) << name << ": " << num_wrong_observations
+               << " observations are not remapped.";
+  }
+  num_failures += num_wrong_observations;
+  if (num_failures == 0) {
+    LOG(INFO) << name << ": passed.";
+  }
+  return num_failures;
+}
+
+int CheckNumMerged(const std::string& name,
+                   const int num_merged,
+                   const int expected_num_merged) {
+  if (num_merged != expected_num_merged) {
+    LOG(ERROR) << name << ": merged " << num_merged << " intrinsics "
+               << "instead of " << expected_num_merged;
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace openMVG
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  using openMVG::BAFile;
+  using openMVG::kTolerance;
+  srand(5);
+  openMVG::WriteTestFile();
+  const BAFile original(openMVG::kTextFilename);
+  original.WriteToBinaryBAFFile(openMVG::kBinaryFilename);
+
+  const int kMergedIds[] = { 0, 1, 0, 2, 1, 0 };
+  const std::vector<int> merged_ids(kMergedIds, kMergedIds + 6);
+  const int kIdenticalIds[] = { 0, 1, 2, 3, 1, 4 };
+  const std::vector<int> identical_ids(kIdenticalIds, kIdenticalIds + 6);
+  const int kBrownIds[] = { 0, 1, 0, 2, 3, 0 };
+  const std::vector<int> brown_ids(kBrownIds, kBrownIds + 6);
+
+  int num_failures = 0;
+  {
+    BAFile merged(openMVG::kTextFilename);
+    num_failures += openMVG::CheckNumMerged(
+        "MergeIntrinsics", merged.MergeIntrinsics(kTolerance), 3);
+    num_failures += openMVG::CheckMerge("MergeIntrinsics", original, merged,
+                                        merged_ids);
+    num_failures += openMVG::CheckNumMerged(
+        "MergeIntrinsics again", merged.MergeIntrinsics(kTolerance), 0);
+  }
+  {
+    BAFile merged(openMVG::kTextFilename);
+    num_failures += openMVG::CheckNumMerged(
+        "Zero tolerance", merged.MergeIntrinsics(0.0), 1);
+    num_failures += openMVG::CheckMerge("Zero tolerance", original, merged,
+                                        identical_ids);
+  }
+  {
+    // Intrinsics of different camera models are never merged.
+    BAFile brown(openMVG::kTextFilename);
+    brown.SetCameraModel(4, openMVG::BROWN_T2);
+    BAFile merged(openMVG::kTextFilename);
+    merged.SetCameraModel(4, openMVG::BROWN_T2);
+    num_failures += openMVG::CheckNumMerged(
+        "Camera models", merged.MergeIntrinsics(kTolerance), 2);
+    num_failures += openMVG::CheckMerge("Camera models", brown, merged,
+                                        brown_ids);
+  }
+
+  BAFile::Options options;
+  options.merge_intrinsics_tolerance = kTolerance;
+  {
+    const BAFile merged(openMVG::kTextFilename, options);
+    num_failures += openMVG::CheckMerge("Text file with tolerance", original,
+                                        merged, merged_ids);
+  }
+  {
+    const BAFile merged(openMVG::kBinaryFilename, options);
+    num_failures += openMVG::CheckMerge("Binary file with tolerance",
+                                        original, merged, merged_ids);
+  }
+  remove(openMVG::kTextFilename);
+  remove(openMVG::kBinaryFilename);
+
+  if (num_failures > 0) {
+    LOG(ERROR) << num_failures << " checks failed.";
+    return 1;
+  }
+  LOG(INFO) << "All intrinsics were merged as expected.";
+  return 0;
+}
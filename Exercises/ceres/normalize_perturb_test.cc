@@ -0,0 +1,137 @@
+// Ceres Solver - A fast non-linear least squares minimizer
+// Copyright 2015 Google Inc. All rights reserved.
+// http://ceres-solver.org/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Normalizes and perturbs a random reconstruction using different
+// numbers of threads, and exits with a non-zero status unless the
+// results are bit for bit the same as with a single thread. There are
+// enough points for Normalize to compute its medians in parallel.
+//
+// Usage: normalize_perturb_test [--logtostderr]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+
+#include "ba_file.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+namespace openMVG {
+namespace {
+
+const char kFilename[] = "normalize_perturb_test.baf";
+const unsigned int kRandomSeed = 38401;
+
+double RandomDouble(const double min, const double max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+void WriteTestFile() {
+  const int num_poses = 10;
+  const int num_points = 70000;
+  std::ofstream of(kFilename);
+  CHECK(of.good()) << "Unable to open file: " << kFilename;
+  of.precision(17);
+  of << "1\n" << num_poses << "\n" << num_points << "\n";
+  of << "1000 320 240 0 0 0\n";
+  for (int i = 0; i < num_poses; ++i) {
+    of << "1 0 0 0 1 0 0 0 1 " << RandomDouble(-10.0, 10.0) << " "
+       << RandomDouble(-10.0, 10.0) << " " << RandomDouble(-10.0, 10.0)
+       << "\n";
+  }
+  for (int i = 0; i < num_points; ++i) {
+    of << RandomDouble(-100.0, 100.0) << " " << RandomDouble(-100.0, 100.0)
+       << " " << RandomDouble(-100.0, 100.0) << " 1 0 " << i % num_poses
+       << " " << RandomDouble(0.0, 640.0) << " "
+       << RandomDouble(0.0, 480.0) << "\n";
+  }
+  CHECK(of.good()) << "Error writing to file: " << kFilename;
+}
+
+// Returns true if the poses and points of a and b are identical.
+bool IsIdentical(const BAFile& a, const BAFile& b) {
+  return memcmp(a.GetPose(0), b.GetPose(0),
+                6 * a.num_poses() * sizeof(double)) == 0 &&
+      memcmp(a.GetPoint(0), b.GetPoint(0),
+             3 * a.num_points() * sizeof(double)) == 0;
+}
+
+}  // namespace
+}  // namespace openMVG
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  srand(5);
+  openMVG::WriteTestFile();
+  openMVG::BAFile expected(openMVG::kFilename);
+  expected.Normalize();
+  openMVG::BAFile normalized(openMVG::kFilename);
+  normalized.Normalize();
+  expected.Perturb(0.1, 0.5, 0.5, openMVG::kRandomSeed);
+
+  int num_failures = 0;
+  const int kNumThreads[] = {2, 3, 8};
+  for (int i = 0; i < sizeof(kNumThreads) / sizeof(kNumThreads[0]); ++i) {
+    openMVG::BAFile::Options options;
+    options.num_threads = kNumThreads[i];
+    openMVG::BAFile actual(openMVG::kFilename, options);
+    actual.Normalize();
+    if (!openMVG::IsIdentical(normalized, actual)) {
+      LOG(ERROR) << "Normalize with " << kNumThreads[i] << " threads "
+                 << "differs from Normalize with one thread.";
+      ++num_failures;
+    }
+    actual.Perturb(0.1, 0.5, 0.5, openMVG::kRandomSeed);
+    if (!openMVG::IsIdentical(expected, actual)) {
+      LOG(ERROR) << "Perturb with " << kNumThreads[i] << " threads "
+                 << "differs from Perturb with one thread.";
+      ++num_failures;
+    }
+  }
+
+  // A different seed must perturb the reconstruction differently.
+  openMVG::BAFile other_seed(openMVG::kFilename);
+  other_seed.Normalize();
+  other_seed.Perturb(0.1, 0.5, 0.5, openMVG::kRandomSeed + 1);
+  if (openMVG::IsIdentical(expected, other_seed)) {
+    LOG(ERROR) << "Perturb ignores its random seed.";
+    ++num_failures;
+  }
+  remove(openMVG::kFilename);
+
+  if (num_failures > 0) {
+    LOG(ERROR) << num_failures << " checks failed.";
+    return 1;
+  }
+  LOG(INFO) << "Normalize and Perturb do not depend on the number of "
+            << "threads.";
+  return 0;
+}
@@ -0,0 +1,633 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "pose_graph_compression.h"
+
+#include <math.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "Eigen/Core"
+#include "Eigen/Eigenvalues"
+#include "ba_file.h"
+#include "bundle_adjustment.h"
+#include "camera_models.h"
+#include "ceres/ceres.h"
+#include "ceres/rotation.h"
+#include "cost_function_arena.h"
+#include "glog/logging.h"
+#include "linear_solver_planner.h"
+#include "reprojection_statistics.h"
+#include "wall_time.h"
+
+namespace openMVG {
+namespace {
+
+// Number of points re-triangulated by each of the problems solved
+// after the pose graph.
+const int kNumPointsPerChunk = 1024;
+
+// The constraint that pose 2 is where the measured relative pose puts
+// it given pose 1. The relative pose is the rotation R_2 R_1^T, as an
+// angle-axis vector, and the center of pose 2 in the frame of pose 1.
+struct RelativePose {
+  int pose_id1;
+  int pose_id2;
+  double rotation[3];
+  double center[3];
+
+  // Row major square root of the information of the error of pose 2
+  // given pose 1, see RelativePoseError.
+  double sqrt_information[36];
+};
+
+// The error of a RelativePose, weighted by its square root information.
+//
+// The rotation error is log(R_2 (R_rel R_1)^T), the rotation taking
+// the prediction of pose 2 to pose 2 as an angle-axis vector, which is
+// continuous wherever the poses are consistent, unlike the difference
+// of the angle-axis vectors, which jumps by 2 pi where the axis flips
+// at a rotation angle of pi. The center error is the difference
+// between the center of pose 2 and its prediction.
+class RelativePoseError {
+ public:
+  explicit RelativePoseError(const RelativePose& relative_pose)
+      : relative_pose_(relative_pose) {
+    ceres::AngleAxisToRotationMatrix(relative_pose.rotation,
+                                     relative_rotation_);
+  }
+
+  template <typename T> bool operator()(const T* const pose1,
+                                        const T* const pose2,
+                                        T* residuals) const {
+    // Column major rotation matrices.
+    T rotation1[9];
+    ceres::AngleAxisToRotationMatrix(pose1, rotation1);
+    T predicted_rotation[9];
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        predicted_rotation[i + 3 * j] = T(0.0);
+        for (int k = 0; k < 3; ++k) {
+          predicted_rotation[i + 3 * j] +=
+              T(relative_rotation_[i + 3 * k]) * rotation1[k + 3 * j];
+        }
+      }
+    }
+
+    T rotation2[9];
+    ceres::AngleAxisToRotationMatrix(pose2, rotation2);
+    T rotation_error[9];
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        rotation_error[i + 3 * j] = T(0.0);
+        for (int k = 0; k < 3; ++k) {
+          rotation_error[i + 3 * j] +=
+              rotation2[i + 3 * k] * predicted_rotation[j + 3 * k];
+        }
+      }
+    }
+
+    T error[6];
+    ceres::RotationMatrixToAngleAxis(rotation_error, error);
+    for (int i = 0; i < 3; ++i) {
+      T predicted_center = pose1[3 + i];
+      for (int k = 0; k < 3; ++k) {
+        predicted_center +=
+            rotation1[k + 3 * i] * T(relative_pose_.center[k]);
+      }
+      error[3 + i] = pose2[3 + i] - predicted_center;
+    }
+
+    for (int i = 0; i < 6; ++i) {
+      residuals[i] = T(0.0);
+      for (int j = 0; j < 6; ++j) {
+        residuals[i] +=
+            T(relative_pose_.sqrt_information[6 * i + j]) * error[j];
+      }
+    }
+    return true;
+  }
+
+ private:
+  RelativePose relative_pose_;
+  double relative_rotation_[9];
+};
+
+// The left Jacobian of the exponential map of SO(3) at angle_axis,
+// i.e., exp(angle_axis + delta) = exp(J delta) exp(angle_axis) to first
+// order in delta, with Taylor series for small angles.
+Eigen::Matrix3d LeftJacobian(const double* angle_axis) {
+  const Eigen::Map<const Eigen::Vector3d> w(angle_axis);
+  const double theta2 = w.squaredNorm();
+  double a;
+  double b;
+  if (theta2 > 1e-4) {
+    const double theta = sqrt(theta2);
+    a = (1.0 - cos(theta)) / theta2;
+    b = (theta - sin(theta)) / (theta2 * theta);
+  } else {
+    a = 0.5 - theta2 / 24.0;
+    b = 1.0 / 6.0 - theta2 / 120.0;
+  }
+  Eigen::Matrix3d w_cross;
+  w_cross << 0.0, -w(2), w(1),
+             w(2), 0.0, -w(0),
+             -w(1), w(0), 0.0;
+  return Eigen::Matrix3d::Identity() + a * w_cross + b * w_cross * w_cross;
+}
+
+// Holds the distance between the center of a pose and a fixed center
+// near its initial value.
+class BaselinePrior {
+ public:
+  BaselinePrior(const double* center, const double length,
+                const double weight)
+      : length_(length), weight_(weight) {
+    std::copy(center, center + 3, center_);
+  }
+
+  template <typename T> bool operator()(const T* const pose,
+                                        T* residuals) const {
+    const T dx = pose[3] - T(center_[0]);
+    const T dy = pose[4] - T(center_[1]);
+    const T dz = pose[5] - T(center_[2]);
+    residuals[0] = T(weight_) * (sqrt(dx * dx + dy * dy + dz * dz) -
+                                 T(length_));
+    return true;
+  }
+
+ private:
+  double center_[3];
+  double length_;
+  double weight_;
+};
+
+// An observation of the same point from two poses.
+struct SharedObservation {
+  int point_id;
+  int observation_id1;
+  int observation_id2;
+};
+
+void FindSharedObservations(const BAFile& ba_file,
+                            const int pose_id1,
+                            const int pose_id2,
+                            std::vector<SharedObservation>* shared) {
+  const int* point_ids1 = ba_file.PointIdsForPose(pose_id1);
+  const int* point_ids2 = ba_file.PointIdsForPose(pose_id2);
+  const int* observation_ids1 = ba_file.ObservationIdsForPose(pose_id1);
+  const int* observation_ids2 = ba_file.ObservationIdsForPose(pose_id2);
+  const int size1 = ba_file.NumObservationsForPose(pose_id1);
+  const int size2 = ba_file.NumObservationsForPose(pose_id2);
+  shared->clear();
+  for (int i = 0, j = 0; i < size1 && j < size2; ) {
+    if (point_ids1[i] < point_ids2[j]) {
+      ++i;
+    } else if (point_ids2[j] < point_ids1[i]) {
+      ++j;
+    } else {
+      SharedObservation observation;
+      observation.point_id = point_ids1[i];
+      observation.observation_id1 = observation_ids1[i];
+      observation.observation_id2 = observation_ids2[j];
+      shared->push_back(observation);
+      ++i;
+      ++j;
+    }
+  }
+}
+
+// Keep the edges of the covisibility graph which are among the
+// max_edges_per_pose strongest ones of either of their poses.
+void SelectEdges(const PoseGraphOptions& options,
+                 const BAFile& ba_file,
+                 std::vector<CovisibilityEdge>* selected_edges) {
+  std::vector<CovisibilityEdge> edges;
+  ba_file.ComputeCovisibilityGraph(&edges);
+  std::vector<std::vector<std::pair<int, int> > > pose_edges(
+      ba_file.num_poses());
+  for (int i = 0; i < edges.size(); ++i) {
+    const CovisibilityEdge& edge = edges[i];
+    if (edge.num_shared_points < options.min_shared_points) {
+      continue;
+    }
+    pose_edges[edge.pose_id1].push_back(
+        std::make_pair(-edge.num_shared_points, i));
+    pose_edges[edge.pose_id2].push_back(
+        std::make_pair(-edge.num_shared_points, i));
+  }
+
+  std::vector<bool> is_selected(edges.size(), false);
+  for (int pose_id = 0; pose_id < ba_file.num_poses(); ++pose_id) {
+    std::vector<std::pair<int, int> >& strongest = pose_edges[pose_id];
+    std::sort(strongest.begin(), strongest.end());
+    const int num_edges =
+        std::min<int>(strongest.size(), options.max_edges_per_pose);
+    for (int i = 0; i < num_edges; ++i) {
+      is_selected[strongest[i].second] = true;
+    }
+  }
+
+  selected_edges->clear();
+  for (int i = 0; i < edges.size(); ++i) {
+    if (is_selected[i]) {
+      selected_edges->push_back(edges[i]);
+    }
+  }
+}
+
+// Refine pose_id2 relative to pose_id1 from the points both poses
+// observe, and marginalize the points. Returns false if the baseline
+// is degenerate or the points do not constrain the pose.
+bool ComputeRelativePose(const PoseGraphOptions& options,
+                         const CovisibilityEdge& edge,
+                         BAFile* ba_file,
+                         RelativePose* relative_pose) {
+  std::vector<SharedObservation> shared;
+  FindSharedObservations(*ba_file, edge.pose_id1, edge.pose_id2, &shared);
+  const int num_points = shared.size();
+
+  // The problem works on copies, so that the edges can be computed
+  // concurrently.
+  double pose1[6];
+  double pose2[6];
+  std::copy(ba_file->GetPose(edge.pose_id1),
+            ba_file->GetPose(edge.pose_id1) + 6,
+            pose1);
+  std::copy(ba_file->GetPose(edge.pose_id2),
+            ba_file->GetPose(edge.pose_id2) + 6,
+            pose2);
+  std::vector<double> points(3 * num_points);
+  for (int i = 0; i < num_points; ++i) {
+    const double* point = ba_file->GetPoint(shared[i].point_id);
+    std::copy(point, point + 3, &points[3 * i]);
+  }
+  const double baseline =
+      sqrt((pose2[3] - pose1[3]) * (pose2[3] - pose1[3]) +
+           (pose2[4] - pose1[4]) * (pose2[4] - pose1[4]) +
+           (pose2[5] - pose1[5]) * (pose2[5] - pose1[5]));
+  if (num_points == 0 || baseline <= 0.0) {
+    return false;
+  }
+
+  CostFunctionArena arena;
+  ceres::Problem::Options problem_options;
+  problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  ceres::Problem problem(problem_options);
+  ceres::Problem::EvaluateOptions evaluate_options;
+  for (int i = 0; i < num_points; ++i) {
+    const Observation obs1 =
+        ba_file->GetObservation(shared[i].observation_id1);
+    const Observation obs2 =
+        ba_file->GetObservation(shared[i].observation_id2);
+    evaluate_options.residual_blocks.push_back(problem.AddResidualBlock(
+        options.create_reprojection_error(*ba_file, obs1, &arena),
+        NULL,
+        ba_file->GetIntrinsics(obs1.intrinsics_id),
+        pose1,
+        &points[3 * i]));
+    evaluate_options.residual_blocks.push_back(problem.AddResidualBlock(
+        options.create_reprojection_error(*ba_file, obs2, &arena),
+        NULL,
+        ba_file->GetIntrinsics(obs2.intrinsics_id),
+        pose2,
+        &points[3 * i]));
+    problem.SetParameterBlockConstant(
+        ba_file->GetIntrinsics(obs1.intrinsics_id));
+    problem.SetParameterBlockConstant(
+        ba_file->GetIntrinsics(obs2.intrinsics_id));
+  }
+  problem.SetParameterBlockConstant(pose1);
+
+  // A relative change of the baseline by one over the focal length
+  // costs as much as a pixel of reprojection error in every shared
+  // point. The prior only fixes the scale of this problem, and is left
+  // out of the information below: two views do not determine the
+  // length of their baseline, which is left to the pose graph.
+  const Observation obs2 = ba_file->GetObservation(shared[0].observation_id2);
+  const double focal_length =
+      ba_file->GetIntrinsics(obs2.intrinsics_id)[OFFSET_FOCAL_LENGTH];
+  const double weight = sqrt(static_cast<double>(num_points)) *
+      focal_length / baseline;
+  problem.AddResidualBlock(
+      new ceres::AutoDiffCostFunction<BaselinePrior, 1, 6>(
+          new BaselinePrior(pose1 + 3, baseline, weight)),
+      NULL,
+      pose2);
+
+  ceres::Solver::Options solver_options;
+  solver_options.linear_solver_type = ceres::DENSE_SCHUR;
+  solver_options.logging_type = ceres::SILENT;
+  ceres::Solver::Summary summary;
+  ceres::Solve(solver_options, &problem, &summary);
+  if (!summary.IsSolutionUsable()) {
+    return false;
+  }
+
+  // The Jacobian of the reprojection errors with respect to pose 2, in
+  // columns [0, 6), and the points, in columns [6 + 3 i, 9 + 3 i).
+  // Every row depends on at most one point.
+  evaluate_options.parameter_blocks.push_back(pose2);
+  for (int i = 0; i < num_points; ++i) {
+    evaluate_options.parameter_blocks.push_back(&points[3 * i]);
+  }
+  ceres::CRSMatrix jacobian;
+  problem.Evaluate(evaluate_options, NULL, NULL, NULL, &jacobian);
+
+  Eigen::Matrix<double, 6, 6> pose_pose = Eigen::Matrix<double, 6, 6>::Zero();
+  Eigen::MatrixXd pose_point = Eigen::MatrixXd::Zero(6, 3 * num_points);
+  Eigen::MatrixXd point_point = Eigen::MatrixXd::Zero(3, 3 * num_points);
+  for (int row = 0; row < jacobian.num_rows; ++row) {
+    Eigen::Matrix<double, 6, 1> pose_row = Eigen::Matrix<double, 6, 1>::Zero();
+    Eigen::Vector3d point_row = Eigen::Vector3d::Zero();
+    int point = -1;
+    for (int k = jacobian.rows[row]; k < jacobian.rows[row + 1]; ++k) {
+      const int col = jacobian.cols[k];
+      if (col < 6) {
+        pose_row(col) = jacobian.values[k];
+      } else {
+        point = (col - 6) / 3;
+        point_row((col - 6) % 3) = jacobian.values[k];
+      }
+    }
+    pose_pose += pose_row * pose_row.transpose();
+    if (point >= 0) {
+      pose_point.block<6, 3>(0, 3 * point) +=
+          pose_row * point_row.transpose();
+      point_point.block<3, 3>(0, 3 * point) +=
+          point_row * point_row.transpose();
+    }
+  }
+
+  Eigen::Matrix<double, 6, 6> information = pose_pose;
+  for (int i = 0; i < num_points; ++i) {
+    const Eigen::Matrix3d block = point_point.block<3, 3>(0, 3 * i);
+    if (block.determinant() <= 0.0) {
+      continue;
+    }
+    const Eigen::Matrix<double, 6, 3> coupling =
+        pose_point.block<6, 3>(0, 3 * i);
+    information -= coupling * block.inverse() * coupling.transpose();
+  }
+
+  // The Schur complement is positive semi-definite up to round off,
+  // which the square root drops.
+  const Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 6, 6> > eigen(
+      0.5 * (information + information.transpose()));
+  if (eigen.eigenvalues().maxCoeff() <= 0.0) {
+    return false;
+  }
+  Eigen::Matrix<double, 6, 6> sqrt_information =
+      eigen.eigenvalues().cwiseMax(0.0).cwiseSqrt().asDiagonal() *
+      eigen.eigenvectors().transpose();
+
+  // The information is with respect to the parameters of pose 2. Near
+  // the solution the rotation error of RelativePoseError changes by
+  // J delta when the angle-axis vector of pose 2 changes by delta, J
+  // being the left Jacobian, so in terms of the error the square root
+  // information is multiplied by J^-1 on the right.
+  sqrt_information.leftCols<3>() =
+      sqrt_information.leftCols<3>() * LeftJacobian(pose2).inverse();
+
+  double rotation1[9];
+  double rotation2[9];
+  ceres::AngleAxisToRotationMatrix(pose1, rotation1);
+  ceres::AngleAxisToRotationMatrix(pose2, rotation2);
+  const Eigen::Map<const Eigen::Matrix3d> r1(rotation1);
+  const Eigen::Map<const Eigen::Matrix3d> r2(rotation2);
+  const Eigen::Matrix3d relative_rotation = r2 * r1.transpose();
+  const Eigen::Map<const Eigen::Vector3d> center1(pose1 + 3);
+  const Eigen::Map<const Eigen::Vector3d> center2(pose2 + 3);
+  const Eigen::Vector3d relative_center = r1 * (center2 - center1);
+
+  relative_pose->pose_id1 = edge.pose_id1;
+  relative_pose->pose_id2 = edge.pose_id2;
+  ceres::RotationMatrixToAngleAxis(relative_rotation.data(),
+                                   relative_pose->rotation);
+  std::copy(relative_center.data(), relative_center.data() + 3,
+            relative_pose->center);
+  for (int i = 0; i < 6; ++i) {
+    for (int j = 0; j < 6; ++j) {
+      relative_pose->sqrt_information[6 * i + j] = sqrt_information(i, j);
+    }
+  }
+  return true;
+}
+
+// The pose graph has no points to eliminate, so it is solved with
+// the normal equations directly. Its gauge is fixed by holding the
+// first pose constant and, since no relative pose constrains the length
+// of its baseline, the distance from the first pose to one of its
+// neighbors near its initial value.
+void SolvePoseGraph(const PoseGraphOptions& options,
+                    const std::vector<RelativePose>& relative_poses,
+                    BAFile* ba_file,
+                    ceres::Solver::Summary* summary) {
+  ceres::Problem problem;
+  int first_pose_id = -1;
+  for (int i = 0; i < relative_poses.size(); ++i) {
+    const RelativePose& relative_pose = relative_poses[i];
+    problem.AddResidualBlock(
+        new ceres::AutoDiffCostFunction<RelativePoseError, 6, 6, 6>(
+            new RelativePoseError(relative_pose)),
+        NULL,
+        ba_file->GetPose(relative_pose.pose_id1),
+        ba_file->GetPose(relative_pose.pose_id2));
+    const int pose_id = std::min(relative_pose.pose_id1,
+                                 relative_pose.pose_id2);
+    if (first_pose_id < 0 ||
+        ba_file->OriginalPoseId(pose_id) <
+            ba_file->OriginalPoseId(first_pose_id)) {
+      first_pose_id = pose_id;
+    }
+  }
+  if (first_pose_id < 0) {
+    return;
+  }
+  double* first_pose = ba_file->GetPose(first_pose_id);
+  problem.SetParameterBlockConstant(first_pose);
+
+  // The prior is as stiff as the relative pose of the neighbor is in
+  // its center.
+  for (int i = 0; i < relative_poses.size(); ++i) {
+    const RelativePose& relative_pose = relative_poses[i];
+    if (relative_pose.pose_id1 != first_pose_id &&
+        relative_pose.pose_id2 != first_pose_id) {
+      continue;
+    }
+    double* neighbor_pose = ba_file->GetPose(
+        relative_pose.pose_id1 == first_pose_id ? relative_pose.pose_id2
+                                                : relative_pose.pose_id1);
+    const Eigen::Map<const Eigen::Vector3d> first_center(first_pose + 3);
+    const Eigen::Map<const Eigen::Vector3d> neighbor_center(
+        neighbor_pose + 3);
+    const Eigen::Map<const Eigen::Matrix<double, 6, 6, Eigen::RowMajor> >
+        sqrt_information(relative_pose.sqrt_information);
+    problem.AddResidualBlock(
+        new ceres::AutoDiffCostFunction<BaselinePrior, 1, 6>(
+            new BaselinePrior(first_pose + 3,
+                              (neighbor_center - first_center).norm(),
+                              sqrt_information.rightCols<3>().norm())),
+        NULL,
+        neighbor_pose);
+    break;
+  }
+
+  ceres::Solver::Options solver_options = options.solver_options;
+  solver_options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+  solver_options.linear_solver_ordering.reset();
+  std::string error;
+  if (!solver_options.IsValid(&error)) {
+    solver_options.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY;
+  }
+  LOG(INFO) << "Pose graph: " << problem.NumParameterBlocks() << " poses, "
+            << relative_poses.size() << " relative poses.";
+  ceres::Solve(solver_options, &problem, summary);
+}
+
+// Re-triangulate the points in [begin_point, end_point) with the
+// intrinsics and poses held constant. Returns the reprojection costs of
+// their observations before and after in summary.
+void RetriangulateChunk(const PoseGraphOptions& options,
+                        const int begin_point,
+                        const int end_point,
+                        BAFile* ba_file,
+                        ceres::Solver::Summary* summary) {
+  CostFunctionArena arena;
+  ceres::Problem::Options problem_options;
+  problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  ceres::Problem problem(problem_options);
+  for (int point_id = begin_point; point_id < end_point; ++point_id) {
+    const ObservationSpan observations =
+        ba_file->ObservationsForPoint(point_id);
+    for (int i = 0; i < observations.size(); ++i) {
+      const Observation obs = observations[i];
+      double* intrinsics = ba_file->GetIntrinsics(obs.intrinsics_id);
+      double* pose = ba_file->GetPose(obs.pose_id);
+      problem.AddResidualBlock(
+          options.create_reprojection_error(*ba_file, obs, &arena),
+          NULL,
+          intrinsics,
+          pose,
+          ba_file->GetPoint(point_id));
+      problem.SetParameterBlockConstant(intrinsics);
+      problem.SetParameterBlockConstant(pose);
+    }
+  }
+
+  // The chunks are solved concurrently, one per thread.
+  ceres::Solver::Options solver_options = options.solver_options;
+  SetNumThreads(1, &solver_options);
+  SolveDecoupled(solver_options, &problem, summary);
+}
+
+// With the poses constant the points are independent of each other, so
+// they are re-triangulated in chunks of kNumPointsPerChunk points,
+// concurrently. Only one small problem per thread exists at any time,
+// instead of one holding every observation. Returns the reprojection
+// cost of all the observations after the re-triangulation.
+double Retriangulate(const PoseGraphOptions& options, BAFile* ba_file) {
+  const double start_time = WallTimeInSeconds();
+  const int num_points = ba_file->num_points();
+  const int num_chunks =
+      (num_points + kNumPointsPerChunk - 1) / kNumPointsPerChunk;
+  double initial_cost = 0.0;
+  double final_cost = 0.0;
+  int num_failed_chunks = 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(options.solver_options.num_threads) \
+    schedule(dynamic) reduction(+: initial_cost, final_cost, num_failed_chunks)
+#endif
+  for (int k = 0; k < num_chunks; ++k) {
+    ceres::Solver::Summary summary;
+    RetriangulateChunk(options,
+                       k * kNumPointsPerChunk,
+                       std::min((k + 1) * kNumPointsPerChunk, num_points),
+                       ba_file,
+                       &summary);
+    initial_cost += summary.initial_cost;
+    final_cost += summary.final_cost;
+    num_failed_chunks += !summary.IsSolutionUsable();
+  }
+  if (num_failed_chunks > 0) {
+    LOG(WARNING) << "Re-triangulation failed for " << num_failed_chunks
+                 << " of " << num_chunks << " chunks of points.";
+  }
+  LOG(INFO) << "Re-triangulation of " << num_points << " points in "
+            << num_chunks << " chunks: the reprojection cost went from "
+            << initial_cost << " to " << final_cost << " in "
+            << WallTimeInSeconds() - start_time << " seconds.";
+  return final_cost;
+}
+
+}  // namespace
+
+void SolveWithPoseGraph(const PoseGraphOptions& options,
+                        BAFile* ba_file,
+                        ceres::Solver::Summary* summary) {
+  CHECK(options.create_reprojection_error != NULL);
+  const double initial_cost =
+      ReprojectionCost(*ba_file, options.solver_options.num_threads);
+  ba_file->IndexObservationsByPose();
+
+  std::vector<CovisibilityEdge> edges;
+  SelectEdges(options, *ba_file, &edges);
+
+  std::vector<RelativePose> relative_poses(edges.size());
+  std::vector<char> is_valid(edges.size(), 0);
+  const int num_edges = edges.size();
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(options.solver_options.num_threads) \
+    schedule(dynamic)
+#endif
+  for (int i = 0; i < num_edges; ++i) {
+    is_valid[i] =
+        ComputeRelativePose(options, edges[i], ba_file, &relative_poses[i]);
+  }
+  int num_valid = 0;
+  for (int i = 0; i < num_edges; ++i) {
+    if (is_valid[i]) {
+      relative_poses[num_valid++] = relative_poses[i];
+    }
+  }
+  relative_poses.resize(num_valid);
+  if (num_valid < num_edges) {
+    LOG(WARNING) << "Dropped " << num_edges - num_valid << " of "
+                 << num_edges << " relative poses, whose points do not "
+                 << "constrain them.";
+  }
+
+  SolvePoseGraph(options, relative_poses, ba_file, summary);
+  LOG(INFO) << "Pose graph: " << summary->BriefReport();
+
+  // The summary reports the reprojection cost, which is what the pose
+  // graph approximates, rather than the cost of the pose graph.
+  summary->initial_cost = initial_cost;
+  summary->final_cost = Retriangulate(options, ba_file);
+}
+
+}  // namespace openMVG
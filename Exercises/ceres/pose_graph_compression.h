@@ -0,0 +1,91 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_POSE_GRAPH_COMPRESSION_H_
+#define EXERCISES_CERES_POSE_GRAPH_COMPRESSION_H_
+
+#include "bundle_adjustment.h"
+#include "ceres/ceres.h"
+
+namespace openMVG {
+
+class BAFile;
+
+struct PoseGraphOptions {
+  PoseGraphOptions()
+      : max_edges_per_pose(5),
+        min_shared_points(30),
+        create_reprojection_error(NULL) {}
+
+  // Every pose is connected to at most max_edges_per_pose of the poses
+  // it shares the most points with, ignoring those it shares fewer
+  // than min_shared_points with.
+  int max_edges_per_pose;
+  int min_shared_points;
+
+  // Used for the pose graph and the re-triangulation, with linear
+  // solvers suited to them. Its num_threads is also the number of
+  // threads the relative pose constraints and the re-triangulation
+  // chunks are computed with.
+  ceres::Solver::Options solver_options;
+
+  ReprojectionErrorFactory create_reprojection_error;
+};
+
+// Approximate bundle adjustment of ba_file, whose cost scales with the
+// number of poses instead of the number of observations.
+//
+//  1. The poses are connected to their most covisible neighbors. For
+//     every edge (i, j), pose j is refined relative to pose i from the
+//     observations of the points both see, with pose i held constant
+//     and the length of the baseline held near its initial value by a
+//     prior, since two views do not determine it. The points are then
+//     marginalized: the Schur complement of the points in the Hessian
+//     of the reprojection errors, without the prior, is the
+//     information of the relative pose, which leaves the length of
+//     the baseline free. The edges are independent and only ever hold
+//     the points of one of them, so they are computed in parallel.
+//
+//  2. The pose graph made of these relative pose constraints is
+//     optimized, with the first pose held constant and the global
+//     scale fixed by the length of one baseline. Its summary is
+//     returned in summary, except that the initial and final costs
+//     are the reprojection costs of ba_file before step 1 and after
+//     step 3. The pose graph costs are logged.
+//
+//  3. The points are re-triangulated with the poses held constant,
+//     which decouples them, so they are solved in small chunks of
+//     points in parallel.
+//
+// The intrinsics are held constant throughout. Poses without any
+// edges keep their values.
+void SolveWithPoseGraph(const PoseGraphOptions& options,
+                        BAFile* ba_file,
+                        ceres::Solver::Summary* summary);
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_POSE_GRAPH_COMPRESSION_H_
@@ -0,0 +1,140 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_RANDOM_H_
+#define EXERCISES_CERES_RANDOM_H_
+
+#include <math.h>
+#include <stdint.h>
+
+namespace openMVG {
+
+// The Philox4x32-10 counter based pseudo random number generator from
+//
+// J. K. Salmon, M. A. Moraes, R. O. Dror and D. E. Shaw, "Parallel
+// Random Numbers: As Easy as 1, 2, 3", SC 2011.
+//
+// It maps a 64 bit key and a 128 bit counter to 128 random bits. There
+// is no state, so random numbers indexed by, e.g., the id of the
+// element they perturb can be generated in any order and on any number
+// of threads with identical results.
+inline void Philox4x32(const uint32_t key[2],
+                       const uint32_t counter[4],
+                       uint32_t result[4]) {
+  uint32_t k0 = key[0];
+  uint32_t k1 = key[1];
+  uint32_t c0 = counter[0];
+  uint32_t c1 = counter[1];
+  uint32_t c2 = counter[2];
+  uint32_t c3 = counter[3];
+  for (int round = 0; round < 10; ++round) {
+    const uint64_t product0 = static_cast<uint64_t>(0xD2511F53) * c0;
+    const uint64_t product1 = static_cast<uint64_t>(0xCD9E8D57) * c2;
+    const uint32_t hi0 = static_cast<uint32_t>(product0 >> 32);
+    const uint32_t lo0 = static_cast<uint32_t>(product0);
+    const uint32_t hi1 = static_cast<uint32_t>(product1 >> 32);
+    const uint32_t lo1 = static_cast<uint32_t>(product1);
+    c0 = hi1 ^ c1 ^ k0;
+    c1 = lo1;
+    c2 = hi0 ^ c3 ^ k1;
+    c3 = lo0;
+    k0 += 0x9E3779B9;
+    k1 += 0xBB67AE85;
+  }
+  result[0] = c0;
+  result[1] = c1;
+  result[2] = c2;
+  result[3] = c3;
+}
+
+// Random numbers determined by a seed and an arbitrary 128 bit
+// counter. The counter is split into a 64 bit index, typically the id
+// of the element being perturbed, a stream id, which distinguishes
+// the different uses of random numbers for the same element, and a
+// block number, for when more than one call per element is needed.
+class CounterBasedRandom {
+ public:
+  explicit CounterBasedRandom(const uint32_t seed) {
+    key_[0] = seed;
+    key_[1] = 0;
+  }
+
+  void Bits(const uint64_t index,
+            const uint32_t stream,
+            const uint32_t block,
+            uint32_t bits[4]) const {
+    const uint32_t counter[4] = {
+      static_cast<uint32_t>(index),
+      static_cast<uint32_t>(index >> 32),
+      stream,
+      block
+    };
+    Philox4x32(key_, counter, bits);
+  }
+
+  // Two uniformly distributed numbers in [0, 1) with 53 random bits
+  // each.
+  void Uniform(const uint64_t index,
+               const uint32_t stream,
+               const uint32_t block,
+               double* u1,
+               double* u2) const {
+    uint32_t bits[4];
+    Bits(index, stream, block, bits);
+    *u1 = ToUniform(bits[0], bits[1]);
+    *u2 = ToUniform(bits[2], bits[3]);
+  }
+
+  // Two independent standard normal numbers, using the Box-Muller
+  // transform. The results are identical across platforms, up to the
+  // accuracy of the log, sqrt, sin and cos implementations.
+  void Normal(const uint64_t index,
+              const uint32_t stream,
+              const uint32_t block,
+              double* n1,
+              double* n2) const {
+    double u1, u2;
+    Uniform(index, stream, block, &u1, &u2);
+    // 1 - u1 is in (0, 1], so the logarithm is finite.
+    const double radius = sqrt(-2.0 * log(1.0 - u1));
+    const double theta = 2.0 * M_PI * u2;
+    *n1 = radius * cos(theta);
+    *n2 = radius * sin(theta);
+  }
+
+ private:
+  static double ToUniform(const uint32_t hi, const uint32_t lo) {
+    const uint64_t bits =
+        (static_cast<uint64_t>(hi >> 5) << 26) | static_cast<uint64_t>(lo >> 6);
+    return bits * (1.0 / 9007199254740992.0);
+  }
+
+  uint32_t key_[2];
+};
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_RANDOM_H_
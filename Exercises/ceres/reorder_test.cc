@@ -0,0 +1,186 @@
+// Ceres Solver - A fast non-linear least squares minimizer
+// Copyright 2015 Google Inc. All rights reserved.
+// http://ceres-solver.org/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Reorders a random reconstruction with each of the reorderings, and
+// with both in turn, and exits with a non-zero status unless the
+// reordered BAFile describes the same reconstruction under its
+// original ids, and RestoreOriginalOrder restores it exactly.
+//
+// Usage: reorder_test [--logtostderr]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#include "ba_file.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+namespace openMVG {
+namespace {
+
+const char kFilename[] = "reorder_test.baf";
+
+double RandomDouble(const double min, const double max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+void WriteTestFile() {
+  const int num_poses = 30;
+  const int num_points = 5000;
+  std::ofstream of(kFilename);
+  CHECK(of.good()) << "Unable to open file: " << kFilename;
+  of.precision(17);
+  of << "2\n" << num_poses << "\n" << num_points << "\n";
+  of << "1000 320 240 0 0 0\n" << "1200 320 240 0.1 0 0\n";
+  for (int i = 0; i < num_poses; ++i) {
+    of << "1 0 0 0 1 0 0 0 1 " << RandomDouble(-10.0, 10.0) << " "
+       << RandomDouble(-10.0, 10.0) << " " << RandomDouble(-10.0, 10.0)
+       << "\n";
+  }
+  for (int i = 0; i < num_points; ++i) {
+    const int num_observations = 1 + rand() % 5;
+    of << RandomDouble(-100.0, 100.0) << " " << RandomDouble(-100.0, 100.0)
+       << " " << RandomDouble(-100.0, 100.0) << " " << num_observations;
+    for (int j = 0; j < num_observations; ++j) {
+      of << " " << rand() % 2 << " " << rand() % num_poses << " "
+         << RandomDouble(0.0, 640.0) << " " << RandomDouble(0.0, 480.0);
+    }
+    of << "\n";
+  }
+  CHECK(of.good()) << "Error writing to file: " << kFilename;
+}
+
+bool IsSameObservation(const Observation& a, const Observation& b) {
+  return a.intrinsics_id == b.intrinsics_id && a.pose_id == b.pose_id &&
+      a.x == b.x && a.y == b.y;
+}
+
+// Returns the number of poses and points of actual which differ from
+// those of expected with the same original id, and checks that the
+// poses and points are in the original order if is_original_order.
+int CompareBAFiles(const BAFile& expected,
+                   const BAFile& actual,
+                   const bool is_original_order) {
+  CHECK_EQ(actual.num_poses(), expected.num_poses());
+  CHECK_EQ(actual.num_points(), expected.num_points());
+
+  int num_failures = 0;
+  for (int i = 0; i < actual.num_poses(); ++i) {
+    const int original_id = actual.OriginalPoseId(i);
+    const double* a = actual.GetPose(i);
+    const double* e = expected.GetPose(original_id);
+    num_failures += (is_original_order && original_id != i) ||
+        !std::equal(a, a + 6, e);
+  }
+  for (int i = 0; i < actual.num_points(); ++i) {
+    const int original_id = actual.OriginalPointId(i);
+    const double* a = actual.GetPoint(i);
+    const double* e = expected.GetPoint(original_id);
+    const ObservationSpan a_observations = actual.ObservationsForPoint(i);
+    const ObservationSpan e_observations =
+        expected.ObservationsForPoint(original_id);
+    bool is_same = (!is_original_order || original_id == i) &&
+        std::equal(a, a + 3, e) &&
+        a_observations.size() == e_observations.size();
+    for (int j = 0; j < a_observations.size() && is_same; ++j) {
+      Observation observation = a_observations[j];
+      observation.pose_id = actual.OriginalPoseId(observation.pose_id);
+      is_same = IsSameObservation(observation, e_observations[j]);
+    }
+    num_failures += !is_same;
+  }
+  return num_failures;
+}
+
+// Returns the number of failures.
+int CheckReorderings(const std::vector<BAFile::ReorderingType>& types,
+                     const char* name,
+                     const BAFile& expected) {
+  BAFile actual(kFilename);
+  for (int i = 0; i < types.size(); ++i) {
+    actual.Reorder(types[i]);
+  }
+  int num_failures = 0;
+  int num_moved_points = 0;
+  for (int i = 0; i < actual.num_points(); ++i) {
+    num_moved_points += actual.OriginalPointId(i) != i;
+  }
+  if (num_moved_points == 0) {
+    LOG(ERROR) << name << ": no point was moved.";
+    ++num_failures;
+  }
+  if (CompareBAFiles(expected, actual, false) > 0) {
+    LOG(ERROR) << name << ": the reordered reconstruction differs.";
+    ++num_failures;
+  }
+
+  actual.RestoreOriginalOrder();
+  if (CompareBAFiles(expected, actual, true) > 0) {
+    LOG(ERROR) << name << ": the restored reconstruction differs.";
+    ++num_failures;
+  }
+  if (num_failures == 0) {
+    LOG(INFO) << name << ": passed.";
+  }
+  return num_failures;
+}
+
+}  // namespace
+}  // namespace openMVG
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  srand(5);
+  openMVG::WriteTestFile();
+  const openMVG::BAFile expected(openMVG::kFilename);
+
+  typedef openMVG::BAFile BAFile;
+  std::vector<BAFile::ReorderingType> types;
+  int num_failures = 0;
+  types.push_back(BAFile::SPACE_FILLING_CURVE);
+  num_failures += openMVG::CheckReorderings(types, "Space filling curve",
+                                            expected);
+  types[0] = BAFile::DOMINANT_CAMERA;
+  num_failures += openMVG::CheckReorderings(types, "Dominant camera",
+                                            expected);
+  types.push_back(BAFile::SPACE_FILLING_CURVE);
+  num_failures += openMVG::CheckReorderings(types, "Both", expected);
+  remove(openMVG::kFilename);
+
+  if (num_failures > 0) {
+    LOG(ERROR) << num_failures << " checks failed.";
+    return 1;
+  }
+  LOG(INFO) << "All reorderings were restored.";
+  return 0;
+}
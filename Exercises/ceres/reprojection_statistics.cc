@@ -0,0 +1,317 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "reprojection_statistics.h"
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "ba_file.h"
+#include "camera_models.h"
+#include "ceres/rotation.h"
+#include "glog/logging.h"
+
+namespace openMVG {
+namespace {
+
+// Number of observations projected together. The projection loops
+// over a batch have a constant trip count and no branches, so they are
+// vectorized for whatever SIMD instruction set the compiler targets.
+const int kBatchSize = 8;
+
+// Number of points per unit of work given to a thread.
+const int kPointsPerBlock = 4096;
+
+// The rigid transformations of the poses, as row major 3x4 matrices
+// [R | -R c] mapping world points into the camera frame.
+const int kTransformSize = 12;
+
+// A batch of observations, with everything needed to project them
+// gathered into arrays indexed by the position in the batch.
+struct ObservationBatch {
+  double point[3][kBatchSize];
+  double transform[kTransformSize][kBatchSize];
+  double intrinsics[kMaxNumIntrinsicParameters][kBatchSize];
+  double observed[2][kBatchSize];
+  double residuals[2][kBatchSize];
+};
+
+// Project all the observations of the batch and compute their
+// residuals. All the camera models are evaluated as BROWN_T2, which
+// gives the same results since BAFile::SetCameraModel zeroes the
+// parameters a model does not use.
+void ProjectBatch(ObservationBatch* batch) {
+  for (int i = 0; i < kBatchSize; ++i) {
+    const double p0 = batch->point[0][i];
+    const double p1 = batch->point[1][i];
+    const double p2 = batch->point[2][i];
+    const double q0 = batch->transform[0][i] * p0 +
+                      batch->transform[1][i] * p1 +
+                      batch->transform[2][i] * p2 +
+                      batch->transform[3][i];
+    const double q1 = batch->transform[4][i] * p0 +
+                      batch->transform[5][i] * p1 +
+                      batch->transform[6][i] * p2 +
+                      batch->transform[7][i];
+    const double q2 = batch->transform[8][i] * p0 +
+                      batch->transform[9][i] * p1 +
+                      batch->transform[10][i] * p2 +
+                      batch->transform[11][i];
+    const double inverse_depth = 1.0 / q2;
+    const double x_u = q0 * inverse_depth;
+    const double y_u = q1 * inverse_depth;
+
+    const double k1 = batch->intrinsics[OFFSET_DISTO_K1][i];
+    const double k2 = batch->intrinsics[OFFSET_DISTO_K2][i];
+    const double k3 = batch->intrinsics[OFFSET_DISTO_K3][i];
+    const double t1 = batch->intrinsics[OFFSET_DISTO_T1][i];
+    const double t2 = batch->intrinsics[OFFSET_DISTO_T2][i];
+    const double r2 = x_u * x_u + y_u * y_u;
+    const double r4 = r2 * r2;
+    const double r6 = r4 * r2;
+    const double r_coeff = 1.0 + k1 * r2 + k2 * r4 + k3 * r6;
+    const double xy = x_u * y_u;
+    const double x_d =
+        x_u * r_coeff + 2.0 * t1 * xy + t2 * (r2 + 2.0 * x_u * x_u);
+    const double y_d =
+        y_u * r_coeff + t1 * (r2 + 2.0 * y_u * y_u) + 2.0 * t2 * xy;
+
+    const double focal = batch->intrinsics[OFFSET_FOCAL_LENGTH][i];
+    batch->residuals[0][i] = batch->intrinsics[OFFSET_PRINCIPAL_POINT_X][i] +
+                             focal * x_d - batch->observed[0][i];
+    batch->residuals[1][i] = batch->intrinsics[OFFSET_PRINCIPAL_POINT_Y][i] +
+                             focal * y_d - batch->observed[1][i];
+  }
+}
+
+// Evaluates the observations of a range of points, one batch at a
+// time, and accumulates the number of observations and the squared
+// norms of their residuals per pose.
+class BatchEvaluator {
+ public:
+  BatchEvaluator(const BAFile& ba_file,
+                 const std::vector<double>& transforms,
+                 double* residuals,
+                 int* num_observations_per_pose,
+                 double* squared_norms_per_pose)
+      : ba_file_(ba_file),
+        transforms_(transforms),
+        residuals_(residuals),
+        num_observations_per_pose_(num_observations_per_pose),
+        squared_norms_per_pose_(squared_norms_per_pose),
+        size_(0) {}
+
+  // Add the observations of a point, the first of which has id
+  // observation_id.
+  void AddPoint(int point_id, int observation_id) {
+    const double* point = ba_file_.GetPoint(point_id);
+    const ObservationSpan observations =
+        ba_file_.ObservationsForPoint(point_id);
+    for (int i = 0; i < observations.size(); ++i) {
+      const int pose_id = observations.pose_id(i);
+      const double* transform = &transforms_[kTransformSize * pose_id];
+      const double* intrinsics =
+          ba_file_.GetIntrinsics(observations.intrinsics_id(i));
+      for (int j = 0; j < 3; ++j) {
+        batch_.point[j][size_] = point[j];
+      }
+      for (int j = 0; j < kTransformSize; ++j) {
+        batch_.transform[j][size_] = transform[j];
+      }
+      for (int j = 0; j < kMaxNumIntrinsicParameters; ++j) {
+        batch_.intrinsics[j][size_] = intrinsics[j];
+      }
+      batch_.observed[0][size_] = observations.x(i);
+      batch_.observed[1][size_] = observations.y(i);
+      pose_ids_[size_] = pose_id;
+      observation_ids_[size_] = observation_id + i;
+      if (++size_ == kBatchSize) {
+        Flush();
+      }
+    }
+  }
+
+  void Flush() {
+    if (size_ == 0) {
+      return;
+    }
+
+    // Fill the rest of a partial batch with copies of its first
+    // observation, so that the projection only sees valid data.
+    for (int i = size_; i < kBatchSize; ++i) {
+      CopyObservation(0, i);
+    }
+
+    ProjectBatch(&batch_);
+
+    for (int i = 0; i < size_; ++i) {
+      const double r0 = batch_.residuals[0][i];
+      const double r1 = batch_.residuals[1][i];
+      ++num_observations_per_pose_[pose_ids_[i]];
+      squared_norms_per_pose_[pose_ids_[i]] += r0 * r0 + r1 * r1;
+      if (residuals_ != NULL) {
+        residuals_[2 * observation_ids_[i]] = r0;
+        residuals_[2 * observation_ids_[i] + 1] = r1;
+      }
+    }
+    size_ = 0;
+  }
+
+ private:
+  void CopyObservation(int from, int to) {
+    for (int j = 0; j < 3; ++j) {
+      batch_.point[j][to] = batch_.point[j][from];
+    }
+    for (int j = 0; j < kTransformSize; ++j) {
+      batch_.transform[j][to] = batch_.transform[j][from];
+    }
+    for (int j = 0; j < kMaxNumIntrinsicParameters; ++j) {
+      batch_.intrinsics[j][to] = batch_.intrinsics[j][from];
+    }
+    batch_.observed[0][to] = batch_.observed[0][from];
+    batch_.observed[1][to] = batch_.observed[1][from];
+  }
+
+  const BAFile& ba_file_;
+  const std::vector<double>& transforms_;
+  double* residuals_;
+  int* num_observations_per_pose_;
+  double* squared_norms_per_pose_;
+  ObservationBatch batch_;
+  int pose_ids_[kBatchSize];
+  int observation_ids_[kBatchSize];
+  int size_;
+};
+
+}  // namespace
+
+void ComputeReprojectionStatistics(const BAFile& ba_file,
+                                   const int num_threads,
+                                   std::vector<double>* residuals,
+                                   ReprojectionStatistics* statistics) {
+  CHECK_GE(num_threads, 1);
+  const int num_poses = ba_file.num_poses();
+  const int num_points = ba_file.num_points();
+
+  std::vector<double> transforms(kTransformSize * num_poses);
+  for (int i = 0; i < num_poses; ++i) {
+    const double* pose = ba_file.GetPose(i);
+    double* transform = &transforms[kTransformSize * i];
+    double rotation[9];
+    ceres::AngleAxisToRotationMatrix(pose,
+                                     ceres::RowMajorAdapter3x3(rotation));
+    for (int j = 0; j < 3; ++j) {
+      const double* row = rotation + 3 * j;
+      std::copy(row, row + 3, transform + 4 * j);
+      transform[4 * j + 3] =
+          -(row[0] * pose[3] + row[1] * pose[4] + row[2] * pose[5]);
+    }
+  }
+
+  // The observations of the points of each block start where the
+  // previous block's end.
+  const int num_blocks = (num_points + kPointsPerBlock - 1) / kPointsPerBlock;
+  std::vector<int> block_observation_offsets(num_blocks + 1, 0);
+  for (int i = 0; i < num_blocks; ++i) {
+    const int end = std::min(num_points, (i + 1) * kPointsPerBlock);
+    int num_observations = 0;
+    for (int j = i * kPointsPerBlock; j < end; ++j) {
+      num_observations += ba_file.ObservationsForPoint(j).size();
+    }
+    block_observation_offsets[i + 1] =
+        block_observation_offsets[i] + num_observations;
+  }
+
+  double* residual_data = NULL;
+  if (residuals != NULL) {
+    residuals->resize(2 * ba_file.num_observations());
+    residual_data = residuals->empty() ? NULL : &(*residuals)[0];
+  }
+
+  // Per thread counts of the observations of each pose and sums of the
+  // squared norms of their residuals.
+  std::vector<int> counts(num_threads * num_poses, 0);
+  std::vector<double> squared_norms(num_threads * num_poses, 0.0);
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(num_threads)
+#endif
+  {
+    int thread_id = 0;
+#ifdef _OPENMP
+    thread_id = omp_get_thread_num();
+#endif
+    BatchEvaluator evaluator(ba_file,
+                             transforms,
+                             residual_data,
+                             &counts[thread_id * num_poses],
+                             &squared_norms[thread_id * num_poses]);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (int i = 0; i < num_blocks; ++i) {
+      const int end = std::min(num_points, (i + 1) * kPointsPerBlock);
+      int observation_id = block_observation_offsets[i];
+      for (int j = i * kPointsPerBlock; j < end; ++j) {
+        evaluator.AddPoint(j, observation_id);
+        observation_id += ba_file.ObservationsForPoint(j).size();
+      }
+      evaluator.Flush();
+    }
+  }
+
+  statistics->num_observations_per_pose.resize(num_poses);
+  statistics->rms_per_pose.resize(num_poses);
+  double total_squared_norm = 0.0;
+  for (int i = 0; i < num_poses; ++i) {
+    int num_observations = 0;
+    double squared_norm = 0.0;
+    for (int j = 0; j < num_threads; ++j) {
+      num_observations += counts[j * num_poses + i];
+      squared_norm += squared_norms[j * num_poses + i];
+    }
+    total_squared_norm += squared_norm;
+    statistics->num_observations_per_pose[i] = num_observations;
+    statistics->rms_per_pose[i] =
+        num_observations > 0 ? sqrt(squared_norm / num_observations) : 0.0;
+  }
+  statistics->rms = ba_file.num_observations() > 0
+      ? sqrt(total_squared_norm / ba_file.num_observations())
+      : 0.0;
+}
+
+double ReprojectionCost(const BAFile& ba_file, const int num_threads) {
+  ReprojectionStatistics statistics;
+  ComputeReprojectionStatistics(ba_file, num_threads, NULL, &statistics);
+  return 0.5 * ba_file.num_observations() * statistics.rms * statistics.rms;
+}
+
+}  // namespace openMVG
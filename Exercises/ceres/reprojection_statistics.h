@@ -0,0 +1,72 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_REPROJECTION_STATISTICS_H_
+#define EXERCISES_CERES_REPROJECTION_STATISTICS_H_
+
+#include <vector>
+
+namespace openMVG {
+
+class BAFile;
+
+struct ReprojectionStatistics {
+  // Root mean square of the norms of the reprojection errors of all
+  // the observations, in pixels.
+  double rms;
+
+  // The number of observations made by each pose and the root mean
+  // square of the norms of their reprojection errors. The RMS of a
+  // pose without observations is zero.
+  std::vector<int> num_observations_per_pose;
+  std::vector<double> rms_per_pose;
+};
+
+// Evaluate the reprojection errors of all the observations of
+// ba_file. If residuals is not NULL, it is resized to contain the
+// residuals of observation i at 2 * i and 2 * i + 1.
+//
+// This evaluates the same residuals as the cost functions given to
+// the solver, for any of the camera models, but without going through
+// them: the rigid transformation of each pose is computed once, and
+// the observations are projected in batches laid out so that the
+// compiler can vectorize the projection. The work is divided between
+// num_threads threads. Each thread accumulates its own per pose sums,
+// so the statistics can differ in the last bits with the number of
+// threads, but the residuals do not.
+void ComputeReprojectionStatistics(const BAFile& ba_file,
+                                   int num_threads,
+                                   std::vector<double>* residuals,
+                                   ReprojectionStatistics* statistics);
+
+// The cost of the bundle adjustment problem of ba_file, i.e., half the
+// sum of the squared norms of the reprojection errors, as it is
+// reported in Solver::Summary.
+double ReprojectionCost(const BAFile& ba_file, int num_threads);
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_REPROJECTION_STATISTICS_H_
@@ -0,0 +1,178 @@
+// Ceres Solver - A fast non-linear least squares minimizer
+// Copyright 2015 Google Inc. All rights reserved.
+// http://ceres-solver.org/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Reads a random reconstruction with and without
+// Options::single_precision_observations, and exits with a non-zero
+// status unless the single precision observations are the double
+// precision ones rounded to floats, and stay so through a binary BAF
+// file read with either precision, and through a double precision
+// binary BAF file read in single precision.
+//
+// Usage: single_precision_test [--logtostderr]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#include "ba_file.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+namespace openMVG {
+namespace {
+
+const char kTextFilename[] = "single_precision_test.baf";
+const char kFloatFilename[] = "single_precision_test_float.bafb";
+const char kDoubleFilename[] = "single_precision_test_double.bafb";
+
+double RandomDouble(const double min, const double max) {
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+void WriteTestFile() {
+  const int num_poses = 20;
+  const int num_points = 2000;
+  std::ofstream of(kTextFilename);
+  CHECK(of.good()) << "Unable to open file: " << kTextFilename;
+  of.precision(17);
+  of << "2\n" << num_poses << "\n" << num_points << "\n";
+  of << "1000 320 240 0 0 0\n" << "1200 320 240 0.1 0 0\n";
+  for (int i = 0; i < num_poses; ++i) {
+    of << "1 0 0 0 1 0 0 0 1 " << RandomDouble(-10.0, 10.0) << " "
+       << RandomDouble(-10.0, 10.0) << " " << RandomDouble(-10.0, 10.0)
+       << "\n";
+  }
+  for (int i = 0; i < num_points; ++i) {
+    const int num_observations = 1 + rand() % 5;
+    of << RandomDouble(-100.0, 100.0) << " " << RandomDouble(-100.0, 100.0)
+       << " " << RandomDouble(-100.0, 100.0) << " " << num_observations;
+    for (int j = 0; j < num_observations; ++j) {
+      of << " " << rand() % 2 << " " << rand() % num_poses << " "
+         << RandomDouble(0.0, 640.0) << " " << RandomDouble(0.0, 480.0);
+    }
+    of << "\n";
+  }
+  CHECK(of.good()) << "Error writing to file: " << kTextFilename;
+}
+
+// Returns the number of failures. The parameters of actual must be
+// identical to those of expected, and its observations must be those
+// of expected rounded to floats.
+int CheckBAFile(const std::string& name,
+                const BAFile& expected,
+                const BAFile& actual) {
+  CHECK_EQ(actual.num_intrinsics(), expected.num_intrinsics());
+  CHECK_EQ(actual.num_poses(), expected.num_poses());
+  CHECK_EQ(actual.num_points(), expected.num_points());
+  CHECK_EQ(actual.num_observations(), expected.num_observations());
+
+  int num_failures = 0;
+  for (int i = 0; i < actual.num_intrinsics(); ++i) {
+    num_failures += !std::equal(actual.GetIntrinsics(i),
+                                actual.GetIntrinsics(i) + 6,
+                                expected.GetIntrinsics(i));
+  }
+  for (int i = 0; i < actual.num_poses(); ++i) {
+    num_failures += !std::equal(actual.GetPose(i), actual.GetPose(i) + 6,
+                                expected.GetPose(i));
+  }
+  for (int i = 0; i < actual.num_points(); ++i) {
+    num_failures += !std::equal(actual.GetPoint(i), actual.GetPoint(i) + 3,
+                                expected.GetPoint(i));
+  }
+  if (num_failures > 0) {
+    LOG(ERROR) << name << ": " << num_failures << " parameter blocks differ.";
+  }
+
+  int num_wrong_observations = 0;
+  for (int i = 0; i < actual.num_observations(); ++i) {
+    const Observation a = actual.GetObservation(i);
+    const Observation e = expected.GetObservation(i);
+    num_wrong_observations +=
+        a.intrinsics_id != e.intrinsics_id || a.pose_id != e.pose_id ||
+        a.x != static_cast<float>(e.x) || a.y != static_cast<float>(e.y);
+  }
+  if (num_wrong_observations > 0) {
+    LOG(ERROR) << name << ": " << num_wrong_observations
+               << " observations are not rounded to floats.";
+  }
+  num_failures += num_wrong_observations;
+  if (num_failures == 0) {
+    LOG(INFO) << name << ": passed.";
+  }
+  return num_failures;
+}
+
+}  // namespace
+}  // namespace openMVG
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  using openMVG::BAFile;
+  srand(5);
+  openMVG::WriteTestFile();
+  BAFile::Options single_precision_options;
+  single_precision_options.single_precision_observations = true;
+
+  int num_failures = 0;
+  {
+    const BAFile expected(openMVG::kTextFilename);
+    const BAFile actual(openMVG::kTextFilename, single_precision_options);
+    num_failures += openMVG::CheckBAFile("Text file", expected, actual);
+    actual.WriteToBinaryBAFFile(openMVG::kFloatFilename);
+    expected.WriteToBinaryBAFFile(openMVG::kDoubleFilename);
+
+    const BAFile float_file(openMVG::kFloatFilename);
+    num_failures += openMVG::CheckBAFile("Single precision binary file",
+                                         expected, float_file);
+    const BAFile float_file_in_single_precision(openMVG::kFloatFilename,
+                                                single_precision_options);
+    num_failures += openMVG::CheckBAFile(
+        "Single precision binary file read in single precision",
+        expected, float_file_in_single_precision);
+    const BAFile double_file_in_single_precision(openMVG::kDoubleFilename,
+                                                 single_precision_options);
+    num_failures += openMVG::CheckBAFile(
+        "Double precision binary file read in single precision",
+        expected, double_file_in_single_precision);
+  }
+  remove(openMVG::kTextFilename);
+  remove(openMVG::kFloatFilename);
+  remove(openMVG::kDoubleFilename);
+
+  if (num_failures > 0) {
+    LOG(ERROR) << num_failures << " checks failed.";
+    return 1;
+  }
+  LOG(INFO) << "All observations were read in single precision.";
+  return 0;
+}
@@ -0,0 +1,590 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "submap_bundle_adjustment.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "ba_file.h"
+#include "ceres/ceres.h"
+#include "ceres/rotation.h"
+#include "cost_function_arena.h"
+#include "glog/logging.h"
+#include "linear_solver_planner.h"
+#include "reprojection_statistics.h"
+#include "wall_time.h"
+
+namespace openMVG {
+namespace {
+
+// A submap is the range of poses [begin_pose, end_pose) and the points
+// they observe at least twice. Poses which observe none of these
+// points are not part of its problem, and has_pose is false for them.
+// Its poses followed by its points are returned at result_offset in
+// the results of the workers.
+struct Submap {
+  int begin_pose;
+  int end_pose;
+  std::vector<int> point_ids;
+  std::vector<bool> has_pose;
+  size_t result_offset;
+};
+
+int NumParameters(const Submap& submap) {
+  return 6 * (submap.end_pose - submap.begin_pose) +
+      3 * submap.point_ids.size();
+}
+
+// Memory shared with the worker processes. Mapping it before forking
+// makes it shared, unlike the rest of the address space, which is
+// copy-on-write.
+class SharedMemory {
+ public:
+  explicit SharedMemory(const size_t size) : size_(size) {
+    data_ = mmap(NULL, size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(data_ != MAP_FAILED) << "mmap failed: " << strerror(errno);
+  }
+
+  ~SharedMemory() { munmap(data_, size_); }
+
+  void* data() { return data_; }
+
+ private:
+  void* data_;
+  size_t size_;
+
+  SharedMemory(const SharedMemory&);
+  void operator=(const SharedMemory&);
+};
+
+// The layout of the shared memory: the index of the next submap to be
+// solved, which the workers increment atomically, the status of every
+// submap, and the results.
+struct WorkerResults {
+  WorkerResults(void* data, const int num_submaps)
+      : next_submap(static_cast<int64_t*>(data)),
+        solved(next_submap + 1),
+        parameters(reinterpret_cast<double*>(solved + num_submaps)) {}
+
+  static size_t Size(const int num_submaps, const size_t num_parameters) {
+    return (1 + num_submaps) * sizeof(int64_t) +
+        num_parameters * sizeof(double);
+  }
+
+  int64_t* next_submap;
+  int64_t* solved;
+  double* parameters;
+};
+
+void PartitionIntoSubmaps(const SubmapOptions& options,
+                          const BAFile& ba_file,
+                          std::vector<Submap>* submaps,
+                          std::vector<int>* point_owners) {
+  const int size = options.max_num_poses;
+  const int overlap = options.num_overlapping_poses;
+  const int num_poses = ba_file.num_poses();
+  const int num_submaps = (num_poses + size - 1) / size;
+  submaps->resize(num_submaps);
+  for (int k = 0; k < num_submaps; ++k) {
+    Submap& submap = (*submaps)[k];
+    submap.begin_pose = std::max(0, k * size - overlap);
+    submap.end_pose = std::min(num_poses, (k + 1) * size + overlap);
+    submap.has_pose.resize(submap.end_pose - submap.begin_pose, false);
+  }
+
+  // Count the observations of each point in every submap containing
+  // one of its poses. Tracks are short, so a vector of (submap, count)
+  // pairs searched linearly is enough.
+  point_owners->resize(ba_file.num_points());
+  std::vector<std::pair<int, int> > counts;
+  for (int i = 0; i < ba_file.num_points(); ++i) {
+    counts.clear();
+    const ObservationSpan observations = ba_file.ObservationsForPoint(i);
+    for (int j = 0; j < observations.size(); ++j) {
+      const int pose_id = observations.pose_id(j);
+      // Submap k contains pose_id if k * size - overlap <= pose_id <
+      // (k + 1) * size + overlap.
+      const int first = std::max(0, (pose_id - overlap) / size - 1);
+      const int last = std::min(num_submaps - 1, (pose_id + overlap) / size);
+      for (int k = first; k <= last; ++k) {
+        const Submap& submap = (*submaps)[k];
+        if (pose_id < submap.begin_pose || pose_id >= submap.end_pose) {
+          continue;
+        }
+        int c = 0;
+        while (c < counts.size() && counts[c].first != k) {
+          ++c;
+        }
+        if (c == counts.size()) {
+          counts.push_back(std::make_pair(k, 0));
+        }
+        ++counts[c].second;
+      }
+    }
+
+    // The owner is the submap containing the most observations of the
+    // point. Ties go to the submap owning the most of its poses, which
+    // solves the point with the poses it is merged with.
+    int owner = -1;
+    int owner_count = 1;
+    int owner_num_owned_poses = 0;
+    for (int c = 0; c < counts.size(); ++c) {
+      if (counts[c].second < 2) {
+        continue;
+      }
+      const int k = counts[c].first;
+      Submap& submap = (*submaps)[k];
+      submap.point_ids.push_back(i);
+      int num_owned_poses = 0;
+      for (int j = 0; j < observations.size(); ++j) {
+        const int pose_id = observations.pose_id(j);
+        if (pose_id >= submap.begin_pose && pose_id < submap.end_pose) {
+          submap.has_pose[pose_id - submap.begin_pose] = true;
+        }
+        if (pose_id / size == k) {
+          ++num_owned_poses;
+        }
+      }
+      if (counts[c].second > owner_count ||
+          (counts[c].second == owner_count &&
+           num_owned_poses > owner_num_owned_poses)) {
+        owner = k;
+        owner_count = counts[c].second;
+        owner_num_owned_poses = num_owned_poses;
+      }
+    }
+    (*point_owners)[i] = owner;
+  }
+
+  size_t offset = 0;
+  for (int k = 0; k < num_submaps; ++k) {
+    (*submaps)[k].result_offset = offset;
+    offset += NumParameters((*submaps)[k]);
+  }
+}
+
+// Solve submap and write its poses and points to result. The
+// parameters of ba_file are restored afterwards, so that the next
+// submap solved by the same worker starts from the initial values too.
+void SolveSubmap(const SubmapOptions& options,
+                 const ceres::Solver::Options& solver_options,
+                 const Submap& submap,
+                 BAFile* ba_file,
+                 double* result) {
+  const int num_pose_parameters = 6 * (submap.end_pose - submap.begin_pose);
+  std::copy(ba_file->GetPose(submap.begin_pose),
+            ba_file->GetPose(submap.begin_pose) + num_pose_parameters,
+            result);
+  for (int i = 0; i < submap.point_ids.size(); ++i) {
+    const double* point = ba_file->GetPoint(submap.point_ids[i]);
+    std::copy(point, point + 3, result + num_pose_parameters + 3 * i);
+  }
+  const std::vector<double> initial_values(
+      result, result + NumParameters(submap));
+
+  CostFunctionArena arena;
+  ceres::Problem::Options problem_options;
+  problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  ceres::Problem problem(problem_options);
+  std::vector<bool> has_intrinsics(ba_file->num_intrinsics(), false);
+  for (int i = 0; i < submap.point_ids.size(); ++i) {
+    const int point_id = submap.point_ids[i];
+    const ObservationSpan observations =
+        ba_file->ObservationsForPoint(point_id);
+    for (int j = 0; j < observations.size(); ++j) {
+      const Observation obs = observations[j];
+      if (obs.pose_id < submap.begin_pose || obs.pose_id >= submap.end_pose) {
+        continue;
+      }
+      problem.AddResidualBlock(
+          options.create_reprojection_error(*ba_file, obs, &arena),
+          NULL,
+          ba_file->GetIntrinsics(obs.intrinsics_id),
+          ba_file->GetPose(obs.pose_id),
+          ba_file->GetPoint(point_id));
+      has_intrinsics[obs.intrinsics_id] = true;
+    }
+  }
+  for (int i = 0; i < has_intrinsics.size(); ++i) {
+    if (has_intrinsics[i]) {
+      problem.SetParameterBlockConstant(ba_file->GetIntrinsics(i));
+    }
+  }
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(solver_options, &problem, &summary);
+  VLOG(1) << "Submap of poses [" << submap.begin_pose << ", "
+          << submap.end_pose << "): " << summary.BriefReport();
+
+  std::copy(ba_file->GetPose(submap.begin_pose),
+            ba_file->GetPose(submap.begin_pose) + num_pose_parameters,
+            result);
+  std::copy(initial_values.begin(),
+            initial_values.begin() + num_pose_parameters,
+            ba_file->GetPose(submap.begin_pose));
+  for (int i = 0; i < submap.point_ids.size(); ++i) {
+    double* point = ba_file->GetPoint(submap.point_ids[i]);
+    std::copy(point, point + 3, result + num_pose_parameters + 3 * i);
+    std::copy(&initial_values[num_pose_parameters + 3 * i],
+              &initial_values[num_pose_parameters + 3 * i] + 3,
+              point);
+  }
+}
+
+void RunWorker(const SubmapOptions& options,
+               const std::vector<Submap>& submaps,
+               BAFile* ba_file,
+               WorkerResults* results) {
+  ceres::Solver::Options solver_options = options.solver_options;
+  solver_options.minimizer_progress_to_stdout = false;
+  solver_options.logging_type = ceres::SILENT;
+  solver_options.callbacks.clear();
+  // The parent has used OpenMP before forking, e.g., to read the BAF
+  // file, and the thread pool of libgomp does not survive fork, so a
+  // worker must not start any threads of its own. The parallelism
+  // comes from the number of workers instead.
+  SetNumThreads(1, &solver_options);
+
+  // Submaps are handed out one at a time, so the workers stay busy
+  // even if the submaps take different amounts of time to solve.
+  while (true) {
+    const int64_t k = __sync_fetch_and_add(results->next_submap, 1);
+    if (k >= static_cast<int64_t>(submaps.size())) {
+      break;
+    }
+    SolveSubmap(options,
+                solver_options,
+                submaps[k],
+                ba_file,
+                results->parameters + submaps[k].result_offset);
+    results->solved[k] = 1;
+  }
+}
+
+// Solve all the submaps in options.num_processes child processes.
+void SolveSubmapsInWorkers(const SubmapOptions& options,
+                           const std::vector<Submap>& submaps,
+                           BAFile* ba_file,
+                           WorkerResults* results) {
+  std::vector<pid_t> pids;
+  for (int i = 0; i < options.num_processes; ++i) {
+    const pid_t pid = fork();
+    CHECK_GE(pid, 0) << "fork failed: " << strerror(errno);
+    if (pid == 0) {
+      RunWorker(options, submaps, ba_file, results);
+      _exit(0);
+    }
+    pids.push_back(pid);
+  }
+
+  int64_t peak_memory_bytes = 0;
+  for (int i = 0; i < pids.size(); ++i) {
+    int status = 0;
+    rusage usage;
+    CHECK_EQ(wait4(pids[i], &status, 0, &usage), pids[i])
+        << "wait4 failed: " << strerror(errno);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        << "Submap worker " << i << " failed.";
+    // ru_maxrss is in kilobytes on Linux.
+    peak_memory_bytes = std::max(
+        peak_memory_bytes, static_cast<int64_t>(usage.ru_maxrss) * 1024);
+  }
+  for (int k = 0; k < submaps.size(); ++k) {
+    CHECK_EQ(results->solved[k], 1) << "Submap " << k << " was not solved.";
+  }
+  LOG(INFO) << "Peak resident memory of a submap worker: "
+            << peak_memory_bytes / (1024.0 * 1024.0) << " MB.";
+}
+
+// The similarity transform x -> scale * rotation * x + translation.
+struct Similarity {
+  Similarity()
+      : scale(1.0),
+        rotation(Eigen::Matrix3d::Identity()),
+        translation(Eigen::Vector3d::Zero()) {}
+
+  double scale;
+  Eigen::Matrix3d rotation;
+  Eigen::Vector3d translation;
+};
+
+// The similarity which best maps the solved points of submap onto
+// their current values in ba_file, in the least squares sense.
+Similarity AlignSubmap(const Submap& submap,
+                       const double* result,
+                       const BAFile& ba_file) {
+  Similarity similarity;
+  const int num_points = submap.point_ids.size();
+  if (num_points < 3) {
+    return similarity;
+  }
+
+  const double* solved_points =
+      result + 6 * (submap.end_pose - submap.begin_pose);
+  Eigen::Matrix3Xd source(3, num_points);
+  Eigen::Matrix3Xd target(3, num_points);
+  for (int i = 0; i < num_points; ++i) {
+    source.col(i) = Eigen::Map<const Eigen::Vector3d>(solved_points + 3 * i);
+    target.col(i) = Eigen::Map<const Eigen::Vector3d>(
+        ba_file.GetPoint(submap.point_ids[i]));
+  }
+  const Eigen::Matrix4d transform = Eigen::umeyama(source, target, true);
+  similarity.scale = transform.block<3, 1>(0, 0).norm();
+  similarity.rotation = transform.block<3, 3>(0, 0) / similarity.scale;
+  similarity.translation = transform.block<3, 1>(0, 3);
+  return similarity;
+}
+
+void TransformPoint(const Similarity& similarity,
+                    const double* point,
+                    double* transformed_point) {
+  const Eigen::Map<const Eigen::Vector3d> x(point);
+  Eigen::Map<Eigen::Vector3d> transformed_x(transformed_point);
+  transformed_x =
+      similarity.scale * similarity.rotation * x + similarity.translation;
+}
+
+// A camera maps x to R (x - c). After the change of coordinates
+// x' = s Q x + t it maps x' to R Q^T (x' - c') / s with c' = s Q c + t,
+// and the scale does not change the projection.
+void TransformPose(const Similarity& similarity,
+                   const double* pose,
+                   double* transformed_pose) {
+  Eigen::Matrix3d rotation;
+  ceres::AngleAxisToRotationMatrix(
+      pose, ceres::ColumnMajorAdapter3x3(rotation.data()));
+  const Eigen::Matrix3d transformed_rotation =
+      rotation * similarity.rotation.transpose();
+  ceres::RotationMatrixToAngleAxis(
+      ceres::ColumnMajorAdapter3x3(transformed_rotation.data()),
+      transformed_pose);
+  TransformPoint(similarity, pose + 3, transformed_pose + 3);
+}
+
+// Replace the parameters of ba_file by the aligned results of the
+// submaps owning them.
+void MergeSubmaps(const SubmapOptions& options,
+                  const std::vector<Submap>& submaps,
+                  const std::vector<int>& point_owners,
+                  const double* results,
+                  BAFile* ba_file) {
+  // All the submaps are aligned to the initial values before any of
+  // them is overwritten.
+  std::vector<Similarity> similarities(submaps.size());
+  for (int k = 0; k < submaps.size(); ++k) {
+    similarities[k] = AlignSubmap(submaps[k],
+                                  results + submaps[k].result_offset,
+                                  *ba_file);
+    VLOG(1) << "Submap " << k << " scale: " << similarities[k].scale;
+  }
+
+  for (int k = 0; k < submaps.size(); ++k) {
+    const Submap& submap = submaps[k];
+    const double* result = results + submap.result_offset;
+    const int begin = k * options.max_num_poses;
+    const int end = std::min(begin + options.max_num_poses,
+                             ba_file->num_poses());
+    for (int pose_id = begin; pose_id < end; ++pose_id) {
+      if (!submap.has_pose[pose_id - submap.begin_pose]) {
+        continue;
+      }
+      TransformPose(similarities[k],
+                    result + 6 * (pose_id - submap.begin_pose),
+                    ba_file->GetPose(pose_id));
+    }
+
+    const double* points = result + 6 * (submap.end_pose - submap.begin_pose);
+    for (int i = 0; i < submap.point_ids.size(); ++i) {
+      const int point_id = submap.point_ids[i];
+      if (point_owners[point_id] == k) {
+        TransformPoint(similarities[k],
+                       points + 3 * i,
+                       ba_file->GetPoint(point_id));
+      }
+    }
+  }
+}
+
+// Refine the poses which are in more than one submap or which are not
+// in the problem of the submap owning them, and the points which are
+// observed from the poses of more than one submap, or which are in
+// none, with everything else held constant.
+void SolveSeparators(const SubmapOptions& options,
+                     const std::vector<Submap>& submaps,
+                     const std::vector<int>& point_owners,
+                     BAFile* ba_file,
+                     ceres::Solver::Summary* summary) {
+  const int size = options.max_num_poses;
+  const int num_poses = ba_file->num_poses();
+  std::vector<int> num_submaps_for_pose(num_poses, 0);
+  for (int k = 0; k < submaps.size(); ++k) {
+    for (int pose_id = submaps[k].begin_pose;
+         pose_id < submaps[k].end_pose;
+         ++pose_id) {
+      ++num_submaps_for_pose[pose_id];
+    }
+  }
+  // MergeSubmaps leaves the poses which are not in the problem of their
+  // submap at their initial values, so they are refined here against
+  // the merged points.
+  std::vector<bool> is_separator_pose(num_poses, false);
+  for (int pose_id = 0; pose_id < num_poses; ++pose_id) {
+    const Submap& owner = submaps[pose_id / size];
+    is_separator_pose[pose_id] = num_submaps_for_pose[pose_id] > 1 ||
+        !owner.has_pose[pose_id - owner.begin_pose];
+  }
+
+  std::vector<bool> is_separator_point(ba_file->num_points(), false);
+  for (int i = 0; i < ba_file->num_points(); ++i) {
+    const ObservationSpan observations = ba_file->ObservationsForPoint(i);
+    bool is_separator = point_owners[i] < 0;
+    for (int j = 1; j < observations.size() && !is_separator; ++j) {
+      is_separator = observations.pose_id(j) / size !=
+          observations.pose_id(0) / size;
+    }
+    is_separator_point[i] = is_separator;
+  }
+
+  // The residuals of the separator points, and those of the separator
+  // poses with the other points.
+  CostFunctionArena arena;
+  ceres::Problem::Options problem_options;
+  problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  ceres::Problem problem(problem_options);
+  std::vector<bool> has_intrinsics(ba_file->num_intrinsics(), false);
+  std::vector<bool> has_pose(num_poses, false);
+  std::vector<int> constant_point_ids;
+  for (int point_id = 0; point_id < ba_file->num_points(); ++point_id) {
+    const ObservationSpan observations =
+        ba_file->ObservationsForPoint(point_id);
+    bool has_point = false;
+    for (int j = 0; j < observations.size(); ++j) {
+      const Observation obs = observations[j];
+      if (!is_separator_point[point_id] && !is_separator_pose[obs.pose_id]) {
+        continue;
+      }
+      problem.AddResidualBlock(
+          options.create_reprojection_error(*ba_file, obs, &arena),
+          NULL,
+          ba_file->GetIntrinsics(obs.intrinsics_id),
+          ba_file->GetPose(obs.pose_id),
+          ba_file->GetPoint(point_id));
+      has_intrinsics[obs.intrinsics_id] = true;
+      has_pose[obs.pose_id] = true;
+      has_point = true;
+    }
+    if (has_point && !is_separator_point[point_id]) {
+      problem.SetParameterBlockConstant(ba_file->GetPoint(point_id));
+    }
+  }
+  for (int i = 0; i < has_intrinsics.size(); ++i) {
+    if (has_intrinsics[i]) {
+      problem.SetParameterBlockConstant(ba_file->GetIntrinsics(i));
+    }
+  }
+  int num_separator_poses = 0;
+  for (int pose_id = 0; pose_id < num_poses; ++pose_id) {
+    if (!has_pose[pose_id]) {
+      continue;
+    }
+    if (is_separator_pose[pose_id]) {
+      ++num_separator_poses;
+    } else {
+      problem.SetParameterBlockConstant(ba_file->GetPose(pose_id));
+    }
+  }
+
+  LOG(INFO) << "Separator problem: " << num_separator_poses << " poses, "
+            << std::count(is_separator_point.begin(),
+                          is_separator_point.end(),
+                          true)
+            << " points, " << problem.NumResidualBlocks()
+            << " residual blocks.";
+  ceres::Solve(options.solver_options, &problem, summary);
+}
+
+}  // namespace
+
+void SolveInSubmaps(const SubmapOptions& options,
+                    BAFile* ba_file,
+                    ceres::Solver::Summary* summary) {
+  CHECK_GE(options.max_num_poses, 1);
+  CHECK_GE(options.num_overlapping_poses, 0);
+  CHECK_GE(options.num_processes, 1);
+  CHECK(options.create_reprojection_error != NULL);
+
+  const double initial_cost =
+      ReprojectionCost(*ba_file, options.solver_options.num_threads);
+  double start_time = WallTimeInSeconds();
+  ba_file->Reorder(BAFile::DOMINANT_CAMERA);
+  std::vector<Submap> submaps;
+  std::vector<int> point_owners;
+  PartitionIntoSubmaps(options, *ba_file, &submaps, &point_owners);
+  size_t num_parameters = 0;
+  for (int k = 0; k < submaps.size(); ++k) {
+    num_parameters += NumParameters(submaps[k]);
+  }
+  LOG(INFO) << "Partitioned " << ba_file->num_poses() << " poses into "
+            << submaps.size() << " submaps in "
+            << WallTimeInSeconds() - start_time << " seconds.";
+
+  start_time = WallTimeInSeconds();
+  SharedMemory shared_memory(
+      WorkerResults::Size(submaps.size(), num_parameters));
+  WorkerResults results(shared_memory.data(), submaps.size());
+  SolveSubmapsInWorkers(options, submaps, ba_file, &results);
+  LOG(INFO) << "Solved " << submaps.size() << " submaps using "
+            << options.num_processes << " processes in "
+            << WallTimeInSeconds() - start_time << " seconds.";
+
+  start_time = WallTimeInSeconds();
+  MergeSubmaps(options, submaps, point_owners, results.parameters, ba_file);
+  LOG(INFO) << "Merged the submaps in "
+            << WallTimeInSeconds() - start_time << " seconds.";
+
+  SolveSeparators(options, submaps, point_owners, ba_file, summary);
+  LOG(INFO) << "Separator problem initial cost: " << summary->initial_cost
+            << " final cost: " << summary->final_cost;
+  summary->initial_cost = initial_cost;
+  summary->final_cost =
+      ReprojectionCost(*ba_file, options.solver_options.num_threads);
+}
+
+}  // namespace openMVG
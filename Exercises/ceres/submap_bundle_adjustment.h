@@ -0,0 +1,104 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_SUBMAP_BUNDLE_ADJUSTMENT_H_
+#define EXERCISES_CERES_SUBMAP_BUNDLE_ADJUSTMENT_H_
+
+#include "bundle_adjustment.h"
+#include "ceres/ceres.h"
+
+namespace openMVG {
+
+class BAFile;
+
+struct SubmapOptions {
+  SubmapOptions()
+      : max_num_poses(100),
+        num_overlapping_poses(10),
+        num_processes(1),
+        create_reprojection_error(NULL) {}
+
+  // Number of poses owned by each submap. Every submap also contains
+  // the num_overlapping_poses poses on either side of the ones it owns.
+  int max_num_poses;
+  int num_overlapping_poses;
+
+  // Number of worker processes the submaps are solved in. This is
+  // where the parallelism of the submap solves comes from, as each
+  // worker is single threaded.
+  int num_processes;
+
+  // Used for the submaps and for the separator pass. The submaps are
+  // solved silently, without the callbacks and with one thread.
+  ceres::Solver::Options solver_options;
+
+  ReprojectionErrorFactory create_reprojection_error;
+};
+
+// Bundle adjust ba_file one submap at a time, so that no process holds
+// a problem larger than a submap and its separators.
+//
+//  1. The poses are reordered in breadth first order of the
+//     covisibility graph and cut into consecutive ranges of
+//     max_num_poses, each of which is extended by
+//     num_overlapping_poses on either side to form a submap. A submap
+//     contains the points observed at least twice by its poses.
+//
+//  2. The submaps are solved independently, with the intrinsics held
+//     constant, in num_processes forked single threaded worker
+//     processes. The workers share the BAFile with the parent
+//     copy-on-write and return their results through shared memory.
+//
+//  3. Every submap is aligned to the initial reconstruction by the
+//     similarity transform which best maps its points onto their
+//     initial positions. Each pose then takes its value from the
+//     submap owning it, unless it observes none of the points of
+//     that submap, and each point from the submap containing the
+//     most of its observations, ties going to the submap owning the
+//     most of its poses.
+//
+//  4. A final problem refines the separators only: the poses in more
+//     than one submap or skipped in step 3, and the points observed
+//     from the poses of more than one submap or in none. Its summary is returned in summary,
+//     except that the initial and final costs are the reprojection
+//     costs of ba_file before step 1 and after step 4. The costs of
+//     the separator problem are logged.
+//
+// Only the Ceres problems are bounded by the size of the submaps, not
+// the memory of the processes. Every worker is forked with the whole
+// BAFile, which it shares copy-on-write with the parent but which
+// counts towards its resident memory as soon as it touches it, and
+// the reordering of step 1 copies all the observations and
+// parameters, on top of any reordering made by the caller.
+//
+// The reordering is not undone, see BAFile::RestoreOriginalOrder.
+void SolveInSubmaps(const SubmapOptions& options,
+                    BAFile* ba_file,
+                    ceres::Solver::Summary* summary);
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_SUBMAP_BUNDLE_ADJUSTMENT_H_
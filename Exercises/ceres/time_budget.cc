@@ -0,0 +1,87 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "time_budget.h"
+
+#include <algorithm>
+
+#include "ceres/ceres.h"
+#include "glog/logging.h"
+#include "wall_time.h"
+
+namespace openMVG {
+
+TimeBudget::TimeBudget(const double deadline, const int min_num_iterations)
+    : deadline_(deadline),
+      min_num_iterations_(min_num_iterations),
+      max_iteration_time_(0.0),
+      is_too_slow_(false),
+      is_out_of_time_(false) {
+}
+
+TimeBudget::~TimeBudget() {
+}
+
+ceres::CallbackReturnType TimeBudget::operator()(
+    const ceres::IterationSummary& summary) {
+  // Iteration 0 is the evaluation at the initial point.
+  if (summary.iteration == 0) {
+    return ceres::SOLVER_CONTINUE;
+  }
+
+  max_iteration_time_ =
+      std::max(max_iteration_time_, summary.iteration_time_in_seconds);
+  const double remaining_seconds = RemainingSeconds();
+  if (remaining_seconds < max_iteration_time_) {
+    LOG(INFO) << "Stopping with " << remaining_seconds
+              << " seconds left, the slowest iteration took "
+              << max_iteration_time_ << " seconds.";
+    is_out_of_time_ = true;
+    return ceres::SOLVER_TERMINATE_SUCCESSFULLY;
+  }
+  if (summary.iteration == 1 &&
+      remaining_seconds < min_num_iterations_ * max_iteration_time_) {
+    LOG(INFO) << "An iteration took " << max_iteration_time_
+              << " seconds, so fewer than " << min_num_iterations_
+              << " iterations fit in the remaining " << remaining_seconds
+              << " seconds.";
+    is_too_slow_ = true;
+    return ceres::SOLVER_TERMINATE_SUCCESSFULLY;
+  }
+  return ceres::SOLVER_CONTINUE;
+}
+
+double TimeBudget::RemainingSeconds() const {
+  return std::max(0.0, deadline_ - WallTimeInSeconds());
+}
+
+void TimeBudget::DisableFallback() {
+  max_iteration_time_ = 0.0;
+  min_num_iterations_ = 0;
+  is_too_slow_ = false;
+}
+
+}  // namespace openMVG
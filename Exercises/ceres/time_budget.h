@@ -0,0 +1,75 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of Google Inc. nor the names of its contributors may be
+//   used to endorse or promote products derived from this software without
+//   specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXERCISES_CERES_TIME_BUDGET_H_
+#define EXERCISES_CERES_TIME_BUDGET_H_
+
+#include "ceres/ceres.h"
+
+namespace openMVG {
+
+// Stops the solver before it starts an iteration which is not expected
+// to finish by a deadline, unlike Solver::Options::
+// max_solver_time_in_seconds, which is only checked once an iteration
+// is over. An iteration is expected to take as long as the slowest one
+// so far. Since the Levenberg-Marquardt algorithm only accepts steps
+// which reduce the cost, the parameters are the best ones found when
+// the solver stops.
+//
+// If after the first iteration fewer than min_num_iterations
+// iterations are expected to fit before the deadline, the solver is
+// stopped right away and is_too_slow() is true, so that the caller can
+// continue with a cheaper linear solver.
+class TimeBudget : public ceres::IterationCallback {
+ public:
+  // deadline is in seconds since the epoch, see WallTimeInSeconds.
+  TimeBudget(double deadline, int min_num_iterations);
+  virtual ~TimeBudget();
+
+  virtual ceres::CallbackReturnType operator()(
+      const ceres::IterationSummary& summary);
+
+  // Seconds left until the deadline, or zero if it has passed.
+  double RemainingSeconds() const;
+
+  // Forget the iteration times and stop checking whether the solver
+  // is too slow, before continuing with a cheaper linear solver.
+  void DisableFallback();
+
+  bool is_too_slow() const { return is_too_slow_; }
+  bool is_out_of_time() const { return is_out_of_time_; }
+
+ private:
+  const double deadline_;
+  int min_num_iterations_;
+  double max_iteration_time_;
+  bool is_too_slow_;
+  bool is_out_of_time_;
+};
+
+}  // namespace openMVG
+
+#endif  // EXERCISES_CERES_TIME_BUDGET_H_